@@ -21,12 +21,18 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <cstdio>
 #include <cstring>
 
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <random>
+#include <shared_mutex>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
@@ -412,4 +418,1116 @@ int main() {
       tiny_bench::escape(t.exists(long_word));
     });
   }
+
+  SECTION("BENCHMARK [impl4]")
+  {
+    MEASURE_EXPR(" ctor time", trie::impl4::trie<int> t);
+
+    START_MEASURE();
+    t.insert("cat", 1);
+    t.insert("bat", 2);
+    t.insert("cake", 3);
+    t.insert("bake", 4);
+    t.insert("abcd", 5);
+    t.insert("somereallylongword", 6);
+    t.insert(long_word, 7);
+    STOP_MEASURE("time to insert 6 elements");
+
+    MEASURE(ELM_COUNT_SMALL, t.exists("cat"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("catt"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    // fill with other garbage
+    MEASURE_EXPR(" inserting" ELM_COUNT,
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    });
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+  }
+
+  SECTION("BENCHMARK [impl5]")
+  {
+    MEASURE_EXPR(" ctor time", trie::impl5::trie<int> t);
+
+    START_MEASURE();
+    t.insert("cat", 1);
+    t.insert("bat", 2);
+    t.insert("cake", 3);
+    t.insert("bake", 4);
+    t.insert("abcd", 5);
+    t.insert("somereallylongword", 6);
+    t.insert(long_word, 7);
+    STOP_MEASURE("time to insert 6 elements");
+
+    MEASURE(ELM_COUNT_SMALL, t.exists("cat"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("catt"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    // fill with other garbage
+    MEASURE_EXPR(" inserting" ELM_COUNT,
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    });
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+  }
+
+  SECTION("BENCHMARK [impl2 allocation policies]")
+  {
+    auto heap_t = std::make_unique<trie::impl2::trie>();
+    MEASURE_EXPR(" inserting (heap_allocator)" ELM_COUNT,
+    for (auto& word : random_words) {
+      heap_t->insert(word);
+    });
+    MEASURE_EXPR(" destroying (heap_allocator)" ELM_COUNT, heap_t.reset());
+
+    auto arena_t = std::make_unique<trie::impl2::basic_trie<trie::arena_allocator>>();
+    MEASURE_EXPR(" inserting (arena_allocator)" ELM_COUNT,
+    for (auto& word : random_words) {
+      arena_t->insert(word);
+    });
+    MEASURE_EXPR(" destroying (arena_allocator)" ELM_COUNT, arena_t.reset());
+  }
+
+  SECTION("BENCHMARK [impl3 allocation policies]")
+  {
+    auto heap_t = std::make_unique<trie::impl3::trie<int>>();
+    MEASURE_EXPR(" inserting (heap_allocator)" ELM_COUNT,
+    for (auto& word : random_words) {
+      heap_t->insert(word, 10);
+    });
+    MEASURE_EXPR(" destroying (heap_allocator)" ELM_COUNT, heap_t.reset());
+
+    auto arena_t = std::make_unique<trie::impl3::trie<int, trie::arena_allocator>>();
+    MEASURE_EXPR(" inserting (arena_allocator)" ELM_COUNT,
+    for (auto& word : random_words) {
+      arena_t->insert(word, 10);
+    });
+    MEASURE_EXPR(" destroying (arena_allocator)" ELM_COUNT, arena_t.reset());
+  }
+
+  SECTION("BENCHMARK [impl3 frozen]")
+  {
+    trie::impl3::trie<int> source;
+    source.insert("cat", 1);
+    source.insert("bat", 2);
+    source.insert("cake", 3);
+    source.insert("bake", 4);
+    source.insert("abcd", 5);
+    source.insert("somereallylongword", 6);
+    source.insert(long_word, 7);
+    for (auto& word : random_words) {
+      source.insert(word, 10);
+    }
+
+    MEASURE_EXPR(" freezing" ELM_COUNT, auto t = source.freeze());
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+  }
+
+  SECTION("BENCHMARK [impl6]")
+  {
+    std::vector<std::pair<std::string, int>> pairs = {
+      { "cat", 1 }, { "bat", 2 }, { "cake", 3 }, { "bake", 4 }, { "abcd", 5 }, { "somereallylongword", 6 }, { long_word, 7 }
+    };
+    for (auto& word : random_words) {
+      pairs.emplace_back(word, 10);
+    }
+    MEASURE_EXPR(" sorting" ELM_COUNT, std::sort(std::begin(pairs), std::end(pairs)));
+
+    MEASURE_EXPR(" building" ELM_COUNT, trie::impl6::trie<int> t(trie::sorted_input, std::begin(pairs), std::end(pairs)));
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+
+    // every word, in an order the cache hasn't seen, next to the hash map
+    std::unordered_map<std::string, int> hash_map{std::begin(pairs), std::end(pairs)};
+    auto queries = random_words;
+    std::shuffle(std::begin(queries), std::end(queries), gen);
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" impl6 exists on every word" ELM_COUNT,
+    for (auto& word : queries) {
+      found += t.exists(word);
+    });
+    MEASURE_EXPR(" std::unordered_map find on every word" ELM_COUNT,
+    for (auto& word : queries) {
+      found += hash_map.find(word) != std::end(hash_map);
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [impl7]")
+  {
+    std::vector<std::pair<std::string, int>> pairs = {
+      { "cat", 1 }, { "bat", 2 }, { "cake", 3 }, { "bake", 4 }, { "abcd", 5 }, { "somereallylongword", 6 }, { long_word, 7 }
+    };
+    for (auto& word : random_words) {
+      pairs.emplace_back(word, 10);
+    }
+    MEASURE_EXPR(" sorting" ELM_COUNT, std::sort(std::begin(pairs), std::end(pairs)));
+
+    MEASURE_EXPR(" building" ELM_COUNT, trie::impl7::trie<int> t(trie::sorted_input, std::begin(pairs), std::end(pairs)));
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE(ELM_COUNT, t.get_words("abc"));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+
+    // the point of the succinct layout, next to the double array holding the same words
+    trie::impl6::trie<int> double_array(trie::sorted_input, std::begin(pairs), std::end(pairs));
+    std::cout << " impl7 " << t.node_count() << " nodes in " << t.size_in_bytes() << " bytes, impl6 "
+              << double_array.state_count() << " states of two ints each\n";
+
+    auto queries = random_words;
+    std::shuffle(std::begin(queries), std::end(queries), gen);
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" impl7 exists on every word" ELM_COUNT,
+    for (auto& word : queries) {
+      found += t.exists(word);
+    });
+    MEASURE_EXPR(" impl6 exists on every word" ELM_COUNT,
+    for (auto& word : queries) {
+      found += double_array.exists(word);
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [impl8]")
+  {
+    std::vector<std::pair<std::string, int>> pairs = {
+      { "cat", 1 }, { "bat", 2 }, { "cake", 3 }, { "bake", 4 }, { "abcd", 5 }, { "somereallylongword", 6 }, { long_word, 7 }
+    };
+    for (auto& word : random_words) {
+      pairs.emplace_back(word, 10);
+    }
+    MEASURE_EXPR(" sorting" ELM_COUNT, std::sort(std::begin(pairs), std::end(pairs)));
+
+    MEASURE_EXPR(" building" ELM_COUNT, trie::impl8::trie<int> t(trie::sorted_input, std::begin(pairs), std::end(pairs)));
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+
+    // random words share few suffixes, stems with common endings show what merging buys
+    std::vector<std::pair<std::string, int>> inflected;
+    for (auto& word : random_words) {
+      for (auto suffix : { "", "s", "ed", "ing", "er", "tion", "able", "ness" }) {
+        inflected.emplace_back(word + suffix, 10);
+      }
+    }
+    std::sort(std::begin(inflected), std::end(inflected));
+
+    MEASURE_EXPR(" building inflected" ELM_COUNT, trie::impl8::trie<int> dawg(trie::sorted_input, std::begin(inflected), std::end(inflected)));
+    trie::impl7::trie<int> plain(trie::sorted_input, std::begin(inflected), std::end(inflected));
+    std::cout << " " << dawg.size() << " words: impl8 " << dawg.state_count() << " states in " << dawg.size_in_bytes()
+              << " bytes, impl7 " << plain.node_count() << " nodes in " << plain.size_in_bytes() << " bytes\n";
+  }
+
+  SECTION("BENCHMARK [impl9]")
+  {
+    MEASURE_EXPR(" ctor time", trie::impl9::trie<int> t);
+
+    START_MEASURE();
+    t.insert("cat", 1);
+    t.insert("bat", 2);
+    t.insert("cake", 3);
+    t.insert("bake", 4);
+    t.insert("abcd", 5);
+    t.insert("somereallylongword", 6);
+    t.insert(long_word, 7);
+    STOP_MEASURE("time to insert 6 elements");
+
+    MEASURE(ELM_COUNT_SMALL, t.exists("cat"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("catt"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+    MEASURE(ELM_COUNT_SMALL, t.exists("bbake"));
+
+    // fill with other garbage
+    MEASURE_EXPR(" inserting" ELM_COUNT,
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    });
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+
+    // lookup speed against memory as the burst threshold moves
+    auto queries = random_words;
+    std::shuffle(std::begin(queries), std::end(queries), gen);
+    for (std::size_t threshold : { 256, 1024, 4096, 16384 }) {
+      trie::impl9::trie<int> tuned{threshold};
+      for (auto& word : random_words) {
+        tuned.insert(word, 10);
+      }
+      std::cout << " burst threshold " << threshold << ": " << tuned.trie_node_count() << " trie nodes, "
+                << tuned.container_count() << " containers, " << tuned.size_in_bytes() << " bytes\n";
+
+      std::size_t found = 0;
+      MEASURE_EXPR(" exists on every word" ELM_COUNT,
+      for (auto& word : queries) {
+        found += tuned.exists(word);
+      });
+      tiny_bench::escape(found);
+    }
+  }
+
+  SECTION("BENCHMARK [impl3 mapped]")
+  {
+    const char* path = "trie_benchmark_mapped.bin";
+    {
+      trie::impl3::trie<int> source;
+      source.insert("cat", 1);
+      source.insert("bat", 2);
+      source.insert("cake", 3);
+      source.insert("bake", 4);
+      source.insert("abcd", 5);
+      source.insert("somereallylongword", 6);
+      source.insert(long_word, 7);
+      for (auto& word : random_words) {
+        source.insert(word, 10);
+      }
+
+      std::ofstream file{path, std::ios::binary};
+      MEASURE_EXPR(" writing" ELM_COUNT, source.freeze().write(file));
+    }
+
+    trie::impl3::mapped_trie<int> t;
+    MEASURE(ELM_COUNT " (open)", t.open(path));
+
+    MEASURE(ELM_COUNT, t.exists("cat"));
+    MEASURE(ELM_COUNT, t.exists("catt"));
+    MEASURE(ELM_COUNT, t.exists("bake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("bbake"));
+    MEASURE(ELM_COUNT, t.exists("somereallylongword"));
+    MEASURE(ELM_COUNT, t.exists(long_word));
+
+    int value;
+    MEASURE(ELM_COUNT, t.value_at("cat", value));
+    MEASURE(ELM_COUNT, t.value_at("bake", value));
+    MEASURE(ELM_COUNT, t.value_at("not in list", value));
+
+    std::string match;
+    MEASURE(ELM_COUNT, t.prefix_match("so", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("ba", match));
+
+    match.clear();
+    MEASURE(ELM_COUNT, t.prefix_match("zz", match));
+
+    MEASURE_EXPR(ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(t.exists(long_word));
+    });
+
+    t.close();
+    std::remove(path);
+  }
+
+  SECTION("BENCHMARK [sorted bulk load]")
+  {
+    auto sorted_words = random_words;
+    MEASURE_EXPR(" sorting" ELM_COUNT, std::sort(std::begin(sorted_words), std::end(sorted_words)));
+
+    std::vector<std::pair<std::string, int>> sorted_pairs;
+    sorted_pairs.reserve(sorted_words.size());
+    for (auto& word : sorted_words) {
+      sorted_pairs.emplace_back(word, 10);
+    }
+
+    {
+      trie::impl2::trie t;
+      MEASURE_EXPR(" impl2 repeated insert" ELM_COUNT,
+      for (auto& word : sorted_words) {
+        t.insert(word);
+      });
+    }
+    MEASURE_EXPR(" impl2 bulk load" ELM_COUNT, trie::impl2::trie bulk_t2(trie::sorted_input, std::begin(sorted_words), std::end(sorted_words)));
+
+    {
+      trie::impl3::trie<int> t;
+      MEASURE_EXPR(" impl3 repeated insert" ELM_COUNT,
+      for (auto& word : sorted_words) {
+        t.insert(word, 10);
+      });
+    }
+    MEASURE_EXPR(" impl3 bulk load" ELM_COUNT, trie::impl3::trie<int> bulk_t3(trie::sorted_input, std::begin(sorted_pairs), std::end(sorted_pairs)));
+  }
+
+  SECTION("BENCHMARK [parallel bulk load]")
+  {
+    // random_words is in no particular order
+    std::vector<std::pair<std::string, int>> pairs;
+    pairs.reserve(random_words.size());
+    for (auto& word : random_words) {
+      pairs.emplace_back(word, 10);
+    }
+
+    {
+      trie::impl3::trie<int> t;
+      MEASURE_EXPR(" impl3 repeated insert" ELM_COUNT,
+      for (auto& pair : pairs) {
+        t.insert(pair.first, pair.second);
+      });
+    }
+
+    auto max_threads = std::max(1u, std::thread::hardware_concurrency());
+    // doubling, with every core as the last point even when that isn't a power of two
+    for (unsigned thread_count = 1;; thread_count = std::min(thread_count * 2, max_threads)) {
+      std::cout << " " << thread_count << " threads\n";
+      MEASURE_EXPR(" impl3 parallel bulk load" ELM_COUNT, trie::impl3::trie<int> bulk_t3(trie::parallel_input, std::begin(pairs), std::end(pairs), thread_count));
+      if (thread_count == max_threads) break;
+    }
+  }
+
+  SECTION("BENCHMARK [lazy iteration]")
+  {
+    trie::impl1::trie t1;
+    trie::impl3::trie<int> t3;
+    for (auto& word : random_words) {
+      t1.insert(word);
+      t3.insert(word, 10);
+    }
+
+    std::size_t chars = 0;
+    MEASURE_EXPR(" impl1 get_words" ELM_COUNT, auto words1 = t1.get_words());
+    MEASURE_EXPR(" impl1 iterate" ELM_COUNT,
+    for (auto& word : t1) {
+      chars += word.size();
+    });
+    MEASURE_EXPR(" impl3 get_words" ELM_COUNT, auto words3 = t3.get_words());
+    MEASURE_EXPR(" impl3 iterate" ELM_COUNT,
+    for (auto& word : t3) {
+      chars += word.size();
+    });
+    MEASURE_EXPR(" impl3 iterate words under 'ab'" ELM_COUNT,
+    for (auto it = t3.lower_bound("ab"); it != t3.end() && it->compare(0, 2, "ab") == 0; ++it) {
+      chars += it->size();
+    });
+    tiny_bench::escape(chars);
+  }
+
+  SECTION("BENCHMARK [impl3 top_k]")
+  {
+    trie::impl3::trie<int, trie::heap_allocator, trie::impl3::max_augment<>> t;
+    std::uniform_int_distribution<> score_dis{0, 1000000};
+    MEASURE_EXPR(" insert with max_augment" ELM_COUNT,
+    for (auto& word : random_words) {
+      t.insert(word, score_dis(gen));
+    });
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" top 10 of every word" ELM_COUNT, found += t.top_k("", 10).size());
+    MEASURE_EXPR(" top 10 under 'ab'" ELM_COUNT, found += t.top_k("ab", 10).size());
+    MEASURE_EXPR(" top 10 under 'ab' by walking every word" ELM_COUNT,
+    std::vector<std::pair<int, std::string>> scored;
+    for (auto it = t.lower_bound("ab"); it != t.end() && it->compare(0, 2, "ab") == 0; ++it) {
+      scored.emplace_back(it.value(), *it);
+    }
+    std::partial_sort(std::begin(scored), std::begin(scored) + std::min<std::size_t>(10, scored.size()), std::end(scored), std::greater<>{});
+    found += std::min<std::size_t>(10, scored.size()));
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [impl3 persistent]")
+  {
+    trie::impl3::persistent_trie<int> t;
+    MEASURE_EXPR(" insert, dropping the old versions" ELM_COUNT,
+    for (auto& word : random_words) {
+      t = t.insert(word, 10);
+    });
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" exists" ELM_COUNT,
+    for (auto& word : random_words) {
+      found += t.exists(word);
+    });
+    tiny_bench::escape(found);
+
+    // every version stays around, each one only costs the branches on the way to its word
+    std::vector<trie::impl3::persistent_trie<int>> versions{ t };
+    versions.reserve(10001);
+    MEASURE_EXPR(" erase keeping all 10000 versions" ELM_COUNT,
+    for (std::size_t i = 0; i != 10000; ++i) {
+      versions.push_back(versions.back().erase(random_words[i]));
+    });
+    tiny_bench::escape(versions.back().size());
+  }
+
+  SECTION("BENCHMARK [fuzzy search]")
+  {
+    trie::impl3::trie<int> t;
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    }
+
+    // misspellings: one char of each word swapped for another
+    std::vector<std::string> queries;
+    for (std::size_t i = 0; i != 1000; ++i) {
+      auto query = random_words[i];
+      query[query.size() / 2] = query[query.size() / 2] == 'z' ? 'a' : query[query.size() / 2] + 1;
+      queries.push_back(std::move(query));
+    }
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" exists on every edit of 1000 words" ELM_COUNT,
+    std::string candidate;
+    for (auto& query : queries) {
+      for (std::size_t i = 0; i <= query.size(); ++i) {
+        for (char c = 'a'; c <= 'z'; ++c) {
+          // insertions, then substitutions
+          candidate = query;
+          candidate.insert(i, 1, c);
+          found += t.exists(candidate);
+          if (i == query.size() || query[i] == c) continue;
+
+          candidate = query;
+          candidate[i] = c;
+          found += t.exists(candidate);
+        }
+        if (i == query.size()) continue;
+
+        // deletions
+        candidate = query;
+        candidate.erase(i, 1);
+        found += t.exists(candidate);
+      }
+    });
+    MEASURE_EXPR(" fuzzy_search distance 1 of 1000 words" ELM_COUNT,
+    for (auto& query : queries) {
+      found += t.fuzzy_search(query, 1).size();
+    });
+    MEASURE_EXPR(" fuzzy_search distance 2 of 1000 words" ELM_COUNT,
+    for (auto& query : queries) {
+      found += t.fuzzy_search(query, 2).size();
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [match pattern]")
+  {
+    trie::impl3::trie<int> t;
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    }
+
+    // 100 patterns like "ab?d*e*": a literal prefix, a wildcard, then stars
+    std::vector<std::string> patterns;
+    for (std::size_t i = 0; i != 100; ++i) {
+      auto& word = random_words[i];
+      patterns.push_back(word.substr(0, 2) + "?" + word.substr(3, 1) + "*" + word.substr(word.size() - 1) + "*");
+    }
+
+    std::function<bool(const char*, const char*)> glob = [&glob](const char* p, const char* w) {
+      if (!*p) return !*w;
+      if (*p == '*') return glob(p + 1, w) || (*w && glob(p, w + 1));
+      return *w && (*p == '?' || *p == *w) && glob(p + 1, w + 1);
+    };
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" glob over every word for 100 patterns" ELM_COUNT,
+    for (auto& pattern : patterns) {
+      for (auto& word : random_words) {
+        found += glob(pattern.c_str(), word.c_str());
+      }
+    });
+    MEASURE_EXPR(" match_pattern for 100 patterns" ELM_COUNT,
+    for (auto& pattern : patterns) {
+      t.match_pattern(pattern, [&found](const std::string&, int) { ++found; });
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [impl3 aho_corasick]")
+  {
+    // 10000 keys of 3 to 8 chars looked for in the text of 100000 other words
+    trie::impl3::trie<int> t;
+    for (std::size_t i = 0; i != 10000; ++i) {
+      t.insert(random_words[i].substr(0, 3 + i % 6), 10);
+    }
+
+    std::string text;
+    for (std::size_t i = 10000; i != 110000; ++i) {
+      text += random_words[i];
+    }
+
+    std::size_t found = 0;
+    MEASURE_EXPR(" exists at every offset and length" ELM_COUNT,
+    std::string candidate;
+    for (std::size_t offset = 0; offset != text.size(); ++offset) {
+      for (std::size_t len = 3; len <= 8 && offset + len <= text.size(); ++len) {
+        candidate.assign(text, offset, len);
+        found += t.exists(candidate);
+      }
+    });
+    tiny_bench::escape(found);
+
+    found = 0;
+    START_MEASURE();
+    trie::impl3::aho_corasick<int> automaton{t};
+    STOP_MEASURE(" building the automaton" ELM_COUNT);
+    MEASURE_EXPR(" scan" ELM_COUNT, automaton.scan(text, [&found](std::size_t, const std::string&, int) { ++found; }));
+    tiny_bench::escape(found);
+
+    found = 0;
+    MEASURE_EXPR(" scanner fed 4096 bytes at a time" ELM_COUNT,
+    auto scanner = automaton.make_scanner();
+    for (std::size_t first = 0; first < text.size(); first += 4096) {
+      scanner.feed(text.data() + first, std::min<std::size_t>(4096, text.size() - first),
+        [&found](std::size_t, const std::string&, int) { ++found; });
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [longest prefix]")
+  {
+    // a routing table: 1M ipv4-like prefixes of 1 to 4 bytes, mostly 3 bytes long like /24s
+    std::uniform_int_distribution<> byte_dis{0, 255};
+    std::discrete_distribution<>    length_dis{0, 1, 10, 80, 9};
+
+    trie::impl3::trie<int> t;
+    for (int i = 0; i != 256; ++i) {
+      t.insert(std::string(1, static_cast<char>(i)), i); // a default route for every first byte
+    }
+    for (int i = 0; i != ELMS; ++i) {
+      std::string prefix(static_cast<std::size_t>(length_dis(gen)), '\0');
+      for (auto& c : prefix) {
+        c = static_cast<char>(byte_dis(gen));
+      }
+      t.insert(prefix, i);
+    }
+    auto frozen = t.freeze();
+
+    // 10M addresses, 1M of them looked up 10 times over
+    std::vector<std::string> addresses(ELMS);
+    for (auto& address : addresses) {
+      address.resize(4);
+      for (auto& c : address) {
+        c = static_cast<char>(byte_dis(gen));
+      }
+    }
+
+    std::size_t found = 0;
+    std::string match;
+    int         value = 0;
+    MEASURE_EXPR(" exists on every prefix, longest first, 10M addresses",
+    for (int round = 0; round != 10; ++round) {
+      for (auto& address : addresses) {
+        for (auto len = address.size(); len != 0; --len) {
+          match.assign(address, 0, len);
+          if (t.value_at(match, value)) {
+            ++found;
+            break;
+          }
+        }
+      }
+    });
+    MEASURE_EXPR(" impl3 longest_prefix_of, 10M addresses",
+    for (int round = 0; round != 10; ++round) {
+      for (auto& address : addresses) {
+        found += t.longest_prefix_of(address, match, value);
+      }
+    });
+    MEASURE_EXPR(" impl3 frozen longest_prefix_of, 10M addresses",
+    for (int round = 0; round != 10; ++round) {
+      for (auto& address : addresses) {
+        found += frozen.longest_prefix_of(address, match, value);
+      }
+    });
+
+    std::vector<const int*> routes(addresses.size());
+    MEASURE_EXPR(" impl3 frozen longest_prefix_of_batch, 10M addresses",
+    for (int round = 0; round != 10; ++round) {
+      frozen.longest_prefix_of_batch(std::begin(addresses), std::end(addresses), std::begin(routes));
+      found += routes.size() - static_cast<std::size_t>(std::count(std::begin(routes), std::end(routes), nullptr));
+    });
+    tiny_bench::escape(found);
+  }
+
+  SECTION("BENCHMARK [impl3 counts]")
+  {
+    trie::impl3::trie<int, trie::heap_allocator, trie::impl3::count_augment> t;
+    MEASURE_EXPR(" insert with count_augment" ELM_COUNT,
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    });
+
+    // 1000 two char prefixes, about 1500 words under each
+    std::vector<std::string> prefixes;
+    for (std::size_t i = 0; i != 1000; ++i) {
+      prefixes.push_back(random_words[i].substr(0, 2));
+    }
+
+    std::size_t count = 0;
+    MEASURE_EXPR(" iterate the words under 1000 prefixes" ELM_COUNT,
+    for (auto& prefix : prefixes) {
+      for (auto it = t.lower_bound(prefix); it != t.end() && it->compare(0, 2, prefix) == 0; ++it) {
+        ++count;
+      }
+    });
+    MEASURE_EXPR(" count_prefix of 1000 prefixes" ELM_COUNT,
+    for (auto& prefix : prefixes) {
+      count += t.count_prefix(prefix);
+    });
+    MEASURE_EXPR(" rank of 1000 words" ELM_COUNT,
+    for (std::size_t i = 0; i != 1000; ++i) {
+      count += t.rank(random_words[i]);
+    });
+
+    // pages of 10 words at 100 places spread over the whole trie
+    std::string word;
+    MEASURE_EXPR(" select 100 pages of 10 words" ELM_COUNT,
+    for (std::size_t page = 0; page != 100; ++page) {
+      for (std::size_t i = 0; i != 10; ++i) {
+        count += t.select(page * (ELMS / 100) + i, word);
+      }
+    });
+    tiny_bench::escape(count);
+  }
+
+  SECTION("BENCHMARK [erase]")
+  {
+    trie::impl3::trie<int> t;
+    for (auto& word : random_words) {
+      t.insert(word, 10);
+    }
+
+    // a refresh which drops half of the words, next to building the smaller trie again
+    MEASURE_EXPR(" impl3 erase half" ELM_COUNT,
+    for (std::size_t i = 0; i < random_words.size(); i += 2) {
+      t.erase(random_words[i]);
+    });
+    MEASURE_EXPR(" impl3 rebuild with half" ELM_COUNT,
+    trie::impl3::trie<int> rebuilt;
+    for (std::size_t i = 1; i < random_words.size(); i += 2) {
+      rebuilt.insert(random_words[i], 10);
+    });
+  }
+
+  SECTION("BENCHMARK [batch lookups]")
+  {
+    trie::impl3::trie<int> t3;
+    trie::impl4::trie<int> t4;
+    for (auto& word : random_words) {
+      t3.insert(word, 10);
+      t4.insert(word, 10);
+    }
+    auto frozen = t3.freeze();
+
+    // look the words up in a different order than they went in so nothing is still in cache
+    auto queries = random_words;
+    std::shuffle(std::begin(queries), std::end(queries), gen);
+
+    std::vector<bool> found;
+    found.reserve(queries.size());
+
+    MEASURE_EXPR(" impl3 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t3.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl3 exists_batch" ELM_COUNT, t3.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    MEASURE_EXPR(" impl4 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t4.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl4 exists_batch" ELM_COUNT, t4.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    MEASURE_EXPR(" impl3 frozen exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(frozen.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl3 frozen exists_batch" ELM_COUNT, frozen.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    trie::impl6::trie<int> t6{t3};
+    trie::impl7::trie<int> t7{t3};
+    trie::impl8::trie<int> t8{t3};
+    trie::impl9::trie<int> t9;
+    for (auto& word : random_words) {
+      t9.insert(word, 10);
+    }
+
+    MEASURE_EXPR(" impl6 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t6.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl6 exists_batch" ELM_COUNT, t6.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    MEASURE_EXPR(" impl7 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t7.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl7 exists_batch" ELM_COUNT, t7.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    MEASURE_EXPR(" impl8 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t8.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl8 exists_batch" ELM_COUNT, t8.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+    found.clear();
+
+    MEASURE_EXPR(" impl9 exists" ELM_COUNT,
+    for (auto& word : queries) {
+      found.push_back(t9.exists(word));
+    });
+    found.clear();
+    MEASURE_EXPR(" impl9 exists_batch" ELM_COUNT, t9.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found)));
+  }
+
+  SECTION("BENCHMARK [simd compares]")
+  {
+    // the leaf compare and the split point of breakup_leaf on the longest key
+    auto other = long_word;
+    other.back() = '!';
+
+    MEASURE_EXPR(" std::equal" ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(std::equal(std::begin(long_word), std::end(long_word), std::begin(other)));
+    });
+    MEASURE_EXPR(" simd::equal" ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(trie::simd::equal(std::begin(long_word), std::end(long_word), std::begin(other), std::end(other)));
+    });
+
+    MEASURE_EXPR(" std::mismatch" ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(std::mismatch(std::begin(long_word), std::end(long_word), std::begin(other), std::end(other)).first);
+    });
+    MEASURE_EXPR(" simd::mismatch" ITER_COUNT,
+    for (int i = 0; i != ITERATIONS; ++i) {
+      tiny_bench::escape(trie::simd::mismatch(std::begin(long_word), std::end(long_word), std::begin(other), std::end(other)).first);
+    });
+  }
+
+  SECTION("BENCHMARK [impl3 concurrent]")
+  {
+    // half the words go in up front, the readers look those up while a writer adds the rest
+    auto half         = random_words.size() / 2;
+    auto reader_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+    auto run = [&](auto lookup, auto insert) {
+      std::atomic<bool>        done{false};
+      std::atomic<std::size_t> lookups{0};
+
+      std::vector<std::thread> readers;
+      for (unsigned r = 0; r != reader_count; ++r) {
+        readers.emplace_back([&, r] {
+          std::size_t count = 0;
+          for (std::size_t i = r; !done.load(std::memory_order_relaxed); ++i, ++count) {
+            lookup(random_words[(i * 7919) % half]);
+          }
+          lookups += count;
+        });
+      }
+
+      for (auto i = half; i != random_words.size(); ++i) {
+        insert(random_words[i]);
+      }
+      done = true;
+      for (auto& reader : readers) {
+        reader.join();
+      }
+      return lookups.load();
+    };
+
+    std::cout << " " << reader_count << " readers, 1 writer\n";
+    {
+      // what a single threaded trie needs: every read waits out every write
+      trie::impl3::trie<int> t;
+      std::shared_mutex      lock;
+      for (std::size_t i = 0; i != half; ++i) {
+        t.insert(random_words[i], 10);
+      }
+
+      START_MEASURE();
+      auto lookups = run([&](const std::string& word) {
+        std::shared_lock<std::shared_mutex> read{lock};
+        tiny_bench::escape(t.exists(word));
+      }, [&](const std::string& word) {
+        std::unique_lock<std::shared_mutex> write{lock};
+        t.insert(word, 10);
+      });
+      STOP_MEASURE(" impl3 behind a shared_mutex");
+      std::cout << lookups << " lookups\n";
+    }
+    {
+      trie::impl3::concurrent_trie<int> t;
+      for (std::size_t i = 0; i != half; ++i) {
+        t.insert(random_words[i], 10);
+      }
+
+      START_MEASURE();
+      auto lookups = run([&](const std::string& word) {
+        tiny_bench::escape(t.exists(word));
+      }, [&](const std::string& word) {
+        t.insert(word, 10);
+      });
+      STOP_MEASURE(" impl3 concurrent_trie");
+      std::cout << lookups << " lookups\n";
+    }
+  }
+
+  SECTION("BENCHMARK [impl3 sharded]")
+  {
+    // every thread inserts then looks up its own slice of the words, 1 thread up to all of them
+    auto max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    auto run = [&](unsigned thread_count, auto work) {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t != thread_count; ++t) {
+        threads.emplace_back([&, t] {
+          for (auto i = t; i < random_words.size(); i += thread_count) {
+            work(random_words[i]);
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    };
+
+    // doubling like the parallel bulk load, ending on every core
+    for (unsigned thread_count = 1;; thread_count = std::min(thread_count * 2, max_threads)) {
+      std::cout << " " << thread_count << " threads\n";
+      {
+        // one lock for the whole trie
+        trie::impl3::trie<int> t;
+        std::shared_mutex      lock;
+
+        START_MEASURE();
+        run(thread_count, [&](const std::string& word) {
+          std::unique_lock<std::shared_mutex> write{lock};
+          t.insert(word, 10);
+        });
+        STOP_MEASURE(" insert: impl3 behind a shared_mutex" ELM_COUNT);
+
+        START_MEASURE();
+        run(thread_count, [&](const std::string& word) {
+          std::shared_lock<std::shared_mutex> read{lock};
+          tiny_bench::escape(t.exists(word));
+        });
+        STOP_MEASURE(" exists: impl3 behind a shared_mutex" ELM_COUNT);
+      }
+      {
+        trie::impl3::sharded_trie<int> t;
+
+        START_MEASURE();
+        run(thread_count, [&](const std::string& word) { t.insert(word, 10); });
+        STOP_MEASURE(" insert: impl3 sharded_trie" ELM_COUNT);
+
+        START_MEASURE();
+        run(thread_count, [&](const std::string& word) { tiny_bench::escape(t.exists(word)); });
+        STOP_MEASURE(" exists: impl3 sharded_trie" ELM_COUNT);
+      }
+      if (thread_count == max_threads) break;
+    }
+  }
 }
@@ -25,13 +25,63 @@ SOFTWARE.
 #pragma once
 
 #include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 
 #include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <queue>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #include <xmmintrin.h>
+#endif
+
+// SSE2 comes with the target, AVX2 is compiled in and picked at runtime (see trie::simd)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define TRIE_HAS_SSE2
+  #include <emmintrin.h>
+  #if defined(__GNUC__) || defined(_MSC_VER)
+    #define TRIE_HAS_AVX2_DISPATCH
+    #include <immintrin.h>
+  #endif
+  #if defined(_MSC_VER)
+    #include <intrin.h>
+  #endif
+#endif
+
+#if defined(_WIN32)
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
 namespace trie {
 
 namespace impl1 {
@@ -102,34 +152,501 @@ public:
     return true;
   }
 
+  // a cursor like impl3::trie::const_iterator.  Every node here is one char, so each frame
+  // walks a std::map of children and the key grows by exactly one char per step
+  class const_iterator {
+    friend class trie;
+
+    typedef std::map<char, trie_node_t_>::const_iterator child_iterator;
+
+    struct frame_t {
+      child_iterator next;
+      child_iterator last;
+      std::size_t    key_size; // length of the key at this node
+    };
+
+    std::vector<frame_t> stack_;
+    std::string          key_;
+    const trie_node_t_*  node_ = nullptr; // the node of the current word, null at the end
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::string               value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const std::string*        pointer;
+    typedef const std::string&        reference;
+
+    const_iterator() = default;
+
+    reference operator*() const { return key_; }
+    pointer operator->() const { return &key_; }
+
+    const_iterator& operator++() {
+      advance_();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto ret = *this;
+      advance_();
+      return ret;
+    }
+
+    friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ == rhs.node_; }
+    friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ != rhs.node_; }
+
+  private:
+    void push_(const trie_node_t_& node) {
+      stack_.push_back({ std::begin(node.children), std::end(node.children), key_.size() });
+    }
+
+    // moves to the next word in order, or to the end
+    void advance_() {
+      node_ = nullptr;
+      while (!stack_.empty()) {
+        auto& top = stack_.back();
+        if (top.next == top.last) {
+          stack_.pop_back();
+          continue;
+        }
+
+        auto child = top.next++;
+        key_.resize(top.key_size);
+        key_.push_back(child->first);
+        push_(child->second); // invalidates top
+
+        if (child->second.is_word) {
+          node_ = &child->second;
+          return;
+        }
+      }
+      key_.clear();
+    }
+
+    void seek_(const trie_node_t_& root, const std::string& target) {
+      auto node = &root;
+      for (char c : target) {
+        // only the children after the one we go down are left to visit at this node
+        auto next = node->children.lower_bound(c);
+        stack_.push_back({ next, std::end(node->children), key_.size() });
+        if (next == std::end(node->children) || next->first != c) {
+          // everything left sorts after the target
+          advance_();
+          return;
+        }
+
+        ++stack_.back().next;
+        key_.push_back(c);
+        node = &next->second;
+      }
+
+      // everything under here sorts at or after the target
+      push_(*node);
+      if (node->is_word) {
+        node_ = node;
+        return;
+      }
+      advance_();
+    }
+  };
+
+  const_iterator begin() const {
+    const_iterator it;
+    it.push_(root_);
+    it.advance_();
+    return it;
+  }
+  const_iterator end() const { return {}; }
+
+  // the first word which doesn't sort before 'prefix'.  Keep walking while the words still
+  // start with 'prefix' to visit every word under it
+  const_iterator lower_bound(const std::string& prefix) const {
+    if (prefix.empty()) return begin();
+
+    const_iterator it;
+    it.seek_(root_, prefix);
+    return it;
+  }
+
   std::vector<std::string> get_words() const {
     std::vector<std::string> ret;
 
-    for (const auto& child : root_.children) {
-      get_words_impl_(ret, std::string(1, child.first), child.second);
+    for (const auto& word : *this) {
+      ret.push_back(word);
     }
 
     return ret;
   }
+};
 
-private:
-  void get_words_impl_(std::vector<std::string>& words, std::string prefix, const trie_node_t_& node) const {
-    if (node.is_word) words.push_back(prefix);
-    if (node.children.empty()) return;
+} // namespace impl1
+
+
+// tag for the constructors which take input that is already sorted
+struct sorted_input_t {
+  explicit sorted_input_t() = default;
+};
+constexpr sorted_input_t sorted_input{};
+
+// tag for the constructors which build from unsorted input on several threads
+struct parallel_input_t {
+  explicit parallel_input_t() = default;
+};
+constexpr parallel_input_t parallel_input{};
+
+namespace util {
+
+// hint that 'address' is about to be read
+inline void prefetch(const void* address) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+  __builtin_prefetch(address);
+#else
+  (void)address;
+#endif
+}
+
+// number of set bits in 'word'
+inline unsigned popcount(std::uint64_t word) {
+#if defined(__GNUC__)
+  return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+  word = word - ((word >> 1) & 0x5555555555555555ULL);
+  word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+  word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+  return static_cast<unsigned>((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+// index of the lowest set bit, 'word' can't be 0
+inline unsigned lowest_bit(std::uint64_t word) {
+#if defined(__GNUC__)
+  return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+  unsigned ret = 0;
+  for (; (word & 1) == 0; word >>= 1) ++ret;
+  return ret;
+#endif
+}
+
+// how many lookups a batch keeps in flight at once
+constexpr std::size_t batch_width = 8;
+
+// drives the batched lookups of the tries.  The words of [first, last) are looked up
+// batch_width at a time: start(word) creates the state of a lookup, step(state) moves it
+// one node down (prefetching the node it lands on) and returns false once it is done,
+// and finish(state) is what gets written to out for that word, in input order.
+// The states point into the words, so words which don't come out of the range as a
+// std::string living in it (const char*, string_view, words made by the iterator) are
+// copied into the batch first
+template <typename ForwardIt, typename OutputIt, typename Start, typename Step, typename Finish>
+OutputIt interleave_lookups(ForwardIt first, ForwardIt last, OutputIt out, Start start, Step step, Finish finish) {
+  typedef typename std::iterator_traits<ForwardIt>::reference reference;
+  typedef decltype(start(std::declval<const std::string&>())) state_t;
+
+  constexpr bool copy_words = !std::is_lvalue_reference<reference>::value ||
+                              !std::is_same<typename std::decay<reference>::type, std::string>::value;
+
+  std::string words[copy_words ? batch_width : 1];
+  state_t     states[batch_width];
+  bool        active[batch_width];
+  while (first != last) {
+    std::size_t count = 0;
+    for (; count != batch_width && first != last; ++count, ++first) {
+      if constexpr (copy_words) {
+        words[count]  = *first;
+        states[count] = start(words[count]);
+      }
+      else {
+        states[count] = start(*first);
+      }
+      active[count] = true;
+    }
+
+    // round robin so every lookup gets a step while the others' loads are in flight
+    for (auto remaining = count; remaining != 0;) {
+      for (std::size_t i = 0; i != count; ++i) {
+        if (active[i] && !step(states[i])) {
+          active[i] = false;
+          --remaining;
+        }
+      }
+    }
 
-    for (const auto& child : node.children) {
-      get_words_impl_(words, prefix + child.first, child.second);
+    for (std::size_t i = 0; i != count; ++i) {
+      *out++ = finish(states[i]);
     }
   }
+
+  return out;
+}
+
+} // namespace util
+
+
+// byte range compares for the long edge labels in leaves and compressed paths.  SSE2 is
+// part of x86-64 so it is used whenever the compiler targets it, AVX2 only once the CPU
+// says it has it, everything else gets the scalar loop
+namespace simd {
+
+namespace detail {
+
+inline std::size_t mismatch_scalar(const char* a, const char* b, std::size_t length) {
+  // a word at a time to skip over the equal part quickly, then the byte that differs
+  std::size_t i = 0;
+  for (; i + sizeof(std::uint64_t) <= length; i += sizeof(std::uint64_t)) {
+    std::uint64_t x;
+    std::uint64_t y;
+    std::memcpy(&x, a + i, sizeof(x));
+    std::memcpy(&y, b + i, sizeof(y));
+    if (x != y) break;
+  }
+  for (; i != length && a[i] == b[i]; ++i) { }
+  return i;
+}
+
+#if defined(TRIE_HAS_SSE2)
+// a set bit for every byte of the 16 at a and b which differs
+inline unsigned differ_sse2(const char* a, const char* b) {
+  auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  auto y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  return ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xffffu;
+}
+
+inline std::size_t mismatch_sse2(const char* a, const char* b, std::size_t length) {
+  if (length < 16) return mismatch_scalar(a, b, length);
+
+  // the last block overlaps the one before it rather than finishing with a byte loop,
+  // whatever it finds in the overlap is already known to be equal
+  std::size_t i = 0;
+  for (; i + 16 < length; i += 16) {
+    auto differ = differ_sse2(a + i, b + i);
+    if (differ != 0) return i + util::lowest_bit(differ);
+  }
+  i = length - 16;
+  auto differ = differ_sse2(a + i, b + i);
+  return differ != 0 ? i + util::lowest_bit(differ) : length;
+}
+#endif
+
+#if defined(TRIE_HAS_AVX2_DISPATCH)
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+inline unsigned differ_avx2(const char* a, const char* b) {
+  auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  auto y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+  return ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+}
+
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+inline std::size_t mismatch_avx2(const char* a, const char* b, std::size_t length) {
+  if (length < 32) return mismatch_sse2(a, b, length);
+
+  std::size_t i = 0;
+  for (; i + 32 < length; i += 32) {
+    auto differ = differ_avx2(a + i, b + i);
+    if (differ != 0) return i + util::lowest_bit(differ);
+  }
+  i = length - 32;
+  auto differ = differ_avx2(a + i, b + i);
+  return differ != 0 ? i + util::lowest_bit(differ) : length;
+}
+
+inline bool has_avx2() {
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+#else
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+
+  // the CPU has to have it and the OS has to save the ymm registers
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#endif
+}
+#endif
+
+typedef std::size_t (*mismatch_fn)(const char*, const char*, std::size_t);
+
+inline mismatch_fn select_mismatch() {
+#if defined(TRIE_HAS_AVX2_DISPATCH)
+  if (has_avx2()) return mismatch_avx2;
+#endif
+#if defined(TRIE_HAS_SSE2)
+  return mismatch_sse2;
+#else
+  return mismatch_scalar;
+#endif
+}
+
+} // namespace detail
+
+// the first position where [a, a + length) and [b, b + length) differ, or length
+inline std::size_t mismatch(const char* a, const char* b, std::size_t length) {
+  // too short for a vector to pay for the call
+  if (length < 16) return detail::mismatch_scalar(a, b, length);
+
+  static const detail::mismatch_fn kernel = detail::select_mismatch();
+  return kernel(a, b, length);
+}
+
+inline bool equal(const char* a, const char* b, std::size_t length) {
+  return mismatch(a, b, length) == length;
+}
+
+// where c is among the first 'count' (at most 16) of the 16 bytes at keys, or count if it
+// isn't.  All 16 have to be readable
+inline std::size_t find_byte(const char* keys, std::size_t count, char c) {
+#if defined(TRIE_HAS_SSE2)
+  auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys));
+  auto found = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c))));
+  found &= (1u << count) - 1;
+  return found != 0 ? util::lowest_bit(found) : count;
+#else
+  std::size_t i = 0;
+  for (; i != count && keys[i] != c; ++i) { }
+  return i;
+#endif
+}
+
+// drop in for std::mismatch and std::equal over contiguous chars (std::string iterators or
+// pointers), either range may be empty
+template <typename It1, typename It2>
+std::pair<It1, It2> mismatch(It1 first1, It1 last1, It2 first2, It2 last2) {
+  auto length = static_cast<std::size_t>(std::min<std::ptrdiff_t>(last1 - first1, last2 - first2));
+  if (length == 0) return { first1, first2 };
+
+  auto shared = static_cast<std::ptrdiff_t>(mismatch(&*first1, &*first2, length));
+  return { first1 + shared, first2 + shared };
+}
+
+template <typename It1, typename It2>
+bool equal(It1 first1, It1 last1, It2 first2, It2 last2) {
+  auto length = last1 - first1;
+  if (length != last2 - first2) return false;
+
+  return length == 0 || equal(&*first1, &*first2, static_cast<std::size_t>(length));
+}
+
+} // namespace simd
+
+// node allocation policies used by impl2 and impl3
+//
+// a policy hands out nodes through make<Node>(args...) as a unique_ptr with the
+// policy's deleter and provides get_allocator<U>() for the containers living
+// inside of the nodes
+
+// every node is its own heap allocation (the default)
+struct heap_allocator {
+  template <typename U>
+  using std_allocator = std::allocator<U>;
+
+  struct deleter {
+    template <typename Node>
+    void operator()(Node* node) const { delete node; }
+  };
+
+  template <typename U>
+  std_allocator<U> get_allocator() const { return { }; }
+
+  template <typename Node, typename... Args>
+  std::unique_ptr<Node, deleter> make(Args&&... args) {
+    return std::unique_ptr<Node, deleter>{new Node(std::forward<Args>(args)...)};
+  }
 };
 
-} // namespace impl1
+// nodes (and the child maps inside of them) are carved out of large blocks,
+// freeing a node only runs its destructor and the memory goes back a block at
+// a time when the allocator dies.  Tearing a trie down still runs the destructor
+// of every node, leaf strings and values own memory of their own, so it is the
+// frees and not the walk which the arena saves
+class arena_allocator {
+  class arena_t {
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char*                                current_   = nullptr;
+    std::size_t                          remaining_ = 0;
+    std::size_t                          block_size_;
+  public:
+    explicit arena_t(std::size_t block_size) : block_size_{block_size} { }
+
+    void* allocate(std::size_t size, std::size_t align) {
+      void* p = current_;
+      if (!std::align(align, size, p, remaining_)) {
+        // doesn't fit in what is left of the current block, oversized requests get a block of their own
+        auto block_size = std::max(block_size_, size + align);
+        blocks_.emplace_back(new char[block_size]);
+        current_   = blocks_.back().get();
+        remaining_ = block_size;
+
+        p = current_;
+        std::align(align, size, p, remaining_);
+      }
+
+      current_    = static_cast<char*>(p) + size;
+      remaining_ -= size;
+      return p;
+    }
+  };
+
+  std::unique_ptr<arena_t> arena_; // the arena doesn't move with the allocator so the maps in nodes can point at it
+public:
+  template <typename U>
+  class std_allocator {
+    template <typename V>
+    friend class std_allocator;
+
+    arena_t* arena_;
+  public:
+    typedef U               value_type;
+    typedef std::true_type  propagate_on_container_move_assignment;
+    typedef std::true_type  propagate_on_container_swap;
+
+    explicit std_allocator(arena_t* arena) : arena_{arena} { }
+
+    template <typename V>
+    std_allocator(const std_allocator<V>& other) : arena_{other.arena_} { }
+
+    U* allocate(std::size_t n) { return static_cast<U*>(arena_->allocate(n * sizeof(U), alignof(U))); }
+    void deallocate(U*, std::size_t) { } // released along with the arena
+
+    template <typename V>
+    bool operator==(const std_allocator<V>& other) const { return arena_ == other.arena_; }
+    template <typename V>
+    bool operator!=(const std_allocator<V>& other) const { return arena_ != other.arena_; }
+  };
+
+  struct deleter {
+    template <typename Node>
+    void operator()(Node* node) const { node->~Node(); }
+  };
+
+  explicit arena_allocator(std::size_t block_size = 64 * 1024) :
+    arena_{std::make_unique<arena_t>(block_size)} { }
+
+  template <typename U>
+  std_allocator<U> get_allocator() const { return std_allocator<U>{arena_.get()}; }
+
+  template <typename Node, typename... Args>
+  std::unique_ptr<Node, deleter> make(Args&&... args) {
+    auto mem = arena_->allocate(sizeof(Node), alignof(Node));
+    return std::unique_ptr<Node, deleter>{new (mem) Node(std::forward<Args>(args)...)};
+  }
+};
 
 
 namespace impl2 {
 
 namespace detail {
 
+template <typename Alloc>
 struct node_concept_t {
   virtual ~node_concept_t() { }
 
@@ -140,64 +657,89 @@ struct node_concept_t {
   virtual void accept(mvisitor_t& v)            = 0;
 };
 
+template <typename Alloc>
 struct leaf_node_t;
+template <typename Alloc>
 struct branch_node_t;
-struct node_concept_t::visitor_t {
-  virtual void operator()(const leaf_node_t&   leaf)   const = 0;
-  virtual void operator()(const branch_node_t& branch) const = 0;
+
+template <typename Alloc>
+struct node_concept_t<Alloc>::visitor_t {
+  virtual void operator()(const leaf_node_t<Alloc>&   leaf)   const = 0;
+  virtual void operator()(const branch_node_t<Alloc>& branch) const = 0;
 };
 
-struct node_concept_t::mvisitor_t {
-  virtual void operator()(leaf_node_t&   leaf)   = 0;
-  virtual void operator()(branch_node_t& branch) = 0;
+template <typename Alloc>
+struct node_concept_t<Alloc>::mvisitor_t {
+  virtual void operator()(leaf_node_t<Alloc>&   leaf)   = 0;
+  virtual void operator()(branch_node_t<Alloc>& branch) = 0;
 };
 
-struct leaf_node_t : node_concept_t {
+template <typename Alloc>
+using node_ptr = std::unique_ptr<node_concept_t<Alloc>, typename Alloc::deleter>;
+
+template <typename Alloc>
+struct leaf_node_t : node_concept_t<Alloc> {
+  using base_t     = node_concept_t<Alloc>;
+  using visitor_t  = typename base_t::visitor_t;
+  using mvisitor_t = typename base_t::mvisitor_t;
+
   std::string data;
 
   void accept(const visitor_t& visitor) const override { visitor(*this); }
   void accept(mvisitor_t& mvisitor) override { mvisitor(*this); }
 };
 
-struct branch_node_t : node_concept_t {
-  std::map<char, std::unique_ptr<node_concept_t>> children;
+template <typename Alloc>
+struct branch_node_t : node_concept_t<Alloc> {
+  using base_t     = node_concept_t<Alloc>;
+  using visitor_t  = typename base_t::visitor_t;
+  using mvisitor_t = typename base_t::mvisitor_t;
+  using children_t = std::map<char, node_ptr<Alloc>, std::less<char>,
+                              typename Alloc::template std_allocator<std::pair<const char, node_ptr<Alloc>>>>;
+
+  children_t children;
   bool is_word = false;
 
+  explicit branch_node_t(const Alloc& alloc) :
+    children{alloc.template get_allocator<typename children_t::value_type>()} { }
+
   void accept(const visitor_t& visitor) const override { visitor(*this); }
   void accept(mvisitor_t& mvisitor) override { mvisitor(*this); }
 };
 
-inline
-std::pair<std::unique_ptr<branch_node_t>, branch_node_t*> build_branches(std::string::const_iterator first, std::string::const_iterator last) {
-  auto root = std::make_unique<branch_node_t>();
+template <typename Alloc>
+std::pair<std::unique_ptr<branch_node_t<Alloc>, typename Alloc::deleter>, branch_node_t<Alloc>*>
+build_branches(Alloc& alloc, std::string::const_iterator first, std::string::const_iterator last) {
+  auto root = alloc.template make<branch_node_t<Alloc>>(alloc);
 
   auto parent = root.get();
   for (; first != last; ++first) {
-    auto child(new branch_node_t); // just use a raw point to avoid making temporary ptr
-    parent->children[*first].reset(std::move(child));
+    auto child = alloc.template make<branch_node_t<Alloc>>(alloc);
+    auto next  = child.get();
+    parent->children[*first] = std::move(child);
 
-    parent = child; // move to child
+    parent = next; // move to child
   }
 
   return { std::move(root), parent };
 }
 
-inline
-std::unique_ptr<leaf_node_t> make_leaf(std::string::const_iterator first, std::string::const_iterator last) {
-  auto l = std::make_unique<leaf_node_t>();
+template <typename Alloc>
+std::unique_ptr<leaf_node_t<Alloc>, typename Alloc::deleter> make_leaf(Alloc& alloc, std::string::const_iterator first, std::string::const_iterator last) {
+  auto l = alloc.template make<leaf_node_t<Alloc>>();
   l->data.append(first, last);
-  return std::move(l);
+  return l;
 }
 
-inline
-std::unique_ptr<node_concept_t> breakup_leaf(const leaf_node_t& leaf, std::string::const_iterator common_first, std::string::const_iterator common_second) {
+template <typename Alloc>
+node_ptr<Alloc> breakup_leaf(Alloc& alloc, const leaf_node_t<Alloc>& leaf, std::string::const_iterator common_first, std::string::const_iterator common_second) {
   // first we want to find where the common prefixes end
   auto first1 = std::begin(leaf.data);
   auto last1  = std::end(leaf.data);
   auto first2 = common_first;
   auto last2  = common_second;
   // once structured bindings are stable across all platforms, std::tie can go away
-  std::tie(first1, first2) = std::mismatch(first1, last1, first2, last2);
+  std::tie(first1, first2) = simd::mismatch(first1, last1, first2, last2);
 
   // base case (adding same word)
   if (first1 == last1 && first2 == last2) {
@@ -207,59 +749,94 @@ std::unique_ptr<node_concept_t> breakup_leaf(const leaf_node_t& leaf, std::strin
   // basic first case: we consumed all of the leaf data, so let's return a branch leading down to this
   //                   node where we split
   if (first1 == last1) {
-    auto root_leaf = build_branches(std::begin(leaf.data), last1);
+    auto root_leaf = build_branches(alloc, std::begin(leaf.data), last1);
 
     // since this happened we want to annotate the bottom of the tree that it _was_ a word
     root_leaf.second->is_word = true;
 
     // now fill in the remaining leaf
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2);
+    root_leaf.second->children[*first2] = make_leaf(alloc, std::next(first2), last2);
 
     return std::move(root_leaf.first);
   }
 
   // case 2: we exhausted the word data.  Split up to the prefix part and construct a new leaf rooted at the end of the first prefix match
   if (first2 == last2) {
-    auto root_leaf = build_branches(common_first, last2);
+    auto root_leaf = build_branches(alloc, common_first, last2);
 
     // since this happened we want to annotate the bottom of the tree that it _was_ a word
     root_leaf.second->is_word = true;
 
     // now fill in the remaining leaf
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1);
+    root_leaf.second->children[*first1] = make_leaf(alloc, std::next(first1), last1);
 
     return std::move(root_leaf.first);
   }
 
   // case 3: we've exhausted neither, build branches for both paths and construct two leaf nodes
-  auto root_leaf = build_branches(std::begin(leaf.data), first1); // first1 is where the range differs
+  auto root_leaf = build_branches(alloc, std::begin(leaf.data), first1); // first1 is where the range differs
 
   // leaf for the old leaf
   {
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1);
+    root_leaf.second->children[*first1] = make_leaf(alloc, std::next(first1), last1);
   }
 
   // leaf for the new incoming word
   {
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2);
+    root_leaf.second->children[*first2] = make_leaf(alloc, std::next(first2), last2);
   }
 
   return std::move(root_leaf.first);
 }
 
+template <typename Alloc>
+bool is_leaf(const node_concept_t<Alloc>& node) {
+  bool ret;
+
+  struct is_leaf_visitor : node_concept_t<Alloc>::visitor_t {
+    bool* result;
+
+    is_leaf_visitor(bool& result) : result(&result) { }
+
+    void operator()(const leaf_node_t<Alloc>&) const { *result = true; }
+    void operator()(const branch_node_t<Alloc>&) const { *result = false; }
+  } visitor{ret};
+
+  node.accept(visitor);
+
+  return ret;
+}
+
 } // namespace detail
 
-class trie {
-  typedef detail::node_concept_t node_concept_t;
+template <typename Alloc = heap_allocator>
+class basic_trie {
+  typedef detail::node_concept_t<Alloc> node_concept_t;
+  typedef detail::branch_node_t<Alloc>  branch_node_t;
+  typedef detail::leaf_node_t<Alloc>    leaf_node_t;
 
-  detail::branch_node_t root_;
+  Alloc         alloc_; // declared first so it outlives the nodes
+  branch_node_t root_;
 public:
-  trie()  = default;
-  ~trie() = default;
+  basic_trie() : root_{alloc_} { }
+  explicit basic_trie(Alloc alloc) : alloc_{std::move(alloc)}, root_{alloc_} { }
+
+  // builds the trie bottom up from sorted words, no leaf ever has to be split
+  template <typename ForwardIt>
+  basic_trie(sorted_input_t, ForwardIt first, ForwardIt last, Alloc alloc = Alloc{}) :
+    alloc_{std::move(alloc)}, root_{alloc_} {
+    assert(std::is_sorted(first, last) && "input must be sorted");
+
+    // the empty word is never stored
+    while (first != last && first->empty()) ++first;
+    build_children_(root_, first, last, 0);
+  }
+
+  ~basic_trie() = default;
 
   void insert(const std::string& word) {
     if (word.empty()) return;
@@ -272,7 +849,7 @@ public:
     if (first == std::end(root_.children)) {
       // new leaf node
       // we use std::next here because the leaf contains data under it, not its own char as the first char
-      root_.children[*w_first] = detail::make_leaf(std::next(w_first), w_last);
+      root_.children[*w_first] = detail::make_leaf(alloc_, std::next(w_first), w_last);
       return;
     }
 
@@ -280,13 +857,14 @@ public:
     struct insert_visitor : node_concept_t::mvisitor_t {
       std::string::const_iterator      first;
       std::string::const_iterator      last;
-      detail::branch_node_t*           parent;
+      branch_node_t*                   parent;
+      Alloc*                           alloc;
 
       insert_visitor(std::string::const_iterator& first, std::string::const_iterator& last,
-        detail::branch_node_t* parent) :
-        first(first), last(last), parent(parent) { }
+        branch_node_t* parent, Alloc& alloc) :
+        first(first), last(last), parent(parent), alloc(&alloc) { }
 
-      void operator()(detail::branch_node_t& branch) override {
+      void operator()(branch_node_t& branch) override {
         if (first == last) {
           // annotate this node that it's a word
           branch.is_word = true;
@@ -296,7 +874,7 @@ public:
         auto next = branch.children.find(*first);
         if (next == std::end(branch.children)) {
           // found place to insert leaf
-          branch.children[*first] = detail::make_leaf(std::next(first), last);
+          branch.children[*first] = detail::make_leaf(*alloc, std::next(first), last);
           return;
         }
 
@@ -305,10 +883,10 @@ public:
         parent = &branch;
         next->second->accept(*this);
       }
-      void operator()(detail::leaf_node_t& leaf) override {
+      void operator()(leaf_node_t& leaf) override {
         // we need to break this leaf apart
         // --first is ok because we checked this on entry to the top-level function
-        auto new_node = detail::breakup_leaf(leaf, first, last);
+        auto new_node = detail::breakup_leaf(*alloc, leaf, first, last);
         if (!new_node) {
           // this indicates no change needs to be made to the tree
           // the prefixes matched
@@ -316,11 +894,97 @@ public:
         }
         parent->children[*--first] = std::move(new_node);
       }
-    } visitor{++w_first, w_last, &root_};
+    } visitor{++w_first, w_last, &root_, alloc_};
 
     first->second->accept(visitor);
   }
 
+  // removes 'word', returns false if it wasn't there.  A branch left holding a single word
+  // folds back into a leaf (undoing breakup_leaf), so the trie ends up shaped just as if
+  // the word had never gone in
+  bool erase(const std::string& word) {
+    if (word.empty()) return false;
+
+    // the branches from the root down to the word, branches[i + 1] hangs off word[i]
+    std::vector<branch_node_t*> branches;
+    bool                        found = false;
+
+    struct erase_visitor : node_concept_t::mvisitor_t {
+      std::string::const_iterator  first;
+      std::string::const_iterator  last;
+      std::vector<branch_node_t*>* branches;
+      bool*                        found;
+
+      erase_visitor(std::string::const_iterator first, std::string::const_iterator last,
+        std::vector<branch_node_t*>& branches, bool& found) :
+        first(first), last(last), branches(&branches), found(&found) { }
+
+      void operator()(branch_node_t& branch) override {
+        if (first == last) {
+          if (!branch.is_word) return;
+
+          // the word ends here but others go on through
+          branch.is_word = false;
+          branches->push_back(&branch);
+          *found = true;
+          return;
+        }
+
+        auto next = branch.children.find(*first);
+        if (next == std::end(branch.children)) return;
+
+        branches->push_back(&branch);
+        ++first; // advance
+        next->second->accept(*this);
+      }
+      void operator()(leaf_node_t& leaf) override {
+        auto lfirst = std::begin(leaf.data);
+        auto llast  = std::end(leaf.data);
+
+        if (!simd::equal(lfirst, llast, first, last)) return;
+
+        // --first is the char the leaf hangs off
+        branches->back()->children.erase(*--first);
+        *found = true;
+      }
+    } visitor{std::begin(word), std::end(word), branches, found};
+
+    root_.accept(visitor);
+    if (!found) return false;
+
+    // find the highest branch (under the root, so 0 is none) left holding a single word.
+    // Branches off the path always hold two words or more, so only the path needs looking at
+    std::size_t fold = 0;
+    for (auto i = branches.size() - 1; i != 0; --i) {
+      auto& branch = *branches[i];
+      auto single  = branch.is_word ? branch.children.empty() :
+        branch.children.size() == 1 && (i + 1 == fold || detail::is_leaf(*std::begin(branch.children)->second));
+      if (!single) break;
+
+      fold = i;
+    }
+    if (fold == 0) return true;
+
+    // everything from there down becomes one leaf
+    std::string data;
+    for (const node_concept_t* node = branches[fold];;) {
+      if (detail::is_leaf(*node)) {
+        data.append(static_cast<const leaf_node_t*>(node)->data);
+        break;
+      }
+
+      auto& branch = static_cast<const branch_node_t&>(*node);
+      if (branch.is_word) break;
+
+      auto& only = *std::begin(branch.children);
+      data.push_back(only.first);
+      node = only.second.get();
+    }
+    branches[fold - 1]->children[word[fold - 1]] = detail::make_leaf(alloc_, data.cbegin(), data.cend());
+
+    return true;
+  }
+
   bool exists(const std::string& word) const {
     if (word.empty()) return false;
 
@@ -338,7 +1002,7 @@ public:
         *this->result = false;
       }
 
-      void operator()(const detail::branch_node_t& branch) const {
+      void operator()(const branch_node_t& branch) const {
         if (*first == *last && branch.is_word) {
           *result = true;
           return;
@@ -353,13 +1017,12 @@ public:
         ++*first; // advance
         next->second->accept(*this);
       }
-      void operator()(const detail::leaf_node_t& leaf) const {
+      void operator()(const leaf_node_t& leaf) const {
         // compare the remaining string to the leaf value
         auto lfirst = std::begin(leaf.data);
         auto llast  = std::end(leaf.data);
 
-        *result = std::distance(lfirst, llast) == std::distance(*first, *last) &&
-          std::equal(lfirst, llast, *first);
+        *result = simd::equal(lfirst, llast, *first, *last);
       }
     } visitor{first, last, ret};
 
@@ -388,7 +1051,7 @@ public:
         *this->result = false;
       }
 
-      void operator()(const detail::branch_node_t& branch) const {
+      void operator()(const branch_node_t& branch) const {
         if (*first == *last) {
           // find the first leaf we can match (alphabetical order)
           if (branch.is_word) {
@@ -414,7 +1077,7 @@ public:
         ++*first; // advance
         next->second->accept(*this);
       }
-      void operator()(const detail::leaf_node_t& leaf) const {
+      void operator()(const leaf_node_t& leaf) const {
         if (*first == *last) {
           match->append(leaf.data); // just append the whole node
           *result = true;
@@ -425,8 +1088,7 @@ public:
         auto llast  = std::end(leaf.data);
 
         // ensure the prefix will both fit and is shared
-        *result = std::distance(*first, *last) <= std::distance(lfirst, llast) &&
-          std::equal(*first, *last, lfirst);
+        *result = simd::mismatch(*first, *last, lfirst, llast).first == *last;
 
         if (*result) {
           match->append(lfirst, llast);
@@ -442,6 +1104,165 @@ public:
     return ret;
   }
 
+  // impl3::trie::const_iterator without the values, a word is only is_word or a leaf
+  class const_iterator {
+    friend class basic_trie;
+
+    typedef typename branch_node_t::children_t::const_iterator child_iterator;
+
+    struct frame_t {
+      child_iterator next;
+      child_iterator last;
+      std::size_t    key_size; // length of the key at this branch
+    };
+
+    std::vector<frame_t>  stack_;
+    std::string           key_;
+    const node_concept_t* node_  = nullptr; // the node of the current word, null at the end
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::string               value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const std::string*        pointer;
+    typedef const std::string&        reference;
+
+    const_iterator() = default;
+
+    reference operator*() const { return key_; }
+    pointer operator->() const { return &key_; }
+
+    const_iterator& operator++() {
+      advance_();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto ret = *this;
+      advance_();
+      return ret;
+    }
+
+    friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ == rhs.node_; }
+    friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ != rhs.node_; }
+
+  private:
+    void push_(const branch_node_t& branch) {
+      stack_.push_back({ std::begin(branch.children), std::end(branch.children), key_.size() });
+    }
+
+    // steps into 'node', whose key is already in key_, returns true if it is a word
+    bool enter_(const node_concept_t& node) {
+      bool is_word;
+
+      struct enter_visitor : node_concept_t::visitor_t {
+        const_iterator* it;
+        bool*           is_word;
+
+        enter_visitor(const_iterator& it, bool& is_word) : it(&it), is_word(&is_word) { }
+
+        void operator()(const branch_node_t& branch) const {
+          it->push_(branch);
+          *is_word = branch.is_word;
+        }
+        void operator()(const leaf_node_t& leaf) const {
+          it->key_.append(leaf.data);
+          *is_word = true;
+        }
+      } visitor{*this, is_word};
+
+      node.accept(visitor);
+
+      if (is_word) node_ = &node;
+      return is_word;
+    }
+
+    // moves to the next word in order, or to the end
+    void advance_() {
+      node_ = nullptr;
+      while (!stack_.empty()) {
+        auto& top = stack_.back();
+        if (top.next == top.last) {
+          stack_.pop_back();
+          continue;
+        }
+
+        auto child = top.next++;
+        key_.resize(top.key_size);
+        key_.push_back(child->first);
+        if (enter_(*child->second)) return; // invalidates top
+      }
+      key_.clear();
+    }
+
+    void seek_(const branch_node_t& root, const std::string& target) {
+      struct seek_visitor : node_concept_t::visitor_t {
+        const_iterator*    it;
+        const std::string* target;
+
+        seek_visitor(const_iterator& it, const std::string& target) : it(&it), target(&target) { }
+
+        void operator()(const branch_node_t& branch) const { seek(branch, branch.is_word); }
+        void operator()(const leaf_node_t& leaf) const {
+          // the leaf holds a single word, it's the one if it doesn't sort before the target
+          it->key_.append(leaf.data);
+          if (!std::lexicographical_compare(std::begin(it->key_), std::end(it->key_), std::begin(*target), std::end(*target))) {
+            it->node_  = &leaf;
+            return;
+          }
+          it->advance_();
+        }
+
+        void seek(const branch_node_t& branch, bool is_word) const {
+          auto depth = it->key_.size();
+          if (depth == target->size()) {
+            // everything under here sorts at or after the target
+            it->push_(branch);
+            if (is_word) {
+              it->node_ = &branch;
+              return;
+            }
+            it->advance_();
+            return;
+          }
+
+          // only the children after the one we go down are left to visit at this branch
+          auto c    = (*target)[depth];
+          auto next = branch.children.lower_bound(c);
+          it->stack_.push_back({ next, std::end(branch.children), depth });
+          if (next == std::end(branch.children) || next->first != c) {
+            // everything left sorts after the target
+            it->advance_();
+            return;
+          }
+
+          ++it->stack_.back().next;
+          it->key_.push_back(c);
+          next->second->accept(*this);
+        }
+      } visitor{*this, target};
+
+      root.accept(visitor);
+    }
+  };
+
+  const_iterator begin() const {
+    const_iterator it;
+    it.push_(root_);
+    it.advance_();
+    return it;
+  }
+  const_iterator end() const { return {}; }
+
+  // the first word which doesn't sort before 'prefix'.  Keep walking while the words still
+  // start with 'prefix' to visit every word under it
+  const_iterator lower_bound(const std::string& prefix) const {
+    if (prefix.empty()) return begin();
+
+    const_iterator it;
+    it.seek_(root_, prefix);
+    return it;
+  }
+
   std::vector<std::string> get_words() const {
     std::vector<std::string> ret;
     std::string              working_prefix;
@@ -453,7 +1274,7 @@ public:
       print_visitor(std::string& working_prefix, std::vector<std::string>& result) :
         working_prefix(&working_prefix), result(&result) { }
 
-      void operator()(const detail::branch_node_t& branch) const {
+      void operator()(const branch_node_t& branch) const {
         if (branch.is_word) result->push_back(*working_prefix);
 
         for (const auto& child : branch.children) {
@@ -462,7 +1283,7 @@ public:
           working_prefix->pop_back();
         }
       }
-      void operator()(const detail::leaf_node_t& leaf) const {
+      void operator()(const leaf_node_t& leaf) const {
         result->push_back(*working_prefix + leaf.data);
       }
     } visitor{working_prefix, ret};
@@ -471,50 +1292,384 @@ public:
 
     return ret;
   }
-};
-
-} // namespace impl2
 
+private:
+  // every word in [first, last) is longer than depth and already shares its first depth chars
+  template <typename ForwardIt>
+  void build_children_(branch_node_t& branch, ForwardIt first, ForwardIt last, std::size_t depth) {
+    while (first != last) {
+      // group up the words continuing with the same char
+      auto c          = (*first)[depth];
+      auto back       = first;
+      auto group_last = std::next(first);
+      for (; group_last != last && (*group_last)[depth] == c; ++group_last) {
+        back = group_last;
+      }
 
-namespace impl3 {
+      branch.children[c] = build_node_(first, back, group_last, depth + 1);
+      first = group_last;
+    }
+  }
 
-namespace detail {
+  template <typename ForwardIt>
+  detail::node_ptr<Alloc> build_node_(ForwardIt first, ForwardIt back, ForwardIt last, std::size_t depth) {
+    const std::string& word      = *first;
+    const std::string& back_word = *back;
 
-template <typename T>
-struct node_concept_t {
-  virtual ~node_concept_t() { }
+    // since the input is sorted every word in the range shares what the first and last words share
+    auto shared = simd::mismatch(std::begin(word) + depth, std::end(word), std::begin(back_word) + depth, std::end(back_word));
+    if (shared.first == std::end(word) && shared.second == std::end(back_word)) {
+      // only one distinct word left
+      return detail::make_leaf(alloc_, std::begin(word) + depth, std::end(word));
+    }
 
-  struct visitor_t;
-  struct mvisitor_t;
+    auto root_branch = detail::build_branches(alloc_, std::begin(word) + depth, shared.first);
+    auto split_depth = static_cast<std::size_t>(shared.first - std::begin(word));
+    if (shared.first == std::end(word)) {
+      // the first word ends where the rest carry on
+      root_branch.second->is_word = true;
+      while (first != last && first->size() == split_depth) ++first;
+    }
 
-  virtual void accept(const visitor_t& v) const = 0;
-  virtual void accept(mvisitor_t& v)            = 0;
+    build_children_(*root_branch.second, first, last, split_depth);
+    return std::move(root_branch.first);
+  }
 };
 
-template <typename T>
-struct leaf_node_t;
-template <typename T>
-struct branch_node_t;
-template <typename T>
-struct branch_value_node_t;
+typedef basic_trie<> trie;
 
-template <typename T>
-struct node_concept_t<T>::visitor_t {
-  virtual void operator()(const leaf_node_t<T>&         leaf)    const = 0;
-  virtual void operator()(const branch_node_t<T>&       branch)  const = 0;
-  virtual void operator()(const branch_value_node_t<T>& vbranch) const = 0;
-};
+} // namespace impl2
 
-template <typename T>
-struct node_concept_t<T>::mvisitor_t {
-  virtual void operator()(leaf_node_t<T>&         leaf)    = 0;
-  virtual void operator()(branch_node_t<T>&       branch)  = 0;
-  virtual void operator()(branch_value_node_t<T>& vbranch) = 0;
-};
 
-template <typename T>
-struct leaf_node_t : node_concept_t<T> {
-  using base_t     = node_concept_t<T>;
+namespace impl3 {
+
+// an augment keeps a summary of the words under every branch, kept up to date as words
+// go in.  It has a nested summary_t<T> with
+//   static summary_t of(const T& value) -- the summary of a single word
+//   void merge(const summary_t& other)  -- folds the summary of more words into this one
+
+// keeps nothing, the default
+struct no_augment {
+  template <typename T>
+  struct summary_t {
+    static summary_t of(const T&) { return {}; }
+    void merge(const summary_t&) { }
+  };
+};
+
+// keeps the greatest value (by Compare) under every branch so top_k can skip the branches
+// which can't make the cut.  T has to be default constructible
+template <typename Compare = std::less<>>
+struct max_augment {
+  typedef Compare compare_type;
+
+  template <typename T>
+  struct summary_t {
+    T    max{};
+    bool has_max = false;
+
+    static summary_t of(const T& value) {
+      summary_t ret;
+      ret.max     = value;
+      ret.has_max = true;
+      return ret;
+    }
+
+    void merge(const summary_t& other) {
+      if (!other.has_max) return;
+      if (!has_max || Compare{}(max, other.max)) {
+        max     = other.max;
+        has_max = true;
+      }
+    }
+  };
+};
+
+// keeps the number of words under every branch so count_prefix, rank and select can add
+// up whole branches instead of walking them
+struct count_augment {
+  template <typename T>
+  struct summary_t {
+    std::size_t count = 0;
+
+    static summary_t of(const T&) {
+      summary_t ret;
+      ret.count = 1;
+      return ret;
+    }
+
+    void merge(const summary_t& other) { count += other.count; }
+  };
+};
+
+namespace detail {
+
+// the children of a branch.  Up to small_capacity of them live as a sorted array of key
+// bytes next to an array of pointers, finding a child is one compare of every key at once
+// (simd::find_byte).  A branch which outgrows that moves its children into a std::map.
+// Keys sort like std::map<char, ...> sorts them so walks see the same order either way
+template <typename Ptr, typename PairAlloc>
+class child_map_t : private std::allocator_traits<PairAlloc>::template rebind_alloc<Ptr> {
+public:
+  typedef std::pair<const char, Ptr>                      value_type;
+  typedef std::map<char, Ptr, std::less<char>, PairAlloc> map_t;
+
+  static constexpr std::size_t small_capacity = 16;
+
+private:
+  typedef typename std::allocator_traits<PairAlloc>::template rebind_alloc<Ptr>   ptr_alloc_t;
+  typedef typename std::allocator_traits<PairAlloc>::template rebind_alloc<map_t> map_alloc_t;
+  typedef std::allocator_traits<ptr_alloc_t>                                      ptr_traits;
+  typedef std::allocator_traits<map_alloc_t>                                      map_traits;
+
+  char         keys_[small_capacity] = { }; // sorted, only the first size_ are children
+  Ptr*         ptrs_     = nullptr;
+  map_t*       map_      = nullptr;         // set once the arrays overflow, then it holds everything
+  std::uint8_t size_     = 0;
+  std::uint8_t capacity_ = 0;
+
+  template <typename P, typename MapIt>
+  class iterator_t {
+    friend class child_map_t;
+
+    const char* key_   = nullptr;
+    P*          ptr_   = nullptr;
+    MapIt       it_    = { };
+    bool        large_ = false;
+
+    iterator_t(const char* key, P* ptr) : key_{key}, ptr_{ptr} { }
+    explicit iterator_t(MapIt it) : it_{it}, large_{true} { }
+  public:
+    // what *it gives, like the pair a std::map iterator points at
+    struct reference {
+      const char& first;
+      P&          second;
+
+      const reference* operator->() const { return this; }
+    };
+
+    iterator_t() = default;
+
+    reference operator*() const {
+      return large_ ? reference{ it_->first, it_->second } : reference{ *key_, *ptr_ };
+    }
+    reference operator->() const { return **this; }
+
+    iterator_t& operator++() {
+      if (large_) {
+        ++it_;
+      }
+      else {
+        ++key_;
+        ++ptr_;
+      }
+      return *this;
+    }
+    iterator_t operator++(int) {
+      auto ret = *this;
+      ++*this;
+      return ret;
+    }
+
+    bool operator==(const iterator_t& other) const { return large_ ? it_ == other.it_ : key_ == other.key_; }
+    bool operator!=(const iterator_t& other) const { return !(*this == other); }
+  };
+
+public:
+  typedef iterator_t<Ptr, typename map_t::iterator>             iterator;
+  typedef iterator_t<const Ptr, typename map_t::const_iterator> const_iterator;
+
+  explicit child_map_t(const PairAlloc& alloc) : ptr_alloc_t{alloc} { }
+
+  child_map_t(child_map_t&& other) noexcept : ptr_alloc_t{other.alloc_()} {
+    swap_(other);
+  }
+
+  child_map_t& operator=(child_map_t&& other) noexcept {
+    if (this != &other) {
+      clear_();
+      alloc_() = other.alloc_();
+      swap_(other);
+    }
+    return *this;
+  }
+
+  child_map_t(const child_map_t&) = delete;
+  child_map_t& operator=(const child_map_t&) = delete;
+
+  ~child_map_t() { clear_(); }
+
+  bool        empty() const { return size() == 0; }
+  std::size_t size() const { return map_ ? map_->size() : size_; }
+
+  iterator begin() { return map_ ? iterator{map_->begin()} : iterator{keys_, ptrs_}; }
+  iterator end() { return map_ ? iterator{map_->end()} : iterator{keys_ + size_, ptrs_ + size_}; }
+  const_iterator begin() const { return map_ ? const_iterator{map_->cbegin()} : const_iterator{keys_, ptrs_}; }
+  const_iterator end() const { return map_ ? const_iterator{map_->cend()} : const_iterator{keys_ + size_, ptrs_ + size_}; }
+
+  iterator find(char c) {
+    if (map_) return iterator{map_->find(c)};
+
+    auto i = simd::find_byte(keys_, size_, c);
+    return iterator{keys_ + i, ptrs_ + i}; // end() when it isn't there
+  }
+
+  const_iterator find(char c) const {
+    if (map_) return const_iterator{map_->find(c)};
+
+    auto i = simd::find_byte(keys_, size_, c);
+    return const_iterator{keys_ + i, ptrs_ + i};
+  }
+
+  const_iterator lower_bound(char c) const {
+    if (map_) return const_iterator{map_->lower_bound(c)};
+
+    std::size_t i = 0;
+    for (; i != size_ && keys_[i] < c; ++i) { }
+    return const_iterator{keys_ + i, ptrs_ + i};
+  }
+
+  // the child at c, an empty one goes in if there isn't one
+  Ptr& operator[](char c) {
+    if (map_) return (*map_)[c];
+
+    auto i = simd::find_byte(keys_, size_, c);
+    if (i != size_) return ptrs_[i];
+
+    if (size_ == small_capacity) {
+      move_to_map_();
+      return (*map_)[c];
+    }
+    if (size_ == capacity_) grow_();
+
+    // shift the larger keys up one to make room
+    std::size_t pos = 0;
+    for (; pos != size_ && keys_[pos] < c; ++pos) { }
+
+    ptr_traits::construct(alloc_(), ptrs_ + size_);
+    for (auto j = static_cast<std::size_t>(size_); j != pos; --j) {
+      keys_[j] = keys_[j - 1];
+      ptrs_[j] = std::move(ptrs_[j - 1]);
+    }
+    keys_[pos] = c;
+    ++size_;
+
+    return ptrs_[pos];
+  }
+
+  std::size_t erase(char c) {
+    if (map_) return map_->erase(c);
+
+    auto i = simd::find_byte(keys_, size_, c);
+    if (i == size_) return 0;
+
+    for (auto j = i + 1; j != size_; ++j) {
+      keys_[j - 1] = keys_[j];
+      ptrs_[j - 1] = std::move(ptrs_[j]);
+    }
+    --size_;
+    ptr_traits::destroy(alloc_(), ptrs_ + size_);
+    return 1;
+  }
+
+private:
+  ptr_alloc_t&       alloc_()       { return *this; }
+  const ptr_alloc_t& alloc_() const { return *this; }
+
+  // the pointers double from 2 up to small_capacity
+  void grow_() {
+    auto capacity = static_cast<std::uint8_t>(capacity_ == 0 ? 2 : capacity_ * 2);
+    auto ptrs     = ptr_traits::allocate(alloc_(), capacity);
+    for (std::size_t i = 0; i != size_; ++i) {
+      ptr_traits::construct(alloc_(), ptrs + i, std::move(ptrs_[i]));
+      ptr_traits::destroy(alloc_(), ptrs_ + i);
+    }
+    if (ptrs_) ptr_traits::deallocate(alloc_(), ptrs_, capacity_);
+
+    ptrs_     = ptrs;
+    capacity_ = capacity;
+  }
+
+  void move_to_map_() {
+    map_alloc_t map_alloc{alloc_()};
+    auto map = map_traits::allocate(map_alloc, 1);
+    map_traits::construct(map_alloc, map, std::less<char>{}, PairAlloc{alloc_()});
+    for (std::size_t i = 0; i != size_; ++i) {
+      map->emplace(keys_[i], std::move(ptrs_[i]));
+    }
+
+    release_arrays_();
+    map_ = map;
+  }
+
+  void release_arrays_() {
+    for (std::size_t i = 0; i != size_; ++i) {
+      ptr_traits::destroy(alloc_(), ptrs_ + i);
+    }
+    if (ptrs_) ptr_traits::deallocate(alloc_(), ptrs_, capacity_);
+
+    ptrs_     = nullptr;
+    size_     = 0;
+    capacity_ = 0;
+  }
+
+  void clear_() {
+    release_arrays_();
+    if (map_) {
+      map_alloc_t map_alloc{alloc_()};
+      map_traits::destroy(map_alloc, map_);
+      map_traits::deallocate(map_alloc, map_, 1);
+      map_ = nullptr;
+    }
+  }
+
+  void swap_(child_map_t& other) {
+    std::swap_ranges(std::begin(keys_), std::end(keys_), std::begin(other.keys_));
+    std::swap(ptrs_, other.ptrs_);
+    std::swap(map_, other.map_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+};
+
+template <typename T, typename Alloc, typename Augment>
+struct node_concept_t {
+  virtual ~node_concept_t() { }
+
+  struct visitor_t;
+  struct mvisitor_t;
+
+  virtual void accept(const visitor_t& v) const = 0;
+  virtual void accept(mvisitor_t& v)            = 0;
+};
+
+template <typename T, typename Alloc, typename Augment>
+struct leaf_node_t;
+template <typename T, typename Alloc, typename Augment>
+struct branch_node_t;
+template <typename T, typename Alloc, typename Augment>
+struct branch_value_node_t;
+
+template <typename T, typename Alloc, typename Augment>
+struct node_concept_t<T, Alloc, Augment>::visitor_t {
+  virtual void operator()(const leaf_node_t<T, Alloc, Augment>&         leaf)    const = 0;
+  virtual void operator()(const branch_node_t<T, Alloc, Augment>&       branch)  const = 0;
+  virtual void operator()(const branch_value_node_t<T, Alloc, Augment>& vbranch) const = 0;
+};
+
+template <typename T, typename Alloc, typename Augment>
+struct node_concept_t<T, Alloc, Augment>::mvisitor_t {
+  virtual void operator()(leaf_node_t<T, Alloc, Augment>&         leaf)    = 0;
+  virtual void operator()(branch_node_t<T, Alloc, Augment>&       branch)  = 0;
+  virtual void operator()(branch_value_node_t<T, Alloc, Augment>& vbranch) = 0;
+};
+
+template <typename T, typename Alloc, typename Augment>
+using node_ptr = std::unique_ptr<node_concept_t<T, Alloc, Augment>, typename Alloc::deleter>;
+
+template <typename T, typename Alloc, typename Augment>
+struct leaf_node_t : node_concept_t<T, Alloc, Augment> {
+  using base_t     = node_concept_t<T, Alloc, Augment>;
   using visitor_t  = typename base_t::visitor_t;
   using mvisitor_t = typename base_t::mvisitor_t;
 
@@ -527,91 +1682,106 @@ struct leaf_node_t : node_concept_t<T> {
   void accept(mvisitor_t& mvisitor) override { mvisitor(*this); }
 };
 
-template <typename T>
-struct branch_node_t : node_concept_t<T> {
-  using base_t     = node_concept_t<T>;
+// the summary is a base so it takes no room with no_augment
+template <typename T, typename Alloc, typename Augment>
+struct branch_node_t : node_concept_t<T, Alloc, Augment>, Augment::template summary_t<T> {
+  using base_t     = node_concept_t<T, Alloc, Augment>;
   using visitor_t  = typename base_t::visitor_t;
   using mvisitor_t = typename base_t::mvisitor_t;
+  using summary_t  = typename Augment::template summary_t<T>;
+
+  using children_t = child_map_t<node_ptr<T, Alloc, Augment>,
+                                typename Alloc::template std_allocator<std::pair<const char, node_ptr<T, Alloc, Augment>>>>;
 
-  std::map<char, std::unique_ptr<node_concept_t<T>>> children;
+  children_t children;
 
-  branch_node_t() = default;
+  explicit branch_node_t(const Alloc& alloc) :
+    children{alloc.template get_allocator<typename children_t::value_type>()} { }
   virtual ~branch_node_t() { }
 
+  // what the augment keeps about the words under this branch
+  summary_t&       summary()       { return *this; }
+  const summary_t& summary() const { return *this; }
+
   virtual void accept(const visitor_t& visitor) const override { visitor(*this); }
   virtual void accept(mvisitor_t& mvisitor) override { mvisitor(*this); }
 };
 
-template <typename T>
-struct branch_value_node_t : branch_node_t<T> {
-  using base_t     = node_concept_t<T>;
+template <typename T, typename Alloc, typename Augment>
+struct branch_value_node_t : branch_node_t<T, Alloc, Augment> {
+  using base_t     = node_concept_t<T, Alloc, Augment>;
   using visitor_t  = typename base_t::visitor_t;
   using mvisitor_t = typename base_t::mvisitor_t;
 
   T value;
 
-  branch_value_node_t(T value) : value{std::move(value)} { }
+  branch_value_node_t(const Alloc& alloc, T value) : branch_node_t<T, Alloc, Augment>{alloc}, value{std::move(value)} { }
 
   void accept(const visitor_t& visitor) const override { visitor(*this); }
   void accept(mvisitor_t& mvisitor) override { mvisitor(*this); }
 };
 
-template <typename T>
-std::pair<std::unique_ptr<branch_node_t<T>>, branch_node_t<T>*> build_branches(std::string::const_iterator first,
-                                                                               std::string::const_iterator last) {
-  auto root = std::make_unique<branch_node_t<T>>();
+template <typename T, typename Alloc, typename Augment>
+std::pair<std::unique_ptr<branch_node_t<T, Alloc, Augment>, typename Alloc::deleter>, branch_node_t<T, Alloc, Augment>*>
+build_branches(Alloc& alloc, std::string::const_iterator first, std::string::const_iterator last) {
+  auto root = alloc.template make<branch_node_t<T, Alloc, Augment>>(alloc);
 
   auto parent = root.get();
   for (; first != last; ++first) {
-    auto child(new branch_node_t<T>); // use raw ptr here to avoid temporary
-    parent->children[*first].reset(child);
+    auto child = alloc.template make<branch_node_t<T, Alloc, Augment>>(alloc);
+    auto next  = child.get();
+    parent->children[*first] = std::move(child);
 
-    parent = child; // move to child
+    parent = next; // move to child
   }
 
   return { std::move(root), parent };
 }
 
-template <typename T>
-std::pair<std::unique_ptr<branch_node_t<T>>, branch_value_node_t<T>*> build_branches_to_value(std::string::const_iterator first, std::string::const_iterator last, T value) {
+template <typename T, typename Alloc, typename Augment>
+std::pair<std::unique_ptr<branch_node_t<T, Alloc, Augment>, typename Alloc::deleter>, branch_value_node_t<T, Alloc, Augment>*>
+build_branches_to_value(Alloc& alloc, std::string::const_iterator first, std::string::const_iterator last, T value) {
   if (first == last) {
-    auto root   = std::make_unique<branch_value_node_t<T>>(std::move(value));
+    auto root   = alloc.template make<branch_value_node_t<T, Alloc, Augment>>(alloc, std::move(value));
     auto parent = root.get();
     return { std::move(root), parent };
   }
 
   auto short_last = std::prev(last);
-  auto branches   = build_branches<T>(first, short_last);
+  auto branches   = build_branches<T, Alloc, Augment>(alloc, first, short_last);
 
   // the last element is where we want to place the value branch
   // short_last is a valid iterator
-  auto child(new branch_value_node_t<T>{std::move(value)});
-  branches.second->children[*short_last].reset(child);
+  auto child = alloc.template make<branch_value_node_t<T, Alloc, Augment>>(alloc, std::move(value));
+  auto value_branch = child.get();
+  branches.second->children[*short_last] = std::move(child);
 
-  return { std::move(branches.first), child };
+  return { std::move(branches.first), value_branch };
 }
 
-template <typename T>
-std::unique_ptr<leaf_node_t<T>> make_leaf(std::string::const_iterator first,
-                                          std::string::const_iterator last,
-                                          T value) {
-  auto l = std::make_unique<leaf_node_t<T>>(std::move(value));
+template <typename T, typename Alloc, typename Augment>
+std::unique_ptr<leaf_node_t<T, Alloc, Augment>, typename Alloc::deleter> make_leaf(Alloc& alloc,
+                                                                         std::string::const_iterator first,
+                                                                         std::string::const_iterator last,
+                                                                         T value) {
+  auto l = alloc.template make<leaf_node_t<T, Alloc, Augment>>(std::move(value));
   l->data.append(first, last);
-  return std::move(l);
+  return l;
 }
 
-template <typename T>
-std::unique_ptr<node_concept_t<T>> breakup_leaf(const leaf_node_t<T>& leaf, T leaf_value,
-                                                std::string::const_iterator common_first,
-                                                std::string::const_iterator common_second,
-                                                T value) {
+// leaf_value is only moved from when the leaf is split, adding the same word leaves it be
+template <typename T, typename Alloc, typename Augment>
+node_ptr<T, Alloc, Augment> breakup_leaf(Alloc& alloc, const leaf_node_t<T, Alloc, Augment>& leaf, T& leaf_value,
+                                std::string::const_iterator common_first,
+                                std::string::const_iterator common_second,
+                                T value) {
   // first we want to find where the common prefixes end
   auto first1 = std::begin(leaf.data);
   auto last1  = std::end(leaf.data);
   auto first2 = common_first;
   auto last2  = common_second;
   // once structured bindings are stable across all platforms, std::tie can go away
-  std::tie(first1, first2) = std::mismatch(first1, last1, first2, last2);
+  std::tie(first1, first2) = simd::mismatch(first1, last1, first2, last2);
 
   // base case (adding same word)
   if (first1 == last1 && first2 == last2) {
@@ -622,11 +1792,11 @@ std::unique_ptr<node_concept_t<T>> breakup_leaf(const leaf_node_t<T>& leaf, T le
   //                   node where we split
   if (first1 == last1) {
     // *_to_value annotates the branch that it is a word
-    auto root_leaf = build_branches_to_value(std::begin(leaf.data), last1, std::move(leaf_value));
+    auto root_leaf = build_branches_to_value<T, Alloc, Augment>(alloc, std::begin(leaf.data), last1, std::move(leaf_value));
 
     // now fill in the remaining leaf
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2, std::move(value));
+    root_leaf.second->children[*first2] = make_leaf<T, Alloc, Augment>(alloc, std::next(first2), last2, std::move(value));
 
     return std::move(root_leaf.first);
   }
@@ -634,42 +1804,249 @@ std::unique_ptr<node_concept_t<T>> breakup_leaf(const leaf_node_t<T>& leaf, T le
   // case 2: we exhausted the word data.  Split up to the prefix part and construct a new leaf rooted at the end of the first prefix match
   if (first2 == last2) {
     // *_to_value annotates this branch that it's a value at the end
-    auto root_leaf = build_branches_to_value(common_first, last2, std::move(value));
+    auto root_leaf = build_branches_to_value<T, Alloc, Augment>(alloc, common_first, last2, std::move(value));
 
     // now fill in the remaining leaf
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1, std::move(leaf_value));
+    root_leaf.second->children[*first1] = make_leaf<T, Alloc, Augment>(alloc, std::next(first1), last1, std::move(leaf_value));
 
     return std::move(root_leaf.first);
   }
 
   // case 3: we've exhausted neither, build branches for both paths and construct two leaf nodes
-  auto root_leaf = build_branches<T>(std::begin(leaf.data), first1); // first1 is where the range differs
+  auto root_leaf = build_branches<T, Alloc, Augment>(alloc, std::begin(leaf.data), first1); // first1 is where the range differs
 
   // leaf for the old leaf
   {
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1, std::move(leaf_value));
+    root_leaf.second->children[*first1] = make_leaf<T, Alloc, Augment>(alloc, std::next(first1), last1, std::move(leaf_value));
   }
 
   // leaf for the new incoming word
   {
     // we use std::next here because the leaf contains data under it, not its own char as the first char
-    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2, std::move(value));
+    root_leaf.second->children[*first2] = make_leaf<T, Alloc, Augment>(alloc, std::next(first2), last2, std::move(value));
   }
 
   return std::move(root_leaf.first);
 }
 
+// works out the summary of the words under 'node' and hands it to every branch on the way.
+// With 'deep' false the summaries the branches under 'node' already have are trusted
+template <typename T, typename Alloc, typename Augment>
+typename Augment::template summary_t<T> summarize(node_concept_t<T, Alloc, Augment>& node, bool deep) {
+  typedef typename Augment::template summary_t<T> summary_t;
+
+  summary_t ret;
+
+  struct summarize_visitor : node_concept_t<T, Alloc, Augment>::mvisitor_t {
+    summary_t* result;
+    bool       deep;
+    bool       top = true; // the node we were asked about always gets worked out
+
+    summarize_visitor(summary_t& result, bool deep) : result(&result), deep(deep) { }
+
+    void operator()(leaf_node_t<T, Alloc, Augment>& leaf) override {
+      *result = summary_t::of(leaf.value);
+    }
+    void operator()(branch_node_t<T, Alloc, Augment>& branch) override {
+      *result = add_children(branch, summary_t{});
+    }
+    void operator()(branch_value_node_t<T, Alloc, Augment>& vbranch) override {
+      *result = add_children(vbranch, summary_t::of(vbranch.value));
+    }
+
+    summary_t add_children(branch_node_t<T, Alloc, Augment>& branch, summary_t summary) {
+      if (!top && !deep) return branch.summary();
+      top = false;
+
+      for (auto child : branch.children) {
+        child.second->accept(*this);
+        summary.merge(*result);
+      }
+      branch.summary() = summary;
+      return summary;
+    }
+  } visitor{ret, deep};
+
+  node.accept(visitor);
+
+  return ret;
+}
+
+// the value kept right at 'node', null for a plain branch.  'leaf' says if it's a leaf
+template <typename T, typename Alloc, typename Augment>
+T* value_at_node(node_concept_t<T, Alloc, Augment>& node, bool& leaf) {
+  T* ret;
+
+  struct value_visitor : node_concept_t<T, Alloc, Augment>::mvisitor_t {
+    T**   result;
+    bool* leaf;
+
+    value_visitor(T*& result, bool& leaf) : result(&result), leaf(&leaf) { }
+
+    void operator()(leaf_node_t<T, Alloc, Augment>& leaf_node) override {
+      *result = &leaf_node.value;
+      *leaf   = true;
+    }
+    void operator()(branch_node_t<T, Alloc, Augment>&) override {
+      *result = nullptr;
+      *leaf   = false;
+    }
+    void operator()(branch_value_node_t<T, Alloc, Augment>& vbranch) override {
+      *result = &vbranch.value;
+      *leaf   = false;
+    }
+  } visitor{ret, leaf};
+
+  node.accept(visitor);
+
+  return ret;
+}
+
+// walks a range of iterators as if it were the range they point at, so a group of
+// unsorted input can be sorted and built from without copying the words
+template <typename It>
+class indirect_iterator_t {
+  typedef typename std::iterator_traits<It>::value_type inner_t;
+
+  It it_;
+public:
+  typedef std::forward_iterator_tag                                   iterator_category;
+  typedef typename std::iterator_traits<inner_t>::value_type          value_type;
+  typedef typename std::iterator_traits<inner_t>::reference           reference;
+  typedef std::add_pointer_t<std::remove_reference_t<reference>>      pointer;
+  typedef std::ptrdiff_t                                              difference_type;
+
+  explicit indirect_iterator_t(It it) : it_{it} { }
+
+  reference operator*() const { return **it_; }
+  pointer operator->() const { return std::addressof(**it_); }
+
+  indirect_iterator_t& operator++() { ++it_; return *this; }
+  indirect_iterator_t operator++(int) { auto ret = *this; ++it_; return ret; }
+
+  bool operator==(const indirect_iterator_t& other) const { return it_ == other.it_; }
+  bool operator!=(const indirect_iterator_t& other) const { return it_ != other.it_; }
+};
+
 } // namespace detail
 
 template <typename T>
+class frozen_trie;
+
+template <typename T, typename Alloc = heap_allocator, typename Augment = no_augment>
 class trie {
-  typedef detail::node_concept_t<T> node_concept_t;
+  typedef detail::node_concept_t<T, Alloc, Augment>      node_concept_t;
+  typedef detail::leaf_node_t<T, Alloc, Augment>         leaf_node_t;
+  typedef detail::branch_node_t<T, Alloc, Augment>       branch_node_t;
+  typedef detail::branch_value_node_t<T, Alloc, Augment> branch_value_node_t;
+  typedef typename branch_node_t::summary_t              summary_t;
+
+  // no_augment has nothing to keep up to date
+  static constexpr bool augmented_ = !std::is_empty<summary_t>::value;
 
-  detail::branch_node_t<T> root_;
+  Alloc         alloc_; // declared first so it outlives the nodes
+  branch_node_t root_;
 public:
-  trie()  = default;
+  trie() : root_{alloc_} { }
+  explicit trie(Alloc alloc) : alloc_{std::move(alloc)}, root_{alloc_} { }
+
+  // builds the trie bottom up from (word, value) pairs sorted by word, no leaf ever
+  // has to be split.  Duplicate words keep their first value like insert() would
+  template <typename ForwardIt>
+  trie(sorted_input_t, ForwardIt first, ForwardIt last, Alloc alloc = Alloc{}) :
+    alloc_{std::move(alloc)}, root_{alloc_} {
+    assert(std::is_sorted(first, last, [](const auto& a, const auto& b) { return a.first < b.first; }) &&
+           "input must be sorted");
+
+    // the empty word is never stored
+    while (first != last && first->first.empty()) ++first;
+    build_children_(root_, first, last, 0);
+
+    if (augmented_) detail::summarize(root_, true);
+  }
+
+  // builds the trie from (word, value) pairs in any order on 'thread_count' threads (0 for
+  // one per core).  The words are split up by their first char, every group is sorted and
+  // built bottom up like sorted input on its own and the subtries go under the root at the
+  // end.  Duplicate words keep their first value like insert() would
+  template <typename ForwardIt>
+  trie(parallel_input_t, ForwardIt first, ForwardIt last, std::size_t thread_count = 0, Alloc alloc = Alloc{}) :
+    alloc_{std::move(alloc)}, root_{alloc_} {
+    typedef typename std::vector<ForwardIt>::iterator group_it;
+    typedef detail::indirect_iterator_t<group_it>     input_it;
+
+    std::vector<std::vector<ForwardIt>> groups(UCHAR_MAX + 1);
+    for (; first != last; ++first) {
+      // the empty word is never stored
+      if (!first->first.empty()) groups[static_cast<unsigned char>(first->first[0])].push_back(first);
+    }
+
+    // the biggest groups go first so no thread is left with a big one at the end
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i != groups.size(); ++i) {
+      if (!groups[i].empty()) order.push_back(i);
+    }
+    std::stable_sort(std::begin(order), std::end(order),
+      [&groups](std::size_t a, std::size_t b) { return groups[a].size() > groups[b].size(); });
+
+    std::vector<detail::node_ptr<T, Alloc, Augment>> subtries(groups.size());
+    std::atomic<std::size_t>                         next{0};
+    std::exception_ptr                               failure;
+    std::mutex                                       failure_lock;
+    auto build = [&] {
+      try {
+        for (std::size_t i; (i = next.fetch_add(1)) < order.size();) {
+          auto& group = groups[order[i]];
+
+          // stable so the first of equal words is the one built
+          std::stable_sort(std::begin(group), std::end(group),
+            [](const ForwardIt& a, const ForwardIt& b) { return a->first < b->first; });
+
+          subtries[order[i]] = build_node_(input_it{std::begin(group)}, input_it{std::prev(std::end(group))},
+                                           input_it{std::end(group)}, 1);
+        }
+      }
+      catch (...) {
+        // the first one to fail is rethrown once everyone is joined, the rest stop early
+        next.store(order.size());
+        std::lock_guard<std::mutex> lock{failure_lock};
+        if (!failure) failure = std::current_exception();
+      }
+    };
+
+    if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+    // an allocator with state (the arena) hands out memory from one thread at a time
+    if (!std::is_empty<Alloc>::value) thread_count = 1;
+    thread_count = std::min(thread_count, order.size());
+
+    // joins whatever was started even if starting the next thread throws
+    struct join_all_t {
+      std::vector<std::thread> workers;
+      ~join_all_t() {
+        for (auto& worker : workers) {
+          if (worker.joinable()) worker.join();
+        }
+      }
+    };
+
+    {
+      join_all_t join_all;
+      for (std::size_t i = 1; i < thread_count; ++i) {
+        join_all.workers.emplace_back(build);
+      }
+      build();
+    }
+    if (failure) std::rethrow_exception(failure);
+
+    for (std::size_t i = 0; i != subtries.size(); ++i) {
+      if (subtries[i]) root_.children[static_cast<char>(i)] = std::move(subtries[i]);
+    }
+
+    if (augmented_) detail::summarize(root_, true);
+  }
+
   ~trie() = default;
 
   void insert(const std::string& word, T value) {
@@ -678,12 +2055,16 @@ public:
     auto w_first = std::begin(word);
     auto w_last = std::end(word);
 
+    // what every branch on the way down gains if the word is new
+    auto added = augmented_ ? summary_t::of(value) : summary_t{};
+
     auto first = root_.children.find(*w_first);
 
     if (first == std::end(root_.children)) {
       // new leaf node
       // we use std::next here because the leaf contains data under it, not its own char as the first char
-      root_.children[*w_first] = detail::make_leaf(std::next(w_first), w_last, std::move(value));
+      root_.children[*w_first] = detail::make_leaf<T, Alloc, Augment>(alloc_, std::next(w_first), w_last, std::move(value));
+      root_.summary().merge(added);
       return;
     }
 
@@ -691,19 +2072,24 @@ public:
     struct insert_visitor : node_concept_t::mvisitor_t {
       std::string::const_iterator      first;
       std::string::const_iterator      last;
-      detail::branch_node_t<T>*        parent;
+      branch_node_t*                   parent;
       T*                               value;
+      Alloc*                           alloc;
+      const summary_t*                 added;
+      bool                             inserted = false; // the summaries on the way back up need 'added'
 
       insert_visitor(std::string::const_iterator& first, std::string::const_iterator& last,
-        detail::branch_node_t<T>* parent, T& value) :
-        first(first), last(last), parent(parent), value(&value) { }
+        branch_node_t* parent, T& value, Alloc& alloc, const summary_t& added) :
+        first(first), last(last), parent(parent), value(&value), alloc(&alloc), added(&added) { }
 
-      void operator()(detail::branch_node_t<T>& branch) override {
+      void operator()(branch_node_t& branch) override {
         if (first == last) {
           // gut this branch and make it a branch value node
-          std::unique_ptr<detail::branch_value_node_t<T>> new_branch(
-            new detail::branch_value_node_t<T>(std::move(*value)));
-          new_branch->children = std::move(branch.children);
+          auto new_branch = alloc->template make<branch_value_node_t>(*alloc, std::move(*value));
+          new_branch->children  = std::move(branch.children);
+          new_branch->summary() = branch.summary();
+          new_branch->summary().merge(*added);
+          inserted = true;
 
           // re-parent (--first) is a valid iterator since this was checked at the top-level function
           parent->children[*--first] = std::move(new_branch);
@@ -713,7 +2099,9 @@ public:
         auto next = branch.children.find(*first);
         if (next == std::end(branch.children)) {
           // found place to insert leaf
-          branch.children[*first] = detail::make_leaf(std::next(first), last, std::move(*value));
+          branch.children[*first] = detail::make_leaf<T, Alloc, Augment>(*alloc, std::next(first), last, std::move(*value));
+          branch.summary().merge(*added);
+          inserted = true;
           return;
         }
 
@@ -721,8 +2109,9 @@ public:
         ++first; // move forward
         parent = &branch;
         next->second->accept(*this);
+        if (inserted) branch.summary().merge(*added);
       }
-      void operator()(detail::branch_value_node_t<T>& vbranch) override {
+      void operator()(branch_value_node_t& vbranch) override {
         if (first == last) {
           // prefixes matched but we landed at a branch node...
           // the user _should_ have just called reset_value()
@@ -732,7 +2121,9 @@ public:
         auto next = vbranch.children.find(*first);
         if (next == std::end(vbranch.children)) {
           // found place for leaf
-          vbranch.children[*first] = detail::make_leaf(std::next(first), last, std::move(*value));
+          vbranch.children[*first] = detail::make_leaf<T, Alloc, Augment>(*alloc, std::next(first), last, std::move(*value));
+          vbranch.summary().merge(*added);
+          inserted = true;
           return;
         }
 
@@ -740,22 +2131,144 @@ public:
         ++first; // move forward
         parent = &vbranch;
         next->second->accept(*this);
+        if (inserted) vbranch.summary().merge(*added);
       }
-      void operator()(detail::leaf_node_t<T>& leaf) override {
+      void operator()(leaf_node_t& leaf) override {
         // we need to break this leaf apart
         // --first is ok because we checked this on entry to the top-level function
-        auto new_node = detail::breakup_leaf(leaf, std::move(leaf.value), first, last, std::move(*value));
+        auto new_node = detail::breakup_leaf(*alloc, leaf, leaf.value, first, last, std::move(*value));
         if (!new_node) {
           // this indicates no change needs to be made to the tree
           // the prefixes matched
           // in fact, the user should have just called reset_value()
           return;
         }
+        // the branches breakup_leaf made only hold the old leaf and the new word
+        if (augmented_) detail::summarize(*new_node, true);
+        inserted = true;
         parent->children[*--first] = std::move(new_node);
       }
-    } visitor{++w_first, w_last, &root_, value};
+    } visitor{++w_first, w_last, &root_, value, alloc_, added};
 
     first->second->accept(visitor);
+    if (visitor.inserted) root_.summary().merge(added);
+  }
+
+  // removes 'word', returns false if it wasn't there.  A branch left holding a single word
+  // folds back into a leaf (undoing breakup_leaf), so the trie ends up shaped just as if
+  // the word had never gone in
+  bool erase(const std::string& word) {
+    if (word.empty()) return false;
+
+    // the branches from the root down to the word, branches[i + 1] hangs off word[i]
+    std::vector<branch_node_t*> branches;
+    bool                        found = false;
+
+    struct erase_visitor : node_concept_t::mvisitor_t {
+      std::string::const_iterator  first;
+      std::string::const_iterator  last;
+      std::vector<branch_node_t*>* branches;
+      bool*                        found;
+      Alloc*                       alloc;
+
+      erase_visitor(std::string::const_iterator first, std::string::const_iterator last,
+        std::vector<branch_node_t*>& branches, bool& found, Alloc& alloc) :
+        first(first), last(last), branches(&branches), found(&found), alloc(&alloc) { }
+
+      void operator()(branch_node_t& branch) override {
+        descend(branch);
+      }
+      void operator()(branch_value_node_t& vbranch) override {
+        if (first != last) {
+          descend(vbranch);
+          return;
+        }
+
+        // the word ends here but others go on through, so this turns back into a plain branch
+        auto new_branch = alloc->template make<branch_node_t>(*alloc);
+        new_branch->children = std::move(vbranch.children);
+
+        auto parent = branches->back();
+        branches->push_back(new_branch.get());
+        // --first is the char the branch hangs off
+        parent->children[*--first] = std::move(new_branch); // vbranch is gone after this
+        *found = true;
+      }
+      void operator()(leaf_node_t& leaf) override {
+        auto lfirst = std::begin(leaf.data);
+        auto llast  = std::end(leaf.data);
+
+        if (!simd::equal(lfirst, llast, first, last)) return;
+
+        // --first is the char the leaf hangs off
+        branches->back()->children.erase(*--first);
+        *found = true;
+      }
+
+      void descend(branch_node_t& branch) {
+        if (first == last) return; // a plain branch isn't a word
+
+        auto next = branch.children.find(*first);
+        if (next == std::end(branch.children)) return;
+
+        branches->push_back(&branch);
+        ++first; // advance
+        next->second->accept(*this);
+      }
+    } visitor{std::begin(word), std::end(word), branches, found, alloc_};
+
+    root_.accept(visitor);
+    if (!found) return false;
+
+    // find the highest branch (under the root, so 0 is none) left holding a single word.
+    // Branches off the path always hold two words or more, so only the path needs looking at
+    bool leaf;
+    std::size_t fold = 0;
+    for (auto i = branches.size() - 1; i != 0; --i) {
+      auto& branch = *branches[i];
+      bool  single = false;
+      if (detail::value_at_node(branch, leaf)) {
+        single = branch.children.empty();
+      }
+      else if (branch.children.size() == 1) {
+        detail::value_at_node(*std::begin(branch.children)->second, leaf);
+        single = i + 1 == fold || leaf;
+      }
+      if (!single) break;
+
+      fold = i;
+    }
+
+    if (fold != 0) {
+      // everything from there down becomes one leaf
+      std::string     data;
+      T*              value;
+      node_concept_t* node = branches[fold];
+      for (;;) {
+        value = detail::value_at_node(*node, leaf);
+        if (leaf) {
+          data.append(static_cast<leaf_node_t*>(node)->data);
+          break;
+        }
+        if (value) break;
+
+        auto only = *std::begin(static_cast<branch_node_t*>(node)->children);
+        data.push_back(only.first);
+        node = only.second.get();
+      }
+      branches[fold - 1]->children[word[fold - 1]] =
+        detail::make_leaf<T, Alloc, Augment>(alloc_, data.cbegin(), data.cend(), std::move(*value));
+      branches.resize(fold);
+    }
+
+    // the branches on the way back up lost the word
+    if (augmented_) {
+      for (auto i = branches.size(); i-- != 0;) {
+        detail::summarize(*branches[i], false);
+      }
+    }
+
+    return true;
   }
 
   bool exists(const std::string& word) const {
@@ -777,14 +2290,14 @@ public:
 
       value_extract_visitor(bool& extracted, T& value) : extracted(&extracted), value(&value) { *this->extracted = false; }
 
-      void operator()(const detail::branch_node_t<T>&) const {
+      void operator()(const branch_node_t&) const {
         // no value here
       }
-      void operator()(const detail::branch_value_node_t<T>& vbranch) const {
+      void operator()(const branch_value_node_t& vbranch) const {
         *value = vbranch.value;
         *extracted = true;
       }
-      void operator()(const detail::leaf_node_t<T>& leaf) const {
+      void operator()(const leaf_node_t& leaf) const {
         *value = leaf.value;
         *extracted = true;
       }
@@ -795,6 +2308,47 @@ public:
     return extracted;
   }
 
+  // looks up every word in [first, last) and writes whether it exists to out.  The lookups
+  // run a few at a time, interleaved, with the next node of each prefetched so the cache
+  // misses of one lookup overlap with the work done on the others
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // like exists_batch but writes a pointer to the value of each word, or nullptr if the
+  // word isn't there.  The pointers are good until the trie is changed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  // the longest word 'key' starts with, found in one walk down which remembers the last
+  // word it went by
+  bool longest_prefix_of(const std::string& key, std::string& matching_word) const {
+    std::size_t length = 0;
+    if (!longest_prefix_(key, length)) return false;
+
+    matching_word.assign(key, 0, length);
+    return true;
+  }
+
+  bool longest_prefix_of(const std::string& key, std::string& matching_word, T& value) const {
+    std::size_t length = 0;
+    auto        found  = longest_prefix_(key, length);
+    if (!found) return false;
+
+    matching_word.assign(key, 0, length);
+    value = *found;
+    return true;
+  }
+
   bool prefix_match(const std::string& prefix, std::string& matching_word) const {
     auto prefix_end = std::begin(prefix);
     auto node = lookup_node_prefix_(std::begin(prefix), std::end(prefix), prefix_end);
@@ -818,17 +2372,17 @@ public:
         *this->result = false;
       }
 
-      void operator()(const detail::branch_node_t<T>& branch) const {
+      void operator()(const branch_node_t& branch) const {
         // recurse down
         auto next = std::begin(branch.children);
         assert(next != std::end(branch.children) && "prog error");
         match->push_back(next->first);
         next->second->accept(*this);
       }
-      void operator()(const detail::branch_value_node_t<T>&) const {
+      void operator()(const branch_value_node_t&) const {
         *result = true; // done
       }
-      void operator()(const detail::leaf_node_t<T>& leaf) const {
+      void operator()(const leaf_node_t& leaf) const {
         match->append(leaf.data); // just append the whole node
         *result = true;
       }
@@ -839,175 +2393,5498 @@ public:
     return ret;
   }
 
-  std::vector<std::string> get_words() const {
-    std::vector<std::string> ret;
-    std::string              working_prefix;
+  // the k words starting with 'prefix' which have the greatest values, greatest first.  Needs
+  // an augment keeping the max under each branch (max_augment) so the walk goes best first
+  // and never opens a branch which can't beat the words already found
+  std::vector<std::pair<std::string, T>> top_k(const std::string& prefix, std::size_t k) const {
+    typedef typename Augment::compare_type compare_t;
 
-    struct print_visitor : node_concept_t::visitor_t {
-      std::string*              working_prefix;
-      std::vector<std::string>* result;
+    std::vector<std::pair<std::string, T>> ret;
+    if (k == 0) return ret;
 
-      print_visitor(std::string& working_prefix, std::vector<std::string>& result) :
-        working_prefix(&working_prefix), result(&result) { }
+    auto prefix_end           = std::end(prefix);
+    const node_concept_t* top = &root_;
+    if (!prefix.empty()) {
+      top = lookup_node_prefix_(std::begin(prefix), std::end(prefix), prefix_end);
+      if (!top) return ret;
+    }
 
-      void operator()(const detail::branch_node_t<T>& branch) const {
-        // visit children
-        for (const auto& child : branch.children) {
-          working_prefix->push_back(child.first);
-          child.second->accept(*this);
-          working_prefix->pop_back();
-        }
+    // either a word or a branch still to be opened
+    struct candidate_t {
+      const T*              score;
+      const node_concept_t* branch; // null for words
+      std::string           key;
+    };
+    struct candidate_less {
+      bool operator()(const candidate_t& a, const candidate_t& b) const {
+        if (compare_t{}(*a.score, *b.score)) return true;
+        if (compare_t{}(*b.score, *a.score)) return false;
+        return a.branch && !b.branch; // on a tie take the word, there's no need to open the branch yet
       }
-      void operator()(const detail::branch_value_node_t<T>& vbranch) const {
-        result->push_back(*working_prefix);
+    };
+    typedef std::priority_queue<candidate_t, std::vector<candidate_t>, candidate_less> queue_t;
 
-        // visit children
-        for (const auto& child : vbranch.children) {
-          working_prefix->push_back(child.first);
-          child.second->accept(*this);
-          working_prefix->pop_back();
+    struct top_k_visitor : node_concept_t::visitor_t {
+      queue_t*           queue;
+      const std::string* key;
+      bool               open; // push what is under a branch rather than the branch
+
+      top_k_visitor(queue_t& queue, const std::string& key, bool open) :
+        queue(&queue), key(&key), open(open) { }
+
+      void operator()(const branch_node_t& branch) const {
+        if (!open) {
+          if (branch.summary().has_max) queue->push({ &branch.summary().max, &branch, *key });
+          return;
         }
+
+        open_children(branch);
       }
-      void operator()(const detail::leaf_node_t<T>& leaf) const {
-        result->push_back(*working_prefix + leaf.data);
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (!open) {
+          queue->push({ &vbranch.summary().max, &vbranch, *key });
+          return;
+        }
+
+        queue->push({ &vbranch.value, nullptr, *key });
+        open_children(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        queue->push({ &leaf.value, nullptr, *key + leaf.data });
       }
-    } visitor{working_prefix, ret};
 
-    root_.accept(visitor);
+      void open_children(const branch_node_t& branch) const {
+        std::string child_key;
+        for (const auto& child : branch.children) {
+          child_key = *key;
+          child_key.push_back(child.first);
+          child.second->accept(top_k_visitor{*queue, child_key, false});
+        }
+      }
+    };
+
+    queue_t     queue;
+    std::string key{std::begin(prefix), prefix_end};
+    top->accept(top_k_visitor{queue, key, false});
+
+    while (!queue.empty() && ret.size() != k) {
+      auto candidate = queue.top();
+      queue.pop();
+
+      if (!candidate.branch) {
+        ret.emplace_back(std::move(candidate.key), *candidate.score);
+        continue;
+      }
+
+      candidate.branch->accept(top_k_visitor{queue, candidate.key, true});
+    }
 
     return ret;
   }
 
-private:
-  const node_concept_t* lookup_node_(std::string::const_iterator first, std::string::const_iterator last) const {
-    if (first == last) return nullptr;
+  // how many words start with 'prefix'.  Needs an augment keeping the word count under each
+  // branch (count_augment) so it's one walk down to where the prefix ends
+  std::size_t count_prefix(const std::string& prefix) const {
+    static_assert(std::is_same<Augment, count_augment>::value, "count_prefix/rank/select need count_augment");
 
-    const node_concept_t* ret;
+    if (prefix.empty()) return root_.summary().count;
 
-    struct lookup_visitor : node_concept_t::visitor_t {
-      std::string::const_iterator* first;
-      std::string::const_iterator* last;
-      const node_concept_t**       result;
+    auto prefix_end = std::begin(prefix);
+    auto node       = lookup_node_prefix_(std::begin(prefix), std::end(prefix), prefix_end);
+    if (!node) return 0;
 
-      lookup_visitor(std::string::const_iterator& first, std::string::const_iterator& last, const node_concept_t*& result) :
-        first(&first), last(&last), result(&result) {
-        *this->result = nullptr;
+    return count_of_(*node);
+  }
+
+  // how many words come before 'key' in get_words() order, 'key' needn't be a word.  Needs
+  // count_augment, the counts of the children before the char taken are added up on the
+  // way down rather than walking them
+  std::size_t rank(const std::string& key) const {
+    static_assert(std::is_same<Augment, count_augment>::value, "count_prefix/rank/select need count_augment");
+
+    std::size_t ret = 0;
+
+    struct rank_visitor : node_concept_t::visitor_t {
+      const std::string* key;
+      std::size_t*       pos;
+      std::size_t*       result;
+
+      rank_visitor(const std::string& key, std::size_t& pos, std::size_t& result) :
+        key(&key), pos(&pos), result(&result) { }
+
+      void operator()(const branch_node_t& branch) const {
+        descend(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        // the word here is a proper prefix of 'key' so it comes first
+        if (*pos != key->size()) ++*result;
+        descend(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        auto first = std::next(std::begin(*key), static_cast<std::ptrdiff_t>(*pos));
+        if (std::lexicographical_compare(std::begin(leaf.data), std::end(leaf.data), first, std::end(*key))) {
+          ++*result;
+        }
       }
 
-      void operator()(const detail::branch_node_t<T>& branch) const {
-        if (*first == *last) {
-          // not found
-          return;
+      void descend(const branch_node_t& branch) const {
+        // everything under here starts with 'key'
+        if (*pos == key->size()) return;
+
+        auto c = (*key)[*pos];
+        for (const auto& child : branch.children) {
+          if (!std::less<char>{}(child.first, c)) {
+            if (child.first != c) return;
+
+            ++*pos;
+            child.second->accept(*this);
+            return;
+          }
+          *result += count_of_(*child.second);
         }
+      }
+    };
 
-        auto next = branch.children.find(**first);
-        if (next == std::end(branch.children)) {
-          // not found
-          return;
+    std::size_t pos = 0;
+    root_.accept(rank_visitor{key, pos, ret});
+
+    return ret;
+  }
+
+  // the word at 'index' in get_words() order, false if there are not that many words.  Needs
+  // count_augment, whole children are skipped over by their counts on the way down
+  bool select(std::size_t index, std::string& word) const {
+    static_assert(std::is_same<Augment, count_augment>::value, "count_prefix/rank/select need count_augment");
+
+    if (index >= root_.summary().count) return false;
+
+    word.clear();
+
+    struct select_visitor : node_concept_t::visitor_t {
+      std::size_t* index;
+      std::string* word;
+
+      select_visitor(std::size_t& index, std::string& word) : index(&index), word(&word) { }
+
+      void operator()(const branch_node_t& branch) const {
+        descend(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (*index == 0) return; // the word so far is the one
+        --*index;
+        descend(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        assert(*index == 0 && "prog error");
+        word->append(leaf.data);
+      }
+
+      void descend(const branch_node_t& branch) const {
+        for (const auto& child : branch.children) {
+          auto count = count_of_(*child.second);
+          if (*index < count) {
+            word->push_back(child.first);
+            child.second->accept(*this);
+            return;
+          }
+          *index -= count;
         }
+        assert(false && "prog error");
+      }
+    };
 
-        ++*first; // advance
-        next->second->accept(*this);
+    root_.accept(select_visitor{index, word});
+
+    return true;
+  }
+
+  // calls on_match(word, value) for every word matching 'pattern', in the same order as
+  // get_words.  '?' matches any one char and '*' any run of chars, empty included.  The
+  // walk carries the set of pattern positions still in play, so a word is only reported
+  // once however many ways it matches, and only opens up every child of a branch when a
+  // wildcard is in play, a plain char is looked up.  Leaf data is matched where it is
+  template <typename F>
+  void match_pattern(const std::string& pattern, F&& on_match) const {
+    typedef typename std::remove_reference<F>::type callback_t;
+
+    struct pattern_visitor : node_concept_t::visitor_t {
+      const std::string*        pattern;
+      std::vector<std::size_t>* states; // the positions in play for the empty key and each char of the key
+      std::vector<std::size_t>* starts; // where each of those sets starts in states
+      std::string*              key;
+      callback_t*               on_match;
+
+      pattern_visitor(const std::string& pattern, std::vector<std::size_t>& states, std::vector<std::size_t>& starts,
+        std::string& key, callback_t& on_match) :
+        pattern(&pattern), states(&states), starts(&starts), key(&key), on_match(&on_match) { }
+
+      void operator()(const branch_node_t& branch) const {
+        visit_children(branch);
       }
-      void operator()(const detail::branch_value_node_t<T>& vbranch) const {
-        if (*first == *last) {
-          *result = &vbranch;
-          return;
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (at_end()) (*on_match)(static_cast<const std::string&>(*key), vbranch.value);
+        visit_children(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        std::size_t pushed = 0;
+        bool        alive  = true;
+        for (char c : leaf.data) {
+          ++pushed;
+          if (!push(c)) {
+            alive = false;
+            break;
+          }
         }
+        if (alive && at_end()) (*on_match)(static_cast<const std::string&>(*key), leaf.value);
 
-        auto next = vbranch.children.find(**first);
-        if (next == std::end(vbranch.children)) {
-          // not found
-          return;
+        while (pushed-- != 0) pop();
+      }
+
+      void visit_children(const branch_node_t& branch) const {
+        // with no wildcard in play only the chars the pattern names can follow
+        std::string literals;
+        for (auto i = starts->back(); i != states->size(); ++i) {
+          auto p = (*states)[i];
+          if (p == pattern->size()) continue;
+
+          auto c = (*pattern)[p];
+          if (c == '?' || c == '*') {
+            for (const auto& child : branch.children) {
+              if (push(child.first)) child.second->accept(*this);
+              pop();
+            }
+            return;
+          }
+          literals.push_back(c);
         }
 
-        ++*first; // advance
-        next->second->accept(*this);
+        std::sort(std::begin(literals), std::end(literals));
+        literals.erase(std::unique(std::begin(literals), std::end(literals)), std::end(literals));
+        for (char c : literals) {
+          auto child = branch.children.find(c);
+          if (child == std::end(branch.children)) continue;
+
+          if (push(c)) child->second->accept(*this);
+          pop();
+        }
       }
-      void operator()(const detail::leaf_node_t<T>& leaf) const {
-        // compare the remaining string to the leaf value
-        auto lfirst = std::begin(leaf.data);
-        auto llast = std::end(leaf.data);
 
-        if (std::distance(lfirst, llast) == std::distance(*first, *last) &&
-          std::equal(lfirst, llast, *first)) {
-          *result = &leaf;
+      // the positions after 'c', false if none are left
+      bool push(char c) const {
+        auto first = starts->back();
+        auto last  = states->size();
+        starts->push_back(last);
+        key->push_back(c);
+
+        for (auto i = first; i != last; ++i) {
+          auto p = (*states)[i];
+          if (p == pattern->size()) continue;
+
+          auto wildcard = (*pattern)[p];
+          if (wildcard == '*') add(p); // the star takes 'c' and stays
+          else if (wildcard == '?' || wildcard == c) add(p + 1);
         }
+        return states->size() != starts->back();
       }
-    } visitor{first, last, ret};
 
+      void pop() const {
+        states->resize(starts->back());
+        starts->pop_back();
+        key->pop_back();
+      }
+
+      // adds 'p' to the newest set along with the positions past the stars from there on,
+      // a star can match nothing
+      void add(std::size_t p) const {
+        for (;;) {
+          if (std::find(std::begin(*states) + static_cast<std::ptrdiff_t>(starts->back()), std::end(*states), p) != std::end(*states)) return;
+
+          states->push_back(p);
+          if (p == pattern->size() || (*pattern)[p] != '*') return;
+          ++p;
+        }
+      }
+
+      bool at_end() const {
+        return std::find(std::begin(*states) + static_cast<std::ptrdiff_t>(starts->back()), std::end(*states),
+                         pattern->size()) != std::end(*states);
+      }
+    };
+
+    callback_t&              callback = on_match;
+    std::vector<std::size_t> states;
+    std::vector<std::size_t> starts{ 0 };
+    std::string              key;
+
+    pattern_visitor visitor{pattern, states, starts, key, callback};
+    visitor.add(0);
     root_.accept(visitor);
+  }
+
+  // every word within 'max_distance' edits (insertions, deletions and substitutions) of
+  // 'word' along with its distance, in the same order as get_words.  The walk carries a row
+  // of the Levenshtein table for each char of the key, leaf data included, and skips what
+  // is below once every entry of the row is past max_distance since nothing there can get
+  // back under it.  Only the band of max_distance entries either side of the diagonal is
+  // worked out, the rest are past max_distance anyway
+  std::vector<std::pair<std::string, std::size_t>> fuzzy_search(const std::string& word, std::size_t max_distance) const {
+    typedef std::vector<std::pair<std::string, std::size_t>> matches_t;
+
+    struct fuzzy_visitor : node_concept_t::visitor_t {
+      const std::string*        word;
+      std::size_t               max_distance;
+      std::vector<std::size_t>* rows;  // word.size() + 1 entries for the empty key and each char of the key
+      std::size_t*              depth; // the row of the whole key
+      std::string*              key;
+      matches_t*                matches;
+
+      fuzzy_visitor(const std::string& word, std::size_t max_distance, std::vector<std::size_t>& rows,
+        std::size_t& depth, std::string& key, matches_t& matches) :
+        word(&word), max_distance(max_distance), rows(&rows), depth(&depth), key(&key), matches(&matches) { }
+
+      void operator()(const branch_node_t& branch) const {
+        visit_children(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        found();
+        visit_children(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        std::size_t pushed = 0;
+        bool        within = true;
+        for (char c : leaf.data) {
+          ++pushed;
+          if (!push(c)) {
+            within = false;
+            break;
+          }
+        }
+        if (within) found();
+
+        while (pushed-- != 0) pop();
+      }
+
+      void visit_children(const branch_node_t& branch) const {
+        // once the best of the row is max_distance a child only stays within it by matching
+        // the word where the row is at max_distance, those few chars are looked up directly
+        auto d     = *depth;
+        auto first = band_first(d);
+        auto last  = band_last(d);
+        if (*std::min_element(row(d) + first, row(d) + last + 1) == max_distance) {
+          std::string next;
+          for (auto i = first; i <= last && i != word->size(); ++i) {
+            if (row(d)[i] == max_distance) next.push_back((*word)[i]);
+          }
+          std::sort(std::begin(next), std::end(next));
+          next.erase(std::unique(std::begin(next), std::end(next)), std::end(next));
+
+          for (char c : next) {
+            auto child = branch.children.find(c);
+            if (child == std::end(branch.children)) continue;
+
+            if (push(c)) child->second->accept(*this);
+            pop();
+          }
+          return;
+        }
+
+        for (const auto& child : branch.children) {
+          if (push(child.first)) child.second->accept(*this);
+          pop();
+        }
+      }
+
+      const std::size_t* row(std::size_t d) const { return rows->data() + d * (word->size() + 1); }
+
+      // first and last entry of the band in row 'd'
+      std::size_t band_first(std::size_t d) const { return d > max_distance ? d - max_distance : 0; }
+      std::size_t band_last(std::size_t d) const { return std::min(word->size(), d + max_distance); }
+
+      // entry i of row d, anything off the band is just past max_distance
+      std::size_t at(std::size_t d, std::size_t i) const {
+        if (i < band_first(d) || i > band_last(d)) return max_distance + 1;
+        return (*rows)[d * (word->size() + 1) + i];
+      }
+
+      // the row for the key with 'c' on the end, false if every entry is past max_distance
+      bool push(char c) const {
+        auto d = ++*depth;
+        key->push_back(c);
+
+        auto width = word->size() + 1;
+        if (rows->size() < (d + 1) * width) rows->resize((d + 1) * width);
+
+        auto first = band_first(d);
+        auto last  = band_last(d);
+        auto best  = max_distance + 1;
+        for (auto i = first; i <= last; ++i) {
+          std::size_t entry = d;
+          if (i != 0) {
+            auto substitute = at(d - 1, i - 1) + ((*word)[i - 1] != c ? 1 : 0);
+            auto left       = i != first ? (*rows)[d * width + i - 1] : max_distance + 1;
+            entry = std::min({ at(d - 1, i) + 1, left + 1, substitute });
+          }
+          (*rows)[d * width + i] = entry;
+          best = std::min(best, entry);
+        }
+
+        return best <= max_distance;
+      }
+
+      void pop() const {
+        --*depth;
+        key->pop_back();
+      }
+
+      // the last entry of the row is the distance from the whole key to the whole word
+      void found() const {
+        auto distance = at(*depth, word->size());
+        if (distance <= max_distance) matches->emplace_back(*key, distance);
+      }
+    };
+
+    // keeps max_distance + 1 from wrapping around
+    max_distance = std::min(max_distance, std::numeric_limits<std::size_t>::max() - 2);
+
+    // the empty key is i edits away from the first i chars of the word
+    std::vector<std::size_t> rows(word.size() + 1);
+    for (std::size_t i = 0; i != rows.size(); ++i) {
+      rows[i] = i;
+    }
+
+    matches_t   ret;
+    std::size_t depth = 0;
+    std::string key;
+    root_.accept(fuzzy_visitor{word, max_distance, rows, depth, key, ret});
 
     return ret;
   }
 
-  const node_concept_t* lookup_node_prefix_(std::string::const_iterator first, std::string::const_iterator last, std::string::const_iterator& prefix_end) const {
-    if (first == last) return nullptr;
+  // walks the words in the same order as get_words, one at a time.  Each word is built in a
+  // single buffer which is reused as the walk goes on, so only the path to the current word
+  // is ever held
+  class const_iterator {
+    friend class trie;
 
-    const node_concept_t* ret;
+    typedef typename branch_node_t::children_t::const_iterator child_iterator;
 
-    struct lookup_prefix_visitor : node_concept_t::visitor_t {
-      std::string::const_iterator* first;
-      std::string::const_iterator* last;
-      const node_concept_t**       result;
+    struct frame_t {
+      child_iterator next;
+      child_iterator last;
+      std::size_t    key_size; // length of the key at this branch
+    };
 
-      lookup_prefix_visitor(std::string::const_iterator& first, std::string::const_iterator& last, const node_concept_t*& result) :
-        first(&first), last(&last), result(&result) {
-        *this->result = nullptr;
-      }
+    std::vector<frame_t>  stack_;
+    std::string           key_;
+    const node_concept_t* node_  = nullptr; // the node of the current word, null at the end
+    const T*              value_ = nullptr;
 
-      void operator()(const detail::branch_node_t<T>& branch) const {
-        if (*first == *last) {
-          // best match
-          *result = &branch;
-          return;
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::string               value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const std::string*        pointer;
+    typedef const std::string&        reference;
+
+    const_iterator() = default;
+
+    reference operator*() const { return key_; }
+    pointer operator->() const { return &key_; }
+
+    // the value stored with the current word
+    const T& value() const { return *value_; }
+
+    const_iterator& operator++() {
+      advance_();
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto ret = *this;
+      advance_();
+      return ret;
+    }
+
+    friend bool operator==(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ == rhs.node_; }
+    friend bool operator!=(const const_iterator& lhs, const const_iterator& rhs) { return lhs.node_ != rhs.node_; }
+
+  private:
+    void push_(const branch_node_t& branch) {
+      stack_.push_back({ std::begin(branch.children), std::end(branch.children), key_.size() });
+    }
+
+    // steps into 'node', whose key is already in key_, returns true if it is a word
+    bool enter_(const node_concept_t& node) {
+      bool is_word;
+
+      struct enter_visitor : node_concept_t::visitor_t {
+        const_iterator* it;
+        bool*           is_word;
+
+        enter_visitor(const_iterator& it, bool& is_word) : it(&it), is_word(&is_word) { }
+
+        void operator()(const branch_node_t& branch) const {
+          it->push_(branch);
+          *is_word = false;
         }
+        void operator()(const branch_value_node_t& vbranch) const {
+          it->push_(vbranch);
+          it->value_ = &vbranch.value;
+          *is_word   = true;
+        }
+        void operator()(const leaf_node_t& leaf) const {
+          it->key_.append(leaf.data);
+          it->value_ = &leaf.value;
+          *is_word = true;
+        }
+      } visitor{*this, is_word};
 
-        auto next = branch.children.find(**first);
-        if (next == std::end(branch.children)) {
-          // not found
-          return;
+      node.accept(visitor);
+
+      if (is_word) node_ = &node;
+      return is_word;
+    }
+
+    // moves to the next word in order, or to the end
+    void advance_() {
+      node_ = nullptr;
+      while (!stack_.empty()) {
+        auto& top = stack_.back();
+        if (top.next == top.last) {
+          stack_.pop_back();
+          continue;
         }
 
-        ++*first; // advance
-        next->second->accept(*this);
+        auto child = top.next++;
+        key_.resize(top.key_size);
+        key_.push_back(child->first);
+        if (enter_(*child->second)) return; // invalidates top
       }
-      void operator()(const detail::branch_value_node_t<T>& vbranch) const {
-        if (*first == *last) {
-          *result = &vbranch;
-          return;
+      key_.clear();
+    }
+
+    void seek_(const branch_node_t& root, const std::string& target) {
+      struct seek_visitor : node_concept_t::visitor_t {
+        const_iterator*    it;
+        const std::string* target;
+
+        seek_visitor(const_iterator& it, const std::string& target) : it(&it), target(&target) { }
+
+        void operator()(const branch_node_t& branch) const { seek(branch, nullptr); }
+        void operator()(const branch_value_node_t& vbranch) const { seek(vbranch, &vbranch.value); }
+        void operator()(const leaf_node_t& leaf) const {
+          // the leaf holds a single word, it's the one if it doesn't sort before the target
+          it->key_.append(leaf.data);
+          if (!std::lexicographical_compare(std::begin(it->key_), std::end(it->key_), std::begin(*target), std::end(*target))) {
+            it->node_  = &leaf;
+            it->value_ = &leaf.value;
+            return;
+          }
+          it->advance_();
         }
 
-        auto next = vbranch.children.find(**first);
-        if (next == std::end(vbranch.children)) {
-          // not found
-          return;
+        void seek(const branch_node_t& branch, const T* value) const {
+          auto depth = it->key_.size();
+          if (depth == target->size()) {
+            // everything under here sorts at or after the target
+            it->push_(branch);
+            if (value) {
+              it->node_  = &branch;
+              it->value_ = value;
+              return;
+            }
+            it->advance_();
+            return;
+          }
+
+          // only the children after the one we go down are left to visit at this branch
+          auto c    = (*target)[depth];
+          auto next = branch.children.lower_bound(c);
+          it->stack_.push_back({ next, std::end(branch.children), depth });
+          if (next == std::end(branch.children) || next->first != c) {
+            // everything left sorts after the target
+            it->advance_();
+            return;
+          }
+
+          ++it->stack_.back().next;
+          it->key_.push_back(c);
+          next->second->accept(*this);
         }
+      } visitor{*this, target};
 
-        ++*first; // advance
-        next->second->accept(*this);
+      root.accept(visitor);
+    }
+  };
+
+  const_iterator begin() const {
+    const_iterator it;
+    it.push_(root_);
+    it.advance_();
+    return it;
+  }
+  const_iterator end() const { return {}; }
+
+  // the first word which doesn't sort before 'prefix'.  Keep walking while the words still
+  // start with 'prefix' to visit every word under it
+  const_iterator lower_bound(const std::string& prefix) const {
+    if (prefix.empty()) return begin();
+
+    const_iterator it;
+    it.seek_(root_, prefix);
+    return it;
+  }
+
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    struct print_visitor : node_concept_t::visitor_t {
+      std::string*              working_prefix;
+      std::vector<std::string>* result;
+
+      print_visitor(std::string& working_prefix, std::vector<std::string>& result) :
+        working_prefix(&working_prefix), result(&result) { }
+
+      void operator()(const branch_node_t& branch) const {
+        // visit children
+        for (const auto& child : branch.children) {
+          working_prefix->push_back(child.first);
+          child.second->accept(*this);
+          working_prefix->pop_back();
+        }
       }
-      void operator()(const detail::leaf_node_t<T>& leaf) const {
-        // compare the remaining string to the leaf value
-        auto lfirst = std::begin(leaf.data);
-        auto llast = std::end(leaf.data);
+      void operator()(const branch_value_node_t& vbranch) const {
+        result->push_back(*working_prefix);
 
-        // compare to the end of this prefix
-        if (std::distance(*first, *last) <= std::distance(lfirst, llast) &&
-          std::equal(*first, *last, lfirst)) {
-          *result = &leaf;
+        // visit children
+        for (const auto& child : vbranch.children) {
+          working_prefix->push_back(child.first);
+          child.second->accept(*this);
+          working_prefix->pop_back();
         }
       }
-    } visitor{first, last, ret};
+      void operator()(const leaf_node_t& leaf) const {
+        result->push_back(*working_prefix + leaf.data);
+      }
+    } visitor{working_prefix, ret};
 
     root_.accept(visitor);
 
-    prefix_end = first;
-
     return ret;
   }
-};
 
-} // namespace impl3
+  // lays the trie out in contiguous arrays for read only use.  The arrays are indexed with
+  // 32 bits, a trie with more nodes, values or bytes of edge data throws std::length_error
+  frozen_trie<T> freeze() const {
+    frozen_trie<T> ret;
+
+    // breadth first so the children of every node end up next to each other,
+    // order[i] is the trie node which becomes ret.nodes_[i]
+    std::vector<const node_concept_t*> order{&root_};
+    std::size_t                        current = 0;
+
+    struct freeze_visitor : node_concept_t::visitor_t {
+      frozen_trie<T>*                     frozen;
+      std::vector<const node_concept_t*>* order;
+      std::size_t*                        current;
+
+      freeze_visitor(frozen_trie<T>& frozen, std::vector<const node_concept_t*>& order, std::size_t& current) :
+        frozen(&frozen), order(&order), current(&current) { }
+
+      void operator()(const branch_node_t& branch) const {
+        add_children(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        add_value(vbranch.value);
+        add_children(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        auto& node      = frozen->nodes_[*current];
+        node.data_first = index(frozen->data_.size());
+        node.data_size  = index(frozen->data_.size() + leaf.data.size()) - node.data_first;
+        frozen->data_.append(leaf.data);
+
+        add_value(leaf.value);
+      }
+
+      void add_value(const T& value) const {
+        frozen->nodes_[*current].value = index(frozen->values_.size());
+        frozen->values_.push_back(value);
+      }
+      void add_children(const branch_node_t& branch) const {
+        auto& node       = frozen->nodes_[*current];
+        node.child_first = index(order->size());
+        node.child_count = index(order->size() + branch.children.size()) - node.child_first;
+
+        for (const auto& child : branch.children) {
+          order->push_back(child.second.get());
+          frozen->edges_.push_back(child.first);
+        }
+        frozen->nodes_.resize(order->size());
+      }
+
+      // the largest index is kept free, it is frozen_node_t::npos
+      static std::uint32_t index(std::size_t i) {
+        if (i >= std::numeric_limits<std::uint32_t>::max()) throw std::length_error("trie is too large to freeze");
+        return static_cast<std::uint32_t>(i);
+      }
+    } visitor{ret, order, current};
+
+    for (; current != order.size(); ++current) {
+      order[current]->accept(visitor);
+    }
+
+    return ret;
+  }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_concept_t*       node  = nullptr; // null once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.node = &root_;
+    return state;
+  }
+
+  static bool batch_step_(batch_state_t& state) {
+    if (!state.node) return false;
+
+    struct step_visitor : node_concept_t::visitor_t {
+      batch_state_t* state;
+
+      step_visitor(batch_state_t& state) : state(&state) { }
+
+      void operator()(const branch_node_t& branch) const {
+        if (state->first == state->last) {
+          // not found
+          state->node = nullptr;
+          return;
+        }
+
+        descend(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (state->first == state->last) {
+          state->value = &vbranch.value;
+          state->node  = nullptr;
+          return;
+        }
+
+        descend(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        // compare the remaining string to the leaf value
+        auto lfirst = std::begin(leaf.data);
+        auto llast  = std::end(leaf.data);
+
+        if (simd::equal(lfirst, llast, state->first, state->last)) {
+          state->value = &leaf.value;
+        }
+        state->node = nullptr;
+      }
+
+      void descend(const branch_node_t& branch) const {
+        auto next = branch.children.find(*state->first);
+        if (next == std::end(branch.children)) {
+          // not found
+          state->node = nullptr;
+          return;
+        }
+
+        ++state->first; // advance
+        state->node = next->second.get();
+        util::prefetch(state->node);
+      }
+    } visitor{state};
+
+    state.node->accept(visitor);
+
+    return state.node != nullptr;
+  }
+
+  // every word in [first, last) is longer than depth and already shares its first depth chars
+  template <typename ForwardIt>
+  void build_children_(branch_node_t& branch, ForwardIt first, ForwardIt last, std::size_t depth) {
+    while (first != last) {
+      // group up the words continuing with the same char
+      auto c          = first->first[depth];
+      auto back       = first;
+      auto group_last = std::next(first);
+      for (; group_last != last && group_last->first[depth] == c; ++group_last) {
+        back = group_last;
+      }
+
+      branch.children[c] = build_node_(first, back, group_last, depth + 1);
+      first = group_last;
+    }
+  }
+
+  template <typename ForwardIt>
+  detail::node_ptr<T, Alloc, Augment> build_node_(ForwardIt first, ForwardIt back, ForwardIt last, std::size_t depth) {
+    const std::string& word      = first->first;
+    const std::string& back_word = back->first;
+
+    // since the input is sorted every word in the range shares what the first and last words share
+    auto shared = simd::mismatch(std::begin(word) + depth, std::end(word), std::begin(back_word) + depth, std::end(back_word));
+    if (shared.first == std::end(word) && shared.second == std::end(back_word)) {
+      // only one distinct word left
+      return detail::make_leaf<T, Alloc, Augment>(alloc_, std::begin(word) + depth, std::end(word), first->second);
+    }
+
+    auto split_depth = static_cast<std::size_t>(shared.first - std::begin(word));
+    if (shared.first == std::end(word)) {
+      // the first word ends where the rest carry on, *_to_value annotates the branch that it is a word
+      auto root_branch = detail::build_branches_to_value<T, Alloc, Augment>(alloc_, std::begin(word) + depth, shared.first, first->second);
+      while (first != last && first->first.size() == split_depth) ++first;
+
+      build_children_(*root_branch.second, first, last, split_depth);
+      return std::move(root_branch.first);
+    }
+
+    auto root_branch = detail::build_branches<T, Alloc, Augment>(alloc_, std::begin(word) + depth, shared.first);
+    build_children_(*root_branch.second, first, last, split_depth);
+    return std::move(root_branch.first);
+  }
+
+  const node_concept_t* lookup_node_(std::string::const_iterator first, std::string::const_iterator last) const {
+    if (first == last) return nullptr;
+
+    const node_concept_t* ret;
+
+    struct lookup_visitor : node_concept_t::visitor_t {
+      std::string::const_iterator* first;
+      std::string::const_iterator* last;
+      const node_concept_t**       result;
+
+      lookup_visitor(std::string::const_iterator& first, std::string::const_iterator& last, const node_concept_t*& result) :
+        first(&first), last(&last), result(&result) {
+        *this->result = nullptr;
+      }
+
+      void operator()(const branch_node_t& branch) const {
+        if (*first == *last) {
+          // not found
+          return;
+        }
+
+        auto next = branch.children.find(**first);
+        if (next == std::end(branch.children)) {
+          // not found
+          return;
+        }
+
+        ++*first; // advance
+        next->second->accept(*this);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (*first == *last) {
+          *result = &vbranch;
+          return;
+        }
+
+        auto next = vbranch.children.find(**first);
+        if (next == std::end(vbranch.children)) {
+          // not found
+          return;
+        }
+
+        ++*first; // advance
+        next->second->accept(*this);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        // compare the remaining string to the leaf value
+        auto lfirst = std::begin(leaf.data);
+        auto llast = std::end(leaf.data);
+
+        if (simd::equal(lfirst, llast, *first, *last)) {
+          *result = &leaf;
+        }
+      }
+    } visitor{first, last, ret};
+
+    root_.accept(visitor);
+
+    return ret;
+  }
+
+  // the value of the last word passed on the way down 'key', its length goes in 'length'
+  const T* longest_prefix_(const std::string& key, std::size_t& length) const {
+    const T* ret = nullptr;
+
+    struct longest_prefix_visitor : node_concept_t::visitor_t {
+      const std::string* key;
+      std::size_t*       pos;
+      std::size_t*       length;
+      const T**          result;
+
+      longest_prefix_visitor(const std::string& key, std::size_t& pos, std::size_t& length, const T*& result) :
+        key(&key), pos(&pos), length(&length), result(&result) { }
+
+      void operator()(const branch_node_t& branch) const {
+        descend(branch);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        *result = &vbranch.value;
+        *length = *pos;
+        descend(vbranch);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        // all of the leaf data has to be in what is left of the key
+        if (key->size() - *pos < leaf.data.size()) return;
+
+        if (simd::equal(leaf.data.data(), key->data() + *pos, leaf.data.size())) {
+          *result = &leaf.value;
+          *length = *pos + leaf.data.size();
+        }
+      }
+
+      void descend(const branch_node_t& branch) const {
+        if (*pos == key->size()) return;
+
+        auto next = branch.children.find((*key)[*pos]);
+        if (next == std::end(branch.children)) return;
+
+        ++*pos; // advance
+        next->second->accept(*this);
+      }
+    };
+
+    std::size_t pos = 0;
+    root_.accept(longest_prefix_visitor{key, pos, length, ret});
+
+    return ret;
+  }
+
+  // the number of words at and under 'node', leaves hold one and branches keep theirs
+  // in the count_augment summary
+  static std::size_t count_of_(const node_concept_t& node) {
+    std::size_t ret;
+
+    struct count_visitor : node_concept_t::visitor_t {
+      std::size_t* result;
+
+      explicit count_visitor(std::size_t& result) : result(&result) { }
+
+      void operator()(const branch_node_t& branch) const { *result = branch.summary().count; }
+      void operator()(const branch_value_node_t& vbranch) const { *result = vbranch.summary().count; }
+      void operator()(const leaf_node_t&) const { *result = 1; }
+    };
+
+    node.accept(count_visitor{ret});
+
+    return ret;
+  }
+
+  const node_concept_t* lookup_node_prefix_(std::string::const_iterator first, std::string::const_iterator last, std::string::const_iterator& prefix_end) const {
+    if (first == last) return nullptr;
+
+    const node_concept_t* ret;
+
+    struct lookup_prefix_visitor : node_concept_t::visitor_t {
+      std::string::const_iterator* first;
+      std::string::const_iterator* last;
+      const node_concept_t**       result;
+
+      lookup_prefix_visitor(std::string::const_iterator& first, std::string::const_iterator& last, const node_concept_t*& result) :
+        first(&first), last(&last), result(&result) {
+        *this->result = nullptr;
+      }
+
+      void operator()(const branch_node_t& branch) const {
+        if (*first == *last) {
+          // best match
+          *result = &branch;
+          return;
+        }
+
+        auto next = branch.children.find(**first);
+        if (next == std::end(branch.children)) {
+          // not found
+          return;
+        }
+
+        ++*first; // advance
+        next->second->accept(*this);
+      }
+      void operator()(const branch_value_node_t& vbranch) const {
+        if (*first == *last) {
+          *result = &vbranch;
+          return;
+        }
+
+        auto next = vbranch.children.find(**first);
+        if (next == std::end(vbranch.children)) {
+          // not found
+          return;
+        }
+
+        ++*first; // advance
+        next->second->accept(*this);
+      }
+      void operator()(const leaf_node_t& leaf) const {
+        // compare the remaining string to the leaf value
+        auto lfirst = std::begin(leaf.data);
+        auto llast = std::end(leaf.data);
+
+        // compare to the end of this prefix
+        if (simd::mismatch(*first, *last, lfirst, llast).first == *last) {
+          *result = &leaf;
+        }
+      }
+    } visitor{first, last, ret};
+
+    root_.accept(visitor);
+
+    prefix_end = first;
+
+    return ret;
+  }
+};
+
+namespace detail {
+
+// a node of a frozen_trie, every node is some edge data followed by an optional value and children
+struct frozen_node_t {
+  static constexpr std::uint32_t npos = static_cast<std::uint32_t>(-1);
+
+  std::uint32_t data_first  = 0;    // compressed edge data (what a leaf_node_t would hold)
+  std::uint32_t data_size   = 0;
+  std::uint32_t child_first = 0;    // children are contiguous in breadth first order
+  std::uint32_t child_count = 0;
+  std::uint32_t value       = npos; // index into the values
+};
+
+// queries over the flat arrays of a frozen trie, wherever those arrays happen to live
+template <typename T>
+struct frozen_view_t {
+  typedef frozen_node_t node_t;
+
+  const node_t* nodes       = nullptr; // nodes[0] is the root
+  const char*   edges       = nullptr; // edges[i] is the char leading into nodes[i]
+  const char*   data        = nullptr;
+  const T*      values      = nullptr;
+  std::size_t   node_count  = 0;
+  std::size_t   value_count = 0;
+
+  const T* lookup(std::string::const_iterator first, std::string::const_iterator last) const {
+    if (first == last) return nullptr;
+
+    auto node = nodes;
+    for (;;) {
+      // compare the remaining string to the edge data
+      auto node_data = data + node->data_first;
+      auto remaining = static_cast<std::size_t>(last - first);
+      if (remaining < node->data_size ||
+          !simd::equal(node_data, node_data + node->data_size, first, first + node->data_size)) {
+        return nullptr;
+      }
+
+      first += node->data_size;
+      if (first == last) {
+        return node->value != node_t::npos ? &values[node->value] : nullptr;
+      }
+
+      node = find_child(*node, *first);
+      if (!node) return nullptr;
+
+      ++first; // advance
+    }
+  }
+
+  // the value of the longest word that [first, last) starts with, its length goes in 'length'
+  const T* longest_prefix(std::string::const_iterator first, std::string::const_iterator last, std::size_t& length) const {
+    const T* ret   = nullptr;
+    auto     start = first;
+
+    auto node = nodes;
+    for (;;) {
+      // the whole edge has to be there for the word at the end of it to be a prefix
+      auto node_data = data + node->data_first;
+      auto remaining = static_cast<std::size_t>(last - first);
+      if (remaining < node->data_size ||
+          !simd::equal(node_data, node_data + node->data_size, first, first + node->data_size)) {
+        return ret;
+      }
+
+      first += node->data_size;
+      if (node->value != node_t::npos) {
+        ret    = &values[node->value];
+        length = static_cast<std::size_t>(first - start);
+      }
+      if (first == last) return ret;
+
+      node = find_child(*node, *first);
+      if (!node) return ret;
+
+      ++first; // advance
+    }
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    auto first = std::begin(prefix);
+    auto last  = std::end(prefix);
+
+    auto node = nodes;
+    for (;;) {
+      // the prefix may end anywhere within the edge data of this node
+      auto node_data = data + node->data_first;
+      auto remaining = static_cast<std::size_t>(last - first);
+      auto shared    = std::min<std::size_t>(remaining, node->data_size);
+      if (!simd::equal(first, first + shared, node_data, node_data + shared)) return false;
+
+      if (shared == remaining) {
+        matching_word.assign(std::begin(prefix), first);
+        break;
+      }
+
+      first += shared;
+      node = find_child(*node, *first);
+      if (!node) return false;
+
+      ++first; // advance
+    }
+
+    // find the first word we can match (alphabetical order)
+    for (;;) {
+      matching_word.append(data + node->data_first, node->data_size);
+      if (node->value != node_t::npos) return true;
+
+      assert(node->child_count && "prog error");
+      matching_word.push_back(edges[node->child_first]);
+      node = &nodes[node->child_first];
+    }
+  }
+
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    ret.reserve(value_count);
+    get_words_impl(ret, working_prefix, nodes[0]);
+
+    return ret;
+  }
+
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_t*               node  = nullptr; // null once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  batch_state_t batch_start(const std::string& word) const {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.node = nodes;
+    return state;
+  }
+
+  bool batch_step(batch_state_t& state) const {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    // compare the remaining string to the edge data
+    auto node_data = data + node->data_first;
+    auto remaining = static_cast<std::size_t>(state.last - state.first);
+    if (remaining < node->data_size ||
+        !simd::equal(node_data, node_data + node->data_size, state.first, state.first + node->data_size)) {
+      return false;
+    }
+
+    state.first += node->data_size;
+    if (state.first == state.last) {
+      if (node->value != node_t::npos) state.value = &values[node->value];
+      return false;
+    }
+
+    state.node = find_child(*node, *state.first);
+    if (!state.node) return false;
+
+    ++state.first; // advance
+    util::prefetch(state.node);
+    return true;
+  }
+
+  template <typename ForwardIt, typename OutputIt, typename Finish>
+  OutputIt lookup_batch(ForwardIt first, ForwardIt last, OutputIt out, Finish finish) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start(word); },
+      [this](batch_state_t& state) { return batch_step(state); },
+      finish);
+  }
+
+  // batch_step for longest_prefix, state.value is the last word passed rather than the one
+  // at the end
+  bool longest_prefix_step(batch_state_t& state) const {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    auto node_data = data + node->data_first;
+    auto remaining = static_cast<std::size_t>(state.last - state.first);
+    if (remaining < node->data_size ||
+        !simd::equal(node_data, node_data + node->data_size, state.first, state.first + node->data_size)) {
+      return false;
+    }
+
+    state.first += node->data_size;
+    if (node->value != node_t::npos) state.value = &values[node->value];
+    if (state.first == state.last) return false;
+
+    state.node = find_child(*node, *state.first);
+    if (!state.node) return false;
+
+    ++state.first; // advance
+    util::prefetch(state.node);
+    return true;
+  }
+
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt longest_prefix_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& key) { return batch_start(key); },
+      [this](batch_state_t& state) { return longest_prefix_step(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  const node_t* find_child(const node_t& node, char c) const {
+    auto first = edges + node.child_first;
+    auto last  = first + node.child_count;
+
+    // edges are sorted in the same order as the std::map the trie was built from
+    auto found = std::lower_bound(first, last, c);
+    if (found == last || *found != c) return nullptr;
+
+    return &nodes[found - edges];
+  }
+
+  void get_words_impl(std::vector<std::string>& words, std::string& working_prefix, const node_t& node) const {
+    auto old_size = working_prefix.size();
+    working_prefix.append(data + node.data_first, node.data_size);
+
+    if (node.value != node_t::npos) words.push_back(working_prefix);
+
+    // visit children
+    for (auto i = node.child_first; i != node.child_first + node.child_count; ++i) {
+      working_prefix.push_back(edges[i]);
+      get_words_impl(words, working_prefix, nodes[i]);
+      working_prefix.pop_back();
+    }
+
+    working_prefix.resize(old_size);
+  }
+};
+
+// on disk layout of a frozen trie, the sections follow the header at the given
+// offsets and everything is in the byte order of the machine that wrote it
+struct frozen_header_t {
+  static constexpr std::uint32_t current_version = 1;
+
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t value_size;
+  std::uint64_t node_count;
+  std::uint64_t data_size;
+  std::uint64_t value_count;
+  std::uint64_t nodes_offset;
+  std::uint64_t edges_offset;
+  std::uint64_t data_offset;
+  std::uint64_t values_offset;
+};
+
+constexpr char frozen_magic[8] = { 'T', 'R', 'I', 'E', 'F', 'R', 'Z', '\0' };
+
+} // namespace detail
+
+// read only impl3 trie with every node, edge label and value stored in a flat array
+template <typename T>
+class frozen_trie {
+  template <typename, typename, typename>
+  friend class trie;
+
+  typedef detail::frozen_node_t node_t;
+
+  std::vector<node_t> nodes_{node_t{}}; // nodes_[0] is the root
+  std::vector<char>   edges_{'\0'};     // edges_[i] is the char leading into nodes_[i]
+  std::string         data_;
+  std::vector<T>      values_;
+public:
+  frozen_trie()  = default;
+  ~frozen_trie() = default;
+
+  bool exists(const std::string& word) const {
+    return view_().lookup(std::begin(word), std::end(word)) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto found = view_().lookup(std::begin(word), std::end(word));
+
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch but the next
+  // flat node of each lookup is prefetched out of the node array, not a child pointer
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    typedef typename detail::frozen_view_t<T>::batch_state_t state_t;
+    return view_().lookup_batch(first, last, out, [](const state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good as long as the frozen trie is
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    typedef typename detail::frozen_view_t<T>::batch_state_t state_t;
+    return view_().lookup_batch(first, last, out, [](const state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    return view_().prefix_match(prefix, matching_word);
+  }
+
+  // the longest word 'key' starts with
+  bool longest_prefix_of(const std::string& key, std::string& matching_word) const {
+    std::size_t length = 0;
+    if (!view_().longest_prefix(std::begin(key), std::end(key), length)) return false;
+
+    matching_word.assign(key, 0, length);
+    return true;
+  }
+
+  bool longest_prefix_of(const std::string& key, std::string& matching_word, T& value) const {
+    std::size_t length = 0;
+    auto        found  = view_().longest_prefix(std::begin(key), std::end(key), length);
+    if (!found) return false;
+
+    matching_word.assign(key, 0, length);
+    value = *found;
+    return true;
+  }
+
+  // like value_at_batch but writes a pointer to the value of the longest word each key
+  // starts with, or nullptr if there isn't one
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt longest_prefix_of_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return view_().longest_prefix_batch(first, last, out);
+  }
+
+  std::vector<std::string> get_words() const {
+    return view_().get_words();
+  }
+
+  std::size_t size() const { return values_.size(); }
+  std::size_t node_count() const { return nodes_.size(); }
+
+  // writes the versioned binary image that mapped_trie can query in place
+  bool write(std::ostream& out) const {
+    static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be written");
+
+    auto align_up = [](std::uint64_t offset) { return (offset + 7) & ~std::uint64_t{7}; };
+
+    detail::frozen_header_t header;
+    std::copy(std::begin(detail::frozen_magic), std::end(detail::frozen_magic), header.magic);
+    header.version       = detail::frozen_header_t::current_version;
+    header.value_size    = sizeof(T);
+    header.node_count    = nodes_.size();
+    header.data_size     = data_.size();
+    header.value_count   = values_.size();
+    header.nodes_offset  = align_up(sizeof(header));
+    header.edges_offset  = header.nodes_offset + nodes_.size() * sizeof(node_t);
+    header.data_offset   = header.edges_offset + edges_.size();
+    header.values_offset = align_up(header.data_offset + data_.size());
+
+    std::uint64_t written = 0;
+    auto write_at = [&out, &written](std::uint64_t offset, const void* bytes, std::size_t size) {
+      static const char padding[8] = { };
+      out.write(padding, static_cast<std::streamsize>(offset - written));
+      out.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+      written = offset + size;
+    };
+
+    write_at(0, &header, sizeof(header));
+    write_at(header.nodes_offset, nodes_.data(), nodes_.size() * sizeof(node_t));
+    write_at(header.edges_offset, edges_.data(), edges_.size());
+    write_at(header.data_offset, data_.data(), data_.size());
+    write_at(header.values_offset, values_.data(), values_.size() * sizeof(T));
+
+    return static_cast<bool>(out);
+  }
+
+private:
+  detail::frozen_view_t<T> view_() const {
+    detail::frozen_view_t<T> view;
+    view.nodes       = nodes_.data();
+    view.edges       = edges_.data();
+    view.data        = data_.data();
+    view.values      = values_.data();
+    view.node_count  = nodes_.size();
+    view.value_count = values_.size();
+    return view;
+  }
+};
+
+// queries a frozen_trie image (see frozen_trie::write) in place, either straight
+// out of a memory mapped file or out of a buffer the caller keeps alive
+template <typename T>
+class mapped_trie {
+  static_assert(std::is_trivially_copyable<T>::value, "only trivially copyable values can be mapped");
+
+  detail::frozen_view_t<T> view_;
+  const void*              mapping_      = nullptr; // only set when we own a file mapping
+  std::size_t              mapping_size_ = 0;
+public:
+  mapped_trie() = default;
+  mapped_trie(const mapped_trie&) = delete;
+  mapped_trie& operator=(const mapped_trie&) = delete;
+  mapped_trie(mapped_trie&& other) noexcept :
+    view_{other.view_}, mapping_{other.mapping_}, mapping_size_{other.mapping_size_} {
+    other.view_         = { };
+    other.mapping_      = nullptr;
+    other.mapping_size_ = 0;
+  }
+  mapped_trie& operator=(mapped_trie&& other) noexcept {
+    if (this != &other) {
+      close();
+      view_               = other.view_;
+      mapping_            = other.mapping_;
+      mapping_size_       = other.mapping_size_;
+      other.view_         = { };
+      other.mapping_      = nullptr;
+      other.mapping_size_ = 0;
+    }
+    return *this;
+  }
+  ~mapped_trie() { close(); }
+
+  // maps the file read only, the pages are shared with every other process mapping it
+  bool open(const std::string& path) {
+    close();
+
+#if defined(_WIN32)
+    auto file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      ::CloseHandle(file);
+      return false;
+    }
+
+    auto mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (!mapping) return false;
+
+    auto bytes = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping);
+    if (!bytes) return false;
+
+    auto mapped_size = static_cast<std::size_t>(size.QuadPart);
+#else
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+
+    auto mapped_size = static_cast<std::size_t>(st.st_size);
+    auto bytes       = ::mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (bytes == MAP_FAILED) return false;
+#endif
+
+    mapping_      = bytes;
+    mapping_size_ = mapped_size;
+    if (!attach(bytes, mapped_size)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // uses an image which is already in memory, nothing is copied.  Every node is checked
+  // against the sections before any query can follow it, a failed attach leaves nothing open
+  bool attach(const void* bytes, std::size_t size) {
+    typedef detail::frozen_node_t node_t;
+
+    view_ = { };
+
+    detail::frozen_header_t header;
+    if (size < sizeof(header)) return false;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (!std::equal(std::begin(detail::frozen_magic), std::end(detail::frozen_magic), header.magic) ||
+        header.version != detail::frozen_header_t::current_version ||
+        header.value_size != sizeof(T) ||
+        header.node_count == 0) {
+      return false;
+    }
+
+    // the sections have to fit in the image and line up for their types.  Written so no
+    // offset or count out of a bad header can wrap around
+    auto fits = [size](std::uint64_t offset, std::uint64_t count, std::size_t elem_size) {
+      return offset <= size && count <= (size - offset) / elem_size;
+    };
+    auto base    = static_cast<const char*>(bytes);
+    auto aligned = [base](std::uint64_t offset, std::size_t align) {
+      return reinterpret_cast<std::uintptr_t>(base + offset) % align == 0;
+    };
+    if (!fits(header.nodes_offset, header.node_count, sizeof(node_t)) ||
+        !fits(header.edges_offset, header.node_count, 1) ||
+        !fits(header.data_offset, header.data_size, 1) ||
+        !fits(header.values_offset, header.value_count, sizeof(T)) ||
+        !aligned(header.nodes_offset, alignof(node_t)) ||
+        !aligned(header.values_offset, alignof(T))) {
+      return false;
+    }
+
+    auto nodes = reinterpret_cast<const node_t*>(base + header.nodes_offset);
+
+    // the root holds no edge data and every other node ends a word or leads to one.
+    // Children come after their parent, so no walk can go around in circles
+    if (nodes[0].data_size != 0) return false;
+    for (std::uint64_t i = 0; i != header.node_count; ++i) {
+      auto& node = nodes[i];
+      if (node.data_first > header.data_size || node.data_size > header.data_size - node.data_first) return false;
+      if (node.value != node_t::npos && node.value >= header.value_count) return false;
+      if (node.child_count != 0 &&
+          (node.child_first <= i || node.child_first > header.node_count ||
+           node.child_count > header.node_count - node.child_first)) {
+        return false;
+      }
+      if (i != 0 && node.child_count == 0 && node.value == node_t::npos) return false;
+    }
+
+    view_.nodes       = nodes;
+    view_.edges       = base + header.edges_offset;
+    view_.data        = base + header.data_offset;
+    view_.values      = reinterpret_cast<const T*>(base + header.values_offset);
+    view_.node_count  = static_cast<std::size_t>(header.node_count);
+    view_.value_count = static_cast<std::size_t>(header.value_count);
+    return true;
+  }
+
+  void close() {
+    if (mapping_) {
+#if defined(_WIN32)
+      ::UnmapViewOfFile(mapping_);
+#else
+      ::munmap(const_cast<void*>(mapping_), mapping_size_);
+#endif
+    }
+    view_         = { };
+    mapping_      = nullptr;
+    mapping_size_ = 0;
+  }
+
+  bool is_open() const { return view_.nodes != nullptr; }
+
+  bool exists(const std::string& word) const {
+    return is_open() && view_.lookup(std::begin(word), std::end(word)) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto found = is_open() ? view_.lookup(std::begin(word), std::end(word)) : nullptr;
+
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like frozen_trie::exists_batch with the flat
+  // nodes prefetched straight out of the image
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    typedef typename detail::frozen_view_t<T>::batch_state_t state_t;
+    return view_.lookup_batch(first, last, out, [](const state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good until the trie is closed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    typedef typename detail::frozen_view_t<T>::batch_state_t state_t;
+    return view_.lookup_batch(first, last, out, [](const state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    return is_open() && view_.prefix_match(prefix, matching_word);
+  }
+
+  // the longest word 'key' starts with
+  bool longest_prefix_of(const std::string& key, std::string& matching_word) const {
+    std::size_t length = 0;
+    if (!is_open() || !view_.longest_prefix(std::begin(key), std::end(key), length)) return false;
+
+    matching_word.assign(key, 0, length);
+    return true;
+  }
+
+  bool longest_prefix_of(const std::string& key, std::string& matching_word, T& value) const {
+    if (!is_open()) return false;
+
+    std::size_t length = 0;
+    auto        found  = view_.longest_prefix(std::begin(key), std::end(key), length);
+    if (!found) return false;
+
+    matching_word.assign(key, 0, length);
+    value = *found;
+    return true;
+  }
+
+  // like value_at_batch but writes a pointer to the value of the longest word each key
+  // starts with, or nullptr if there isn't one.  The pointers are good until the trie is closed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt longest_prefix_of_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return view_.longest_prefix_batch(first, last, out);
+  }
+
+  std::vector<std::string> get_words() const {
+    return is_open() ? view_.get_words() : std::vector<std::string>{};
+  }
+
+  std::size_t size() const { return view_.value_count; }
+  std::size_t node_count() const { return view_.node_count; }
+};
+
+namespace detail {
+
+// epoch based reclamation for concurrent_trie.  A reader announces the epoch it saw on the
+// way in and clears it on the way out.  The writer only moves the epoch on once every reader
+// inside announced the current one, so anything unlinked two epochs ago can't be reached
+// by anyone any more
+class epoch_domain_t {
+  static constexpr std::size_t slot_count = 64;
+
+  // (epoch << 1) | 1 while a reader is inside, 0 when free.  One per cache line so readers
+  // on different slots never share one
+  struct alignas(64) slot_t {
+    std::atomic<std::uint64_t> state{0};
+  };
+
+  slot_t                     slots_[slot_count];
+  std::atomic<std::uint64_t> epoch_{0};
+public:
+  // claims a free slot for the calling thread, readers past slot_count wait their turn.
+  // Every full pass that finds nothing free gives the core away, so the readers holding
+  // the slots get to run and leave instead of racing the waiters for the cpu
+  std::size_t enter() {
+    static thread_local std::size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+
+    for (auto i = hint;; ++i) {
+      auto&         slot = slots_[i % slot_count];
+      std::uint64_t idle = 0;
+      if (slot.state.load(std::memory_order_relaxed) != 0 ||
+          !slot.state.compare_exchange_strong(idle, (epoch_.load(std::memory_order_relaxed) << 1) | 1,
+                                              std::memory_order_relaxed)) {
+        if ((i + 1 - hint) % slot_count == 0) std::this_thread::yield();
+        continue;
+      }
+
+      // pairs with the fence in try_advance: either the writer sees this slot or this
+      // reader sees everything the writer unlinked before it last moved the epoch
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      hint = i;
+      return i % slot_count;
+    }
+  }
+
+  void leave(std::size_t slot) {
+    slots_[slot].state.store(0, std::memory_order_release);
+  }
+
+  // only the writer moves the epoch
+  std::uint64_t epoch() const { return epoch_.load(std::memory_order_relaxed); }
+
+  // moves to the next epoch unless a reader is still inside an older one
+  bool try_advance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto epoch = epoch_.load(std::memory_order_relaxed);
+    for (auto& slot : slots_) {
+      auto state = slot.state.load(std::memory_order_acquire);
+      if ((state & 1) != 0 && (state >> 1) != epoch) return false;
+    }
+
+    epoch_.store(epoch + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+// holds a slot of the domain for as long as it lives
+class epoch_guard_t {
+  epoch_domain_t& domain_;
+  std::size_t     slot_;
+public:
+  explicit epoch_guard_t(epoch_domain_t& domain) : domain_(domain), slot_{domain.enter()} { }
+  ~epoch_guard_t() { domain_.leave(slot_); }
+
+  epoch_guard_t(const epoch_guard_t&) = delete;
+  epoch_guard_t& operator=(const epoch_guard_t&) = delete;
+};
+
+enum class rcu_kind : unsigned char {
+  leaf,
+  branch
+};
+
+// nodes of a concurrent_trie never change once a reader can reach them, apart from the
+// child pointers of a branch
+template <typename T>
+struct rcu_node_t {
+  rcu_kind kind;
+
+  explicit rcu_node_t(rcu_kind kind) : kind{kind} { }
+};
+
+template <typename T>
+struct rcu_leaf_t : rcu_node_t<T> {
+  std::string data;
+  T           value;
+
+  rcu_leaf_t(std::string data, T value) :
+    rcu_node_t<T>{rcu_kind::leaf}, data{std::move(data)}, value{std::move(value)} { }
+};
+
+template <typename T>
+struct rcu_branch_t : rcu_node_t<T> {
+  typedef std::atomic<rcu_node_t<T>*> child_t;
+
+  std::unique_ptr<T>         value;    // set when a word ends here
+  std::string                keys;     // sorted like std::map<char, ...> sorts them
+  std::unique_ptr<child_t[]> children; // children[i] hangs off keys[i]
+
+  explicit rcu_branch_t(std::string keys) :
+    rcu_node_t<T>{rcu_kind::branch}, keys{std::move(keys)}, children{new child_t[this->keys.size()]} { }
+
+  child_t* find(char c) const {
+    auto found = std::lower_bound(std::begin(keys), std::end(keys), c);
+    if (found == std::end(keys) || *found != c) return nullptr;
+
+    return &children[static_cast<std::size_t>(found - std::begin(keys))];
+  }
+};
+
+// frees just this node, its children may live on in a newer copy of it
+template <typename T>
+void delete_rcu_node(rcu_node_t<T>* node) {
+  switch (node->kind) {
+  case rcu_kind::leaf:   delete static_cast<rcu_leaf_t<T>*>(node);   break;
+  case rcu_kind::branch: delete static_cast<rcu_branch_t<T>*>(node); break;
+  }
+}
+
+} // namespace detail
+
+// impl3's shape for many readers and one writer at a time.  Readers take no locks: they
+// walk the nodes with acquire loads inside an epoch guard.  A writer never changes a node
+// in place, it builds the replacement (a copy of a branch with the new child, or the
+// branches breakup_leaf would make) and publishes it with a release store into the one
+// child pointer leading to it.  The node it replaced is retired and freed once the epoch
+// shows no reader can still be looking at it
+template <typename T>
+class concurrent_trie {
+  typedef detail::rcu_node_t<T>   node_t;
+  typedef detail::rcu_leaf_t<T>   leaf_t;
+  typedef detail::rcu_branch_t<T> branch_t;
+  typedef std::atomic<node_t*>    child_t;
+
+  child_t                        root_;      // always a branch
+  mutable detail::epoch_domain_t domain_;
+  std::mutex                     writer_;
+  std::vector<node_t*>           retired_[3]; // by epoch % 3
+  std::atomic<std::size_t>       size_{0};
+public:
+  concurrent_trie() : root_{new branch_t{std::string{}}} { }
+
+  ~concurrent_trie() {
+    delete_tree_(root_.load(std::memory_order_relaxed));
+    for (auto& retired : retired_) {
+      free_(retired);
+    }
+  }
+
+  concurrent_trie(const concurrent_trie&) = delete;
+  concurrent_trie& operator=(const concurrent_trie&) = delete;
+
+  // writers go one at a time, readers see the word as soon as this returns.  Like impl3 the
+  // first value of a word stays
+  void insert(const std::string& word, T value) {
+    if (word.empty()) return;
+
+    std::lock_guard<std::mutex> lock{writer_};
+
+    auto        slot = &root_;
+    std::size_t pos  = 0;
+    for (;;) {
+      // only the writer stores, nothing to synchronize with
+      auto node = slot->load(std::memory_order_relaxed);
+
+      if (node->kind == detail::rcu_kind::leaf) {
+        auto replacement = split_(*static_cast<leaf_t*>(node), word, pos, value);
+        if (!replacement) return;
+
+        publish_(*slot, replacement, node);
+        break;
+      }
+
+      auto& branch = *static_cast<branch_t*>(node);
+      if (pos == word.size()) {
+        if (branch.value) return;
+
+        auto copy = copy_(branch, branch.keys);
+        copy->value.reset(new T(std::move(value)));
+        publish_(*slot, copy, node);
+        break;
+      }
+
+      auto next = branch.find(word[pos]);
+      if (!next) {
+        // a copy of the branch with the new leaf among its children
+        auto keys = branch.keys;
+        keys.insert(std::lower_bound(std::begin(keys), std::end(keys), word[pos]), word[pos]);
+
+        auto copy = copy_(branch, keys);
+        copy->find(word[pos])->store(new leaf_t{word.substr(pos + 1), std::move(value)}, std::memory_order_relaxed);
+        publish_(*slot, copy, node);
+        break;
+      }
+
+      slot = next;
+      ++pos;
+    }
+
+    size_.fetch_add(1, std::memory_order_relaxed);
+    collect_();
+  }
+
+  bool exists(const std::string& word) const {
+    detail::epoch_guard_t guard{domain_};
+    return lookup_(word) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    detail::epoch_guard_t guard{domain_};
+
+    auto found = lookup_(word);
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists, interleaved like impl3::trie::exists_batch with the whole batch in one
+  // epoch guard.  There is no value_at_batch, a pointer to a value could outlive the guard
+  // and the node it points into
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    detail::epoch_guard_t guard{domain_};
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    detail::epoch_guard_t guard{domain_};
+
+    auto        node = root_.load(std::memory_order_acquire);
+    std::size_t pos  = 0;
+    for (; pos != prefix.size(); ++pos) {
+      if (node->kind == detail::rcu_kind::leaf) break;
+
+      auto next = static_cast<const branch_t*>(node)->find(prefix[pos]);
+      if (!next) return false;
+      node = next->load(std::memory_order_acquire);
+    }
+
+    std::string match = prefix;
+    if (node->kind == detail::rcu_kind::leaf) {
+      // the rest of the prefix has to be the start of the leaf
+      auto& data = static_cast<const leaf_t*>(node)->data;
+      if (simd::mismatch(std::begin(prefix) + static_cast<std::ptrdiff_t>(pos), std::end(prefix),
+                         std::begin(data), std::end(data)).first != std::end(prefix)) {
+        return false;
+      }
+      match.append(data, prefix.size() - pos, std::string::npos);
+    }
+    else {
+      // the first word below, always the smallest key
+      while (node->kind == detail::rcu_kind::branch && !static_cast<const branch_t*>(node)->value) {
+        auto branch = static_cast<const branch_t*>(node);
+        match.push_back(branch->keys.front());
+        node = branch->children[0].load(std::memory_order_acquire);
+      }
+      if (node->kind == detail::rcu_kind::leaf) match += static_cast<const leaf_t*>(node)->data;
+    }
+
+    matching_word = std::move(match);
+    return true;
+  }
+
+  // a snapshot, words going in meanwhile may or may not be part of it
+  std::vector<std::string> get_words() const {
+    detail::epoch_guard_t guard{domain_};
+
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, root_.load(std::memory_order_acquire));
+
+    return ret;
+  }
+
+  std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+  // a single lookup of exists_batch
+  struct batch_state_t {
+    const node_t*      node  = nullptr; // null once the lookup is done
+    const std::string* word  = nullptr;
+    std::size_t        pos   = 0;
+    const T*           value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.word = &word;
+    state.node = root_.load(std::memory_order_acquire);
+    return state;
+  }
+
+  // one node of lookup_
+  static bool batch_step_(batch_state_t& state) {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    auto& word = *state.word;
+    if (node->kind == detail::rcu_kind::leaf) {
+      auto leaf = static_cast<const leaf_t*>(node);
+      auto rest = std::begin(word) + static_cast<std::ptrdiff_t>(state.pos);
+      if (simd::equal(std::begin(leaf->data), std::end(leaf->data), rest, std::end(word))) state.value = &leaf->value;
+      return false;
+    }
+
+    auto branch = static_cast<const branch_t*>(node);
+    if (state.pos == word.size()) {
+      state.value = branch->value.get();
+      return false;
+    }
+
+    auto next = branch->find(word[state.pos++]);
+    if (!next) return false;
+
+    state.node = next->load(std::memory_order_acquire);
+    util::prefetch(state.node);
+    return true;
+  }
+
+  const T* lookup_(const std::string& word) const {
+    auto        node = root_.load(std::memory_order_acquire);
+    std::size_t pos  = 0;
+    for (;;) {
+      if (node->kind == detail::rcu_kind::leaf) {
+        auto leaf = static_cast<const leaf_t*>(node);
+        auto rest = std::begin(word) + static_cast<std::ptrdiff_t>(pos);
+        return simd::equal(std::begin(leaf->data), std::end(leaf->data), rest, std::end(word)) ? &leaf->value : nullptr;
+      }
+
+      auto branch = static_cast<const branch_t*>(node);
+      if (pos == word.size()) return branch->value.get();
+
+      auto next = branch->find(word[pos++]);
+      if (!next) return nullptr;
+      node = next->load(std::memory_order_acquire);
+    }
+  }
+
+  // a new branch sharing the children of 'branch', 'keys' holds every key of branch
+  // and maybe one more which is left without a child
+  static branch_t* copy_(const branch_t& branch, const std::string& keys) {
+    auto copy = new branch_t{keys};
+    if (branch.value) copy->value.reset(new T(*branch.value));
+
+    for (std::size_t i = 0; i != branch.keys.size(); ++i) {
+      copy->find(branch.keys[i])->store(branch.children[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    return copy;
+  }
+
+  // what breakup_leaf does, but into new nodes, the leaf stays as it is for the readers
+  // still on it.  nullptr if the word is the leaf's
+  static node_t* split_(const leaf_t& leaf, const std::string& word, std::size_t pos, T& value) {
+    auto& data   = leaf.data;
+    auto  rest   = std::begin(word) + static_cast<std::ptrdiff_t>(pos);
+    auto  common = static_cast<std::size_t>(simd::mismatch(std::begin(data), std::end(data), rest, std::end(word)).first -
+                                            std::begin(data));
+    auto  word_common = pos + common;
+    if (common == data.size() && word_common == word.size()) return nullptr;
+
+    // the branch where the two part ways
+    branch_t* split;
+    if (common == data.size()) {
+      split = new branch_t{std::string(1, word[word_common])};
+      split->value.reset(new T(leaf.value));
+      split->children[0].store(new leaf_t{word.substr(word_common + 1), std::move(value)}, std::memory_order_relaxed);
+    }
+    else if (word_common == word.size()) {
+      split = new branch_t{std::string(1, data[common])};
+      split->value.reset(new T(std::move(value)));
+      split->children[0].store(new leaf_t{data.substr(common + 1), leaf.value}, std::memory_order_relaxed);
+    }
+    else {
+      split = new branch_t{data[common] < word[word_common] ? std::string{data[common], word[word_common]}
+                                                            : std::string{word[word_common], data[common]}};
+      split->find(data[common])->store(new leaf_t{data.substr(common + 1), leaf.value}, std::memory_order_relaxed);
+      split->find(word[word_common])->store(new leaf_t{word.substr(word_common + 1), std::move(value)},
+                                            std::memory_order_relaxed);
+    }
+
+    // and the single child branches down to it
+    node_t* ret = split;
+    for (auto i = common; i-- != 0;) {
+      auto branch = new branch_t{std::string(1, data[i])};
+      branch->children[0].store(ret, std::memory_order_relaxed);
+      ret = branch;
+    }
+    return ret;
+  }
+
+  // readers see either the old node or all of the new one
+  void publish_(child_t& slot, node_t* replacement, node_t* old) {
+    slot.store(replacement, std::memory_order_release);
+    retired_[domain_.epoch() % 3].push_back(old);
+  }
+
+  // whatever was retired two epochs ago is out of every reader's reach
+  void collect_() {
+    if (domain_.try_advance()) free_(retired_[(domain_.epoch() + 1) % 3]);
+  }
+
+  static void free_(std::vector<node_t*>& retired) {
+    for (auto node : retired) {
+      detail::delete_rcu_node(node);
+    }
+    retired.clear();
+  }
+
+  static void delete_tree_(node_t* node) {
+    if (node->kind == detail::rcu_kind::branch) {
+      auto branch = static_cast<branch_t*>(node);
+      for (std::size_t i = 0; i != branch->keys.size(); ++i) {
+        delete_tree_(branch->children[i].load(std::memory_order_relaxed));
+      }
+    }
+    detail::delete_rcu_node(node);
+  }
+
+  static void get_words_impl_(std::vector<std::string>& words, std::string& prefix, const node_t* node) {
+    if (node->kind == detail::rcu_kind::leaf) {
+      words.push_back(prefix + static_cast<const leaf_t*>(node)->data);
+      return;
+    }
+
+    auto branch = static_cast<const branch_t*>(node);
+    if (branch->value) words.push_back(prefix);
+    for (std::size_t i = 0; i != branch->keys.size(); ++i) {
+      prefix.push_back(branch->keys[i]);
+      get_words_impl_(words, prefix, branch->children[i].load(std::memory_order_acquire));
+      prefix.pop_back();
+    }
+  }
+};
+
+namespace detail {
+
+enum class persistent_kind : unsigned char {
+  leaf,
+  branch
+};
+
+// nodes of a persistent_trie are never changed once made, every version holding on to one
+// keeps it alive
+template <typename T>
+struct persistent_node_t {
+  persistent_kind kind;
+
+  explicit persistent_node_t(persistent_kind kind) : kind{kind} { }
+};
+
+template <typename T>
+using persistent_ptr = std::shared_ptr<const persistent_node_t<T>>;
+
+template <typename T>
+struct persistent_leaf_t : persistent_node_t<T> {
+  std::string data;
+  T           value;
+
+  persistent_leaf_t(std::string data, T value) :
+    persistent_node_t<T>{persistent_kind::leaf}, data{std::move(data)}, value{std::move(value)} { }
+};
+
+template <typename T>
+struct persistent_branch_t : persistent_node_t<T> {
+  std::shared_ptr<const T>       value;    // set when a word ends here, shared by the copies
+  std::string                    keys;     // sorted like std::map<char, ...> sorts them
+  std::vector<persistent_ptr<T>> children; // children[i] hangs off keys[i]
+
+  persistent_branch_t() : persistent_node_t<T>{persistent_kind::branch} { }
+
+  // where 'c' is or would go in keys
+  std::size_t index_of(char c) const {
+    return static_cast<std::size_t>(std::lower_bound(std::begin(keys), std::end(keys), c) - std::begin(keys));
+  }
+
+  const persistent_node_t<T>* find(char c) const {
+    auto i = index_of(c);
+    return i != keys.size() && keys[i] == c ? children[i].get() : nullptr;
+  }
+};
+
+} // namespace detail
+
+// impl3's shape made out of immutable, reference counted nodes.  insert() and erase()
+// leave the trie alone and return a new version which copies only the branches on the
+// path to the word and shares every other node with this one, so copying a version (a
+// snapshot) is O(1) and going back to an old version is just keeping it around.
+// Versions can be read and built upon from any number of threads
+template <typename T>
+class persistent_trie {
+  typedef detail::persistent_node_t<T>   node_t;
+  typedef detail::persistent_leaf_t<T>   leaf_t;
+  typedef detail::persistent_branch_t<T> branch_t;
+  typedef detail::persistent_ptr<T>      node_ptr;
+
+  node_ptr    root_; // always a branch
+  std::size_t size_ = 0;
+public:
+  persistent_trie() : root_{std::make_shared<const branch_t>()} { }
+
+  // like impl3 the first value of a word stays, the same version comes back then
+  persistent_trie insert(const std::string& word, T value) const {
+    if (word.empty()) return *this;
+
+    auto root = insert_(*root_, word, 0, value);
+    if (!root) return *this;
+
+    return persistent_trie{std::move(root), size_ + 1};
+  }
+
+  persistent_trie erase(const std::string& word) const {
+    node_ptr root;
+    if (!erase_(*root_, word, 0, root)) return *this;
+
+    return persistent_trie{std::move(root), size_ - 1};
+  }
+
+  bool exists(const std::string& word) const {
+    return lookup_(word) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto found = lookup_(word);
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good as long as some version sharing the words is around
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    const node_t* node = root_.get();
+    std::size_t   pos  = 0;
+    for (; pos != prefix.size(); ++pos) {
+      if (node->kind == detail::persistent_kind::leaf) break;
+
+      node = static_cast<const branch_t*>(node)->find(prefix[pos]);
+      if (!node) return false;
+    }
+
+    std::string match = prefix;
+    if (node->kind == detail::persistent_kind::leaf) {
+      // the rest of the prefix has to be the start of the leaf
+      auto& data = static_cast<const leaf_t*>(node)->data;
+      if (simd::mismatch(std::begin(prefix) + static_cast<std::ptrdiff_t>(pos), std::end(prefix),
+                         std::begin(data), std::end(data)).first != std::end(prefix)) {
+        return false;
+      }
+      match.append(data, prefix.size() - pos, std::string::npos);
+    }
+    else {
+      // the first word below, always the smallest key
+      while (node->kind == detail::persistent_kind::branch && !static_cast<const branch_t*>(node)->value) {
+        auto branch = static_cast<const branch_t*>(node);
+        match.push_back(branch->keys.front());
+        node = branch->children.front().get();
+      }
+      if (node->kind == detail::persistent_kind::leaf) match += static_cast<const leaf_t*>(node)->data;
+    }
+
+    matching_word = std::move(match);
+    return true;
+  }
+
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, *root_);
+
+    return ret;
+  }
+
+  std::size_t size() const { return size_; }
+
+  // true when both are the same version, or versions which came out the same through
+  // inserts and erases that changed nothing
+  bool shares_root_with(const persistent_trie& other) const { return root_ == other.root_; }
+
+private:
+  persistent_trie(node_ptr root, std::size_t size) : root_{std::move(root)}, size_{size} { }
+
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_t*      node  = nullptr; // null once the lookup is done
+    const std::string* word  = nullptr;
+    std::size_t        pos   = 0;
+    const T*           value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.word = &word;
+    state.node = root_.get();
+    return state;
+  }
+
+  // one node of lookup_
+  static bool batch_step_(batch_state_t& state) {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    auto& word = *state.word;
+    if (node->kind == detail::persistent_kind::leaf) {
+      auto leaf = static_cast<const leaf_t*>(node);
+      auto rest = std::begin(word) + static_cast<std::ptrdiff_t>(state.pos);
+      if (simd::equal(std::begin(leaf->data), std::end(leaf->data), rest, std::end(word))) state.value = &leaf->value;
+      return false;
+    }
+
+    auto branch = static_cast<const branch_t*>(node);
+    if (state.pos == word.size()) {
+      state.value = branch->value.get();
+      return false;
+    }
+
+    state.node = branch->find(word[state.pos++]);
+    if (!state.node) return false;
+
+    util::prefetch(state.node);
+    return true;
+  }
+
+  const T* lookup_(const std::string& word) const {
+    const node_t* node = root_.get();
+    std::size_t   pos  = 0;
+    for (;;) {
+      if (node->kind == detail::persistent_kind::leaf) {
+        auto leaf = static_cast<const leaf_t*>(node);
+        auto rest = std::begin(word) + static_cast<std::ptrdiff_t>(pos);
+        return simd::equal(std::begin(leaf->data), std::end(leaf->data), rest, std::end(word)) ? &leaf->value : nullptr;
+      }
+
+      auto branch = static_cast<const branch_t*>(node);
+      if (pos == word.size()) return branch->value.get();
+
+      node = branch->find(word[pos++]);
+      if (!node) return nullptr;
+    }
+  }
+
+  // the new version of 'node' with the word under it, nullptr if the word is there already
+  static node_ptr insert_(const node_t& node, const std::string& word, std::size_t pos, T& value) {
+    if (node.kind == detail::persistent_kind::leaf) return split_(static_cast<const leaf_t&>(node), word, pos, value);
+
+    auto& branch = static_cast<const branch_t&>(node);
+    if (pos == word.size()) {
+      if (branch.value) return nullptr;
+
+      auto copy = std::make_shared<branch_t>(branch);
+      copy->value = std::make_shared<const T>(std::move(value));
+      return copy;
+    }
+
+    auto i    = branch.index_of(word[pos]);
+    auto diff = static_cast<std::ptrdiff_t>(i);
+    if (i == branch.keys.size() || branch.keys[i] != word[pos]) {
+      auto copy = std::make_shared<branch_t>(branch);
+      copy->keys.insert(std::begin(copy->keys) + diff, word[pos]);
+      copy->children.insert(std::begin(copy->children) + diff, std::make_shared<const leaf_t>(word.substr(pos + 1), std::move(value)));
+      return copy;
+    }
+
+    auto child = insert_(*branch.children[i], word, pos + 1, value);
+    if (!child) return nullptr;
+
+    auto copy = std::make_shared<branch_t>(branch);
+    copy->children[i] = std::move(child);
+    return copy;
+  }
+
+  // what breakup_leaf does, but into new nodes.  nullptr if the word is the leaf's
+  static node_ptr split_(const leaf_t& leaf, const std::string& word, std::size_t pos, T& value) {
+    auto& data   = leaf.data;
+    auto  rest   = std::begin(word) + static_cast<std::ptrdiff_t>(pos);
+    auto  common = static_cast<std::size_t>(simd::mismatch(std::begin(data), std::end(data), rest, std::end(word)).first -
+                                            std::begin(data));
+    auto  word_common = pos + common;
+    if (common == data.size() && word_common == word.size()) return nullptr;
+
+    // the branch where the two part ways
+    auto split = std::make_shared<branch_t>();
+    if (common == data.size()) {
+      split->value = std::make_shared<const T>(leaf.value);
+      split->keys.push_back(word[word_common]);
+      split->children.push_back(std::make_shared<const leaf_t>(word.substr(word_common + 1), std::move(value)));
+    }
+    else if (word_common == word.size()) {
+      split->value = std::make_shared<const T>(std::move(value));
+      split->keys.push_back(data[common]);
+      split->children.push_back(std::make_shared<const leaf_t>(data.substr(common + 1), leaf.value));
+    }
+    else {
+      auto leaf_part = std::make_shared<const leaf_t>(data.substr(common + 1), leaf.value);
+      auto word_part = std::make_shared<const leaf_t>(word.substr(word_common + 1), std::move(value));
+      if (data[common] < word[word_common]) {
+        split->keys     = { data[common], word[word_common] };
+        split->children = { std::move(leaf_part), std::move(word_part) };
+      }
+      else {
+        split->keys     = { word[word_common], data[common] };
+        split->children = { std::move(word_part), std::move(leaf_part) };
+      }
+    }
+
+    // and the single child branches down to it
+    node_ptr ret = std::move(split);
+    for (auto i = common; i-- != 0;) {
+      auto branch = std::make_shared<branch_t>();
+      branch->keys.push_back(data[i]);
+      branch->children.push_back(std::move(ret));
+      ret = std::move(branch);
+    }
+    return ret;
+  }
+
+  // false if the word isn't under 'node', otherwise 'replacement' is the new version of
+  // 'node' (nullptr when nothing is left of it)
+  static bool erase_(const node_t& node, const std::string& word, std::size_t pos, node_ptr& replacement) {
+    if (node.kind == detail::persistent_kind::leaf) {
+      auto& data = static_cast<const leaf_t&>(node).data;
+      if (!simd::equal(std::begin(data), std::end(data), std::begin(word) + static_cast<std::ptrdiff_t>(pos), std::end(word))) {
+        return false;
+      }
+
+      replacement = nullptr;
+      return true;
+    }
+
+    auto& branch = static_cast<const branch_t&>(node);
+    std::shared_ptr<branch_t> copy;
+    if (pos == word.size()) {
+      if (!branch.value) return false;
+
+      copy = std::make_shared<branch_t>(branch);
+      copy->value.reset();
+    }
+    else {
+      auto i = branch.index_of(word[pos]);
+      if (i == branch.keys.size() || branch.keys[i] != word[pos]) return false;
+
+      node_ptr child;
+      if (!erase_(*branch.children[i], word, pos + 1, child)) return false;
+
+      copy = std::make_shared<branch_t>(branch);
+      if (child) {
+        copy->children[i] = std::move(child);
+      }
+      else {
+        copy->keys.erase(i, 1);
+        copy->children.erase(std::begin(copy->children) + static_cast<std::ptrdiff_t>(i));
+      }
+    }
+
+    // the root stays a branch no matter what is left under it
+    replacement = pos == 0 ? std::move(copy) : collapse_(std::move(copy));
+    return true;
+  }
+
+  // what is left of a branch after an erase: nothing, a leaf if all it leads to is a leaf,
+  // or the branch itself
+  static node_ptr collapse_(std::shared_ptr<branch_t> branch) {
+    if (branch->value) return branch;
+    if (branch->keys.empty()) return nullptr;
+
+    if (branch->keys.size() == 1 && branch->children[0]->kind == detail::persistent_kind::leaf) {
+      auto& leaf = static_cast<const leaf_t&>(*branch->children[0]);
+      return std::make_shared<const leaf_t>(branch->keys[0] + leaf.data, leaf.value);
+    }
+    return branch;
+  }
+
+  static void get_words_impl_(std::vector<std::string>& words, std::string& prefix, const node_t& node) {
+    if (node.kind == detail::persistent_kind::leaf) {
+      words.push_back(prefix + static_cast<const leaf_t&>(node).data);
+      return;
+    }
+
+    auto& branch = static_cast<const branch_t&>(node);
+    if (branch.value) words.push_back(prefix);
+    for (std::size_t i = 0; i != branch.keys.size(); ++i) {
+      prefix.push_back(branch.keys[i]);
+      get_words_impl_(words, prefix, *branch.children[i]);
+      prefix.pop_back();
+    }
+  }
+};
+
+// the root branch already splits words by their first char, sharded_trie gives every range
+// of leading bytes a trie and a lock of its own so writers of different ranges never contend.
+// Shards cover contiguous ranges of the first two bytes in char order: 256 shards is one per
+// first byte, more split further on the second byte.  Shards are visited in order, so
+// get_words() and prefix_match() still come out like a single trie's
+template <typename T>
+class sharded_trie {
+  struct alignas(64) shard_t {
+    mutable std::shared_mutex lock;
+    trie<T>                   words;
+  };
+
+  std::size_t                shard_count_;
+  std::unique_ptr<shard_t[]> shards_;
+public:
+  static constexpr std::size_t default_shard_count = 256;
+  static constexpr std::size_t max_shard_count     = 1 << 16;
+
+  explicit sharded_trie(std::size_t shard_count = default_shard_count) :
+    shard_count_{std::max<std::size_t>(1, std::min(shard_count, max_shard_count))},
+    shards_{new shard_t[shard_count_]} { }
+
+  void insert(const std::string& word, T value) {
+    if (word.empty()) return;
+
+    auto& shard = shards_[shard_of_(key_of_(word, 0))];
+    std::unique_lock<std::shared_mutex> lock{shard.lock};
+    shard.words.insert(word, std::move(value));
+  }
+
+  bool erase(const std::string& word) {
+    if (word.empty()) return false;
+
+    auto& shard = shards_[shard_of_(key_of_(word, 0))];
+    std::unique_lock<std::shared_mutex> lock{shard.lock};
+    return shard.words.erase(word);
+  }
+
+  bool exists(const std::string& word) const {
+    if (word.empty()) return false;
+
+    auto& shard = shards_[shard_of_(key_of_(word, 0))];
+    std::shared_lock<std::shared_mutex> lock{shard.lock};
+    return shard.words.exists(word);
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    if (word.empty()) return false;
+
+    auto& shard = shards_[shard_of_(key_of_(word, 0))];
+    std::shared_lock<std::shared_mutex> lock{shard.lock};
+    return shard.words.value_at(word, value);
+  }
+
+  // batched exists.  The words are grouped by shard so every shard is locked once and
+  // looked up with trie::exists_batch, the answers go out in input order.  There is no
+  // value_at_batch, a pointer to a value could outlive the shard lock
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    typedef typename std::vector<ForwardIt>::iterator group_it;
+    typedef detail::indirect_iterator_t<group_it>     input_it;
+
+    // (shard, position in the input), empty words go past the last shard
+    std::vector<std::pair<std::size_t, std::size_t>> order;
+    std::vector<ForwardIt>                           words;
+    for (; first != last; ++first) {
+      const std::string& word = *first; // a copy for words which aren't a std::string
+      order.emplace_back(word.empty() ? shard_count_ : shard_of_(key_of_(word, 0)), words.size());
+      words.push_back(first);
+    }
+    std::sort(std::begin(order), std::end(order));
+
+    std::vector<ForwardIt> grouped;
+    grouped.reserve(words.size());
+    for (auto& word : order) {
+      grouped.push_back(words[word.second]);
+    }
+
+    std::vector<char> found(words.size(), false);
+    std::vector<char> grouped_found(words.size(), false);
+    for (std::size_t i = 0; i != order.size() && order[i].first != shard_count_;) {
+      auto shard = order[i].first;
+      auto group = i;
+      for (++i; i != order.size() && order[i].first == shard; ++i) { }
+
+      std::shared_lock<std::shared_mutex> lock{shards_[shard].lock};
+      shards_[shard].words.exists_batch(input_it{std::begin(grouped) + static_cast<std::ptrdiff_t>(group)},
+                                        input_it{std::begin(grouped) + static_cast<std::ptrdiff_t>(i)},
+                                        std::begin(grouped_found) + static_cast<std::ptrdiff_t>(group));
+    }
+    for (std::size_t i = 0; i != order.size(); ++i) {
+      found[order[i].second] = grouped_found[i];
+    }
+
+    for (auto exists : found) {
+      *out++ = exists != 0;
+    }
+    return out;
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    // a one char prefix spans every second byte, the first shard holding a match has the smallest
+    auto last = shard_of_(key_of_(prefix, 0xff));
+    for (auto i = shard_of_(key_of_(prefix, 0)); i <= last; ++i) {
+      std::shared_lock<std::shared_mutex> lock{shards_[i].lock};
+      if (shards_[i].words.prefix_match(prefix, matching_word)) return true;
+    }
+    return false;
+  }
+
+  // each shard is read under its own lock, words inserted meanwhile may or may not show up
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> words;
+    for (std::size_t i = 0; i != shard_count_; ++i) {
+      std::shared_lock<std::shared_mutex> lock{shards_[i].lock};
+
+      auto shard_words = shards_[i].words.get_words();
+      words.insert(std::end(words), std::make_move_iterator(std::begin(shard_words)), std::make_move_iterator(std::end(shard_words)));
+    }
+    return words;
+  }
+
+  std::size_t shard_count() const { return shard_count_; }
+
+private:
+  // the first two bytes as a number in char order, a missing second byte sorts first
+  static std::size_t key_of_(const std::string& word, std::size_t missing) {
+    auto rank = [](char c) { return static_cast<std::size_t>(static_cast<int>(c) - CHAR_MIN); };
+    return (rank(word[0]) << 8) | (word.size() > 1 ? rank(word[1]) : missing);
+  }
+
+  std::size_t shard_of_(std::size_t key) const {
+    return key * shard_count_ / max_shard_count;
+  }
+};
+
+// every word of an impl3 trie laid out as an Aho-Corasick automaton: one state per prefix
+// (leaves spelled out char by char), a failure link from each state to the state of its
+// longest proper suffix that is also a prefix, and an output link to the next state down
+// that chain which ends a word.  scan() finds every occurrence of every word in a text in
+// one pass, scanner does the same over text handed over a chunk at a time
+template <typename T>
+class aho_corasick {
+  static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+
+  std::vector<std::uint32_t> first_;   // the transitions of state s are [first_[s], first_[s + 1])
+  std::string                labels_;  // sorted within a state
+  std::vector<std::uint32_t> targets_;
+  std::vector<std::uint32_t> root_;    // where the root goes on every byte, 0 for nowhere
+  std::vector<std::uint32_t> fail_;
+  std::vector<std::uint32_t> output_;  // the next state down the failure chain ending a word, npos if none
+  std::vector<std::uint32_t> word_;    // the word ending at the state, npos if none
+  std::vector<std::string>   words_;
+  std::vector<T>             values_;
+public:
+  // hands the text over in any number of pieces, matches which span pieces are found
+  // all the same.  Offsets count from the start of the first piece
+  class scanner {
+    const aho_corasick* automaton_;
+    std::uint32_t       state_  = 0;
+    std::size_t         offset_ = 0;
+  public:
+    explicit scanner(const aho_corasick& automaton) : automaton_{&automaton} { }
+
+    // calls on_match(offset, word, value) for every match ending in this piece
+    template <typename F>
+    void feed(const char* text, std::size_t size, F&& on_match) {
+      state_   = automaton_->scan_(state_, offset_, text, size, on_match);
+      offset_ += size;
+    }
+
+    template <typename F>
+    void feed(const std::string& text, F&& on_match) {
+      feed(text.data(), text.size(), std::forward<F>(on_match));
+    }
+
+    // back to the start of a new text
+    void reset() {
+      state_  = 0;
+      offset_ = 0;
+    }
+
+    // how much text went in so far
+    std::size_t offset() const { return offset_; }
+  };
+
+  template <typename Alloc, typename Augment>
+  explicit aho_corasick(const trie<T, Alloc, Augment>& source) : root_(UCHAR_MAX + 1, 0) {
+    for (auto it = source.begin(); it != source.end(); ++it) {
+      words_.push_back(*it);
+      values_.push_back(it.value());
+    }
+
+    build_goto_();
+    build_links_();
+  }
+
+  // calls on_match(offset, word, value) for every occurrence of a word in the text, offset
+  // being where it starts.  Matches come in the order they end, longest first when several
+  // end at the same place
+  template <typename F>
+  void scan(const char* text, std::size_t size, F&& on_match) const {
+    scan_(0, 0, text, size, on_match);
+  }
+
+  template <typename F>
+  void scan(const std::string& text, F&& on_match) const {
+    scan(text.data(), text.size(), std::forward<F>(on_match));
+  }
+
+  scanner make_scanner() const { return scanner{*this}; }
+
+  std::size_t size() const { return words_.size(); }
+
+  std::size_t state_count() const { return fail_.size(); }
+
+private:
+  // the state after 'c' from 'state' following the failure links, the root at worst
+  std::uint32_t next_(std::uint32_t state, char c) const {
+    for (; state != 0; state = fail_[state]) {
+      auto found = transition_(state, c);
+      if (found != npos) return found;
+    }
+    return root_[static_cast<unsigned char>(c)];
+  }
+
+  std::uint32_t transition_(std::uint32_t state, char c) const {
+    auto first = std::begin(labels_) + first_[state];
+    auto last  = std::begin(labels_) + first_[state + 1];
+    auto found = std::lower_bound(first, last, c);
+    if (found == last || *found != c) return npos;
+
+    return targets_[static_cast<std::size_t>(found - std::begin(labels_))];
+  }
+
+  template <typename F>
+  std::uint32_t scan_(std::uint32_t state, std::size_t offset, const char* text, std::size_t size, F& on_match) const {
+    for (std::size_t i = 0; i != size; ++i) {
+      state = next_(state, text[i]);
+
+      auto end = offset + i + 1;
+      for (auto s = word_[state] != npos ? state : output_[state]; s != npos; s = output_[s]) {
+        auto& word = words_[word_[s]];
+        on_match(end - word.size(), word, values_[word_[s]]);
+      }
+    }
+    return state;
+  }
+
+  // the states are numbered breadth first, the words sharing the prefix of a state are a
+  // run of the sorted words so the children of a state are the runs one char longer
+  void build_goto_() {
+    struct run_t {
+      std::size_t first;
+      std::size_t last;
+    };
+
+    std::vector<run_t> level{ { 0, words_.size() } };
+    first_.push_back(0);
+    for (std::size_t depth = 0; !level.empty(); ++depth) {
+      // the states of the next level are numbered right after the ones of this level
+      auto next_state = word_.size() + level.size();
+
+      std::vector<run_t> next_level;
+      for (auto& run : level) {
+        auto first = run.first;
+
+        // the word the same length as the prefix sorts first
+        if (first != run.last && words_[first].size() == depth) {
+          word_.push_back(static_cast<std::uint32_t>(first++));
+        }
+        else {
+          word_.push_back(npos);
+        }
+
+        while (first != run.last) {
+          auto c    = words_[first][depth];
+          auto last = first + 1;
+          for (; last != run.last && words_[last][depth] == c; ++last) { }
+
+          labels_.push_back(c);
+          targets_.push_back(static_cast<std::uint32_t>(next_state + next_level.size()));
+          next_level.push_back({ first, last });
+          first = last;
+        }
+        first_.push_back(static_cast<std::uint32_t>(labels_.size()));
+      }
+      level = std::move(next_level);
+    }
+
+    for (auto i = first_[0]; i != first_[1]; ++i) {
+      root_[static_cast<unsigned char>(labels_[i])] = targets_[i];
+    }
+  }
+
+  // failure and output links, parents are always numbered before their children
+  void build_links_() {
+    fail_.assign(word_.size(), 0);
+    output_.assign(word_.size(), npos);
+
+    for (std::uint32_t state = 0; state != word_.size(); ++state) {
+      for (auto i = first_[state]; i != first_[state + 1]; ++i) {
+        auto target = targets_[i];
+        if (state != 0) fail_[target] = next_(fail_[state], labels_[i]);
+
+        auto fail = fail_[target];
+        output_[target] = word_[fail] != npos ? fail : output_[fail];
+      }
+    }
+  }
+};
+
+} // namespace impl3
+
+
+namespace impl4 {
+
+// adaptive radix tree (ART): inner nodes grow from 4 -> 16 -> 48 -> 256 children
+// as keys are added, inner nodes carry a compressed path and leaves carry the
+// remaining key (lazy expansion)
+namespace detail {
+
+enum class node_type : unsigned char {
+  leaf,
+  node4,
+  node16,
+  node48,
+  node256
+};
+
+template <typename T>
+struct node_t;
+
+template <typename T>
+struct node_deleter {
+  void operator()(node_t<T>* node) const;
+};
+
+template <typename T>
+using node_ptr = std::unique_ptr<node_t<T>, node_deleter<T>>;
+
+template <typename T>
+struct node_t {
+  node_type   type;
+  std::string prefix; // compressed path for inner nodes, remaining key data for leaves
+
+  explicit node_t(node_type type) : type{type} { }
+};
+
+template <typename T>
+struct leaf_t : node_t<T> {
+  T value;
+
+  leaf_t(std::string::const_iterator first, std::string::const_iterator last, T value) :
+    node_t<T>{node_type::leaf}, value{std::move(value)} {
+    this->prefix.append(first, last);
+  }
+};
+
+template <typename T>
+struct inner_t : node_t<T> {
+  std::uint16_t      count = 0; // number of children
+  std::unique_ptr<T> value;     // set when the key ending at this node is a word
+
+  explicit inner_t(node_type type) : node_t<T>{type} { }
+};
+
+template <typename T>
+struct node4_t : inner_t<T> {
+  unsigned char keys[4];     // sorted by key_less
+  node_ptr<T>   children[4];
+
+  node4_t() : inner_t<T>{node_type::node4} { }
+};
+
+template <typename T>
+struct node16_t : inner_t<T> {
+  unsigned char keys[16];     // sorted by key_less
+  node_ptr<T>   children[16];
+
+  node16_t() : inner_t<T>{node_type::node16} { }
+};
+
+template <typename T>
+struct node48_t : inner_t<T> {
+  unsigned char index[256];    // 0 means empty, otherwise slot + 1 into children
+  node_ptr<T>   children[48];
+
+  node48_t() : inner_t<T>{node_type::node48} { std::fill(std::begin(index), std::end(index), 0); }
+};
+
+template <typename T>
+struct node256_t : inner_t<T> {
+  node_ptr<T> children[256];
+
+  node256_t() : inner_t<T>{node_type::node256} { }
+};
+
+template <typename T>
+void node_deleter<T>::operator()(node_t<T>* node) const {
+  switch (node->type) {
+  case node_type::leaf:    delete static_cast<leaf_t<T>*>(node);    break;
+  case node_type::node4:   delete static_cast<node4_t<T>*>(node);   break;
+  case node_type::node16:  delete static_cast<node16_t<T>*>(node);  break;
+  case node_type::node48:  delete static_cast<node48_t<T>*>(node);  break;
+  case node_type::node256: delete static_cast<node256_t<T>*>(node); break;
+  }
+}
+
+template <typename T>
+node_ptr<T> make_leaf(std::string::const_iterator first, std::string::const_iterator last, T value) {
+  return node_ptr<T>{new leaf_t<T>(first, last, std::move(value))};
+}
+
+// children are kept and walked in the order impl1 to impl3 keep them (std::map<char>), so
+// where char is signed the bytes from 0x80 up come before the rest
+inline bool key_less(unsigned char a, unsigned char b) {
+  return static_cast<char>(a) < static_cast<char>(b);
+}
+
+// the byte at place i in that order
+inline unsigned char key_at(int i) {
+  return static_cast<unsigned char>(i + CHAR_MIN);
+}
+
+template <typename T>
+const node_ptr<T>* find_child(const inner_t<T>& inner, unsigned char c) {
+  switch (inner.type) {
+  case node_type::node4: {
+    auto& node = static_cast<const node4_t<T>&>(inner);
+    for (std::uint16_t i = 0; i != node.count; ++i) {
+      if (node.keys[i] == c) return &node.children[i];
+    }
+    return nullptr;
+  }
+  case node_type::node16: {
+    auto& node = static_cast<const node16_t<T>&>(inner);
+    auto last  = std::begin(node.keys) + node.count;
+    auto found = std::lower_bound(std::begin(node.keys), last, c, key_less);
+    if (found == last || *found != c) return nullptr;
+    return &node.children[found - std::begin(node.keys)];
+  }
+  case node_type::node48: {
+    auto& node = static_cast<const node48_t<T>&>(inner);
+    if (!node.index[c]) return nullptr;
+    return &node.children[node.index[c] - 1];
+  }
+  case node_type::node256: {
+    auto& node = static_cast<const node256_t<T>&>(inner);
+    return node.children[c] ? &node.children[c] : nullptr;
+  }
+  case node_type::leaf:
+    break;
+  }
+  assert(false && "prog error");
+  return nullptr;
+}
+
+template <typename T>
+node_ptr<T>* find_child(inner_t<T>& inner, unsigned char c) {
+  return const_cast<node_ptr<T>*>(find_child(static_cast<const inner_t<T>&>(inner), c));
+}
+
+// moves the header (compressed path, value) and children of 'from' into 'to'
+template <typename T>
+void move_header(inner_t<T>& from, inner_t<T>& to) {
+  to.prefix = std::move(from.prefix);
+  to.value  = std::move(from.value);
+  to.count  = from.count;
+}
+
+// inserts a child into a sorted key array of a node4/node16
+template <typename Node, typename T>
+void insert_sorted(Node& node, unsigned char c, node_ptr<T> child) {
+  auto last = std::begin(node.keys) + node.count;
+  auto pos  = std::upper_bound(std::begin(node.keys), last, c, key_less) - std::begin(node.keys);
+  for (auto i = static_cast<std::ptrdiff_t>(node.count); i != pos; --i) {
+    node.keys[i]     = node.keys[i - 1];
+    node.children[i] = std::move(node.children[i - 1]);
+  }
+  node.keys[pos]     = c;
+  node.children[pos] = std::move(child);
+  ++node.count;
+}
+
+// adds a child to the inner node held by 'ref', growing the node to the next size if it is full
+template <typename T>
+void add_child(node_ptr<T>& ref, unsigned char c, node_ptr<T> child) {
+  switch (ref->type) {
+  case node_type::node4: {
+    auto& node = static_cast<node4_t<T>&>(*ref);
+    if (node.count < 4) {
+      insert_sorted(node, c, std::move(child));
+      return;
+    }
+
+    auto grown = new node16_t<T>;
+    move_header<T>(node, *grown);
+    std::copy(std::begin(node.keys), std::end(node.keys), std::begin(grown->keys));
+    std::move(std::begin(node.children), std::end(node.children), std::begin(grown->children));
+    ref.reset(grown);
+    insert_sorted(*grown, c, std::move(child));
+    return;
+  }
+  case node_type::node16: {
+    auto& node = static_cast<node16_t<T>&>(*ref);
+    if (node.count < 16) {
+      insert_sorted(node, c, std::move(child));
+      return;
+    }
+
+    auto grown = new node48_t<T>;
+    move_header<T>(node, *grown);
+    for (unsigned char i = 0; i != 16; ++i) {
+      grown->index[node.keys[i]] = i + 1;
+      grown->children[i]         = std::move(node.children[i]);
+    }
+    ref.reset(grown);
+    grown->index[c]                = static_cast<unsigned char>(grown->count + 1);
+    grown->children[grown->count++] = std::move(child);
+    return;
+  }
+  case node_type::node48: {
+    auto& node = static_cast<node48_t<T>&>(*ref);
+    if (node.count < 48) {
+      node.index[c]              = static_cast<unsigned char>(node.count + 1);
+      node.children[node.count++] = std::move(child);
+      return;
+    }
+
+    auto grown = new node256_t<T>;
+    move_header<T>(node, *grown);
+    for (int i = 0; i != 256; ++i) {
+      if (node.index[i]) grown->children[i] = std::move(node.children[node.index[i] - 1]);
+    }
+    ref.reset(grown);
+    grown->children[c] = std::move(child);
+    ++grown->count;
+    return;
+  }
+  case node_type::node256: {
+    auto& node = static_cast<node256_t<T>&>(*ref);
+    node.children[c] = std::move(child);
+    ++node.count;
+    return;
+  }
+  case node_type::leaf:
+    break;
+  }
+  assert(false && "prog error");
+}
+
+// calls f(key, child) for every child of the inner node in key_less order
+template <typename T, typename F>
+void for_each_child(const inner_t<T>& inner, F&& f) {
+  switch (inner.type) {
+  case node_type::node4: {
+    auto& node = static_cast<const node4_t<T>&>(inner);
+    for (std::uint16_t i = 0; i != node.count; ++i) f(node.keys[i], *node.children[i]);
+    return;
+  }
+  case node_type::node16: {
+    auto& node = static_cast<const node16_t<T>&>(inner);
+    for (std::uint16_t i = 0; i != node.count; ++i) f(node.keys[i], *node.children[i]);
+    return;
+  }
+  case node_type::node48: {
+    auto& node = static_cast<const node48_t<T>&>(inner);
+    for (int i = 0; i != 256; ++i) {
+      auto c = key_at(i);
+      if (node.index[c]) f(c, *node.children[node.index[c] - 1]);
+    }
+    return;
+  }
+  case node_type::node256: {
+    auto& node = static_cast<const node256_t<T>&>(inner);
+    for (int i = 0; i != 256; ++i) {
+      auto c = key_at(i);
+      if (node.children[c]) f(c, *node.children[c]);
+    }
+    return;
+  }
+  case node_type::leaf:
+    break;
+  }
+  assert(false && "prog error");
+}
+
+// the child with the smallest key by key_less
+template <typename T>
+std::pair<unsigned char, const node_t<T>*> first_child(const inner_t<T>& inner) {
+  switch (inner.type) {
+  case node_type::node4: {
+    auto& node = static_cast<const node4_t<T>&>(inner);
+    return { node.keys[0], node.children[0].get() };
+  }
+  case node_type::node16: {
+    auto& node = static_cast<const node16_t<T>&>(inner);
+    return { node.keys[0], node.children[0].get() };
+  }
+  case node_type::node48: {
+    auto& node = static_cast<const node48_t<T>&>(inner);
+    for (int i = 0; i != 256; ++i) {
+      auto c = key_at(i);
+      if (node.index[c]) return { c, node.children[node.index[c] - 1].get() };
+    }
+    break;
+  }
+  case node_type::node256: {
+    auto& node = static_cast<const node256_t<T>&>(inner);
+    for (int i = 0; i != 256; ++i) {
+      auto c = key_at(i);
+      if (node.children[c]) return { c, node.children[c].get() };
+    }
+    break;
+  }
+  case node_type::leaf:
+    break;
+  }
+  assert(false && "prog error");
+  return { 0, nullptr };
+}
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  typedef detail::node_t<T>  node_t;
+  typedef detail::leaf_t<T>  leaf_t;
+  typedef detail::inner_t<T> inner_t;
+  typedef detail::node_ptr<T> node_ptr;
+
+  node_ptr root_;
+public:
+  trie() : root_{new detail::node4_t<T>} { }
+  ~trie() = default;
+
+  void insert(const std::string& word, T value) {
+    if (word.empty()) return;
+
+    auto w_first = std::begin(word);
+    auto w_last  = std::end(word);
+
+    auto ref = &root_;
+    for (;;) {
+      auto& node = **ref;
+
+      // find where the stored data (leaf key or compressed path) and the word part ways
+      auto p_first = std::begin(node.prefix);
+      auto p_last  = std::end(node.prefix);
+      auto mismatch = simd::mismatch(p_first, p_last, w_first, w_last);
+
+      if (node.type == detail::node_type::leaf) {
+        if (mismatch.first == p_last && mismatch.second == w_last) {
+          // base case (adding same word)
+          return;
+        }
+        split_(*ref, mismatch.first, mismatch.second, w_last, value);
+        return;
+      }
+
+      if (mismatch.first != p_last) {
+        // the word leaves the compressed path in the middle
+        split_(*ref, mismatch.first, mismatch.second, w_last, value);
+        return;
+      }
+
+      w_first = mismatch.second;
+      auto& inner = static_cast<inner_t&>(node);
+      if (w_first == w_last) {
+        // the word ends at this node
+        if (!inner.value) inner.value = std::make_unique<T>(std::move(value));
+        return;
+      }
+
+      auto next = detail::find_child(inner, static_cast<unsigned char>(*w_first));
+      if (!next) {
+        // we use std::next here because the leaf contains data under it, not its own char as the first char
+        detail::add_child(*ref, static_cast<unsigned char>(*w_first), detail::make_leaf(std::next(w_first), w_last, std::move(value)));
+        return;
+      }
+
+      ++w_first; // move forward
+      ref = next;
+    }
+  }
+
+  bool exists(const std::string& word) const {
+    return lookup_value_(word) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto found = lookup_value_(word);
+
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch with the child
+  // picked out of each Node4/16/48/256 prefetched
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good until the trie is changed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    auto first = std::begin(prefix);
+    auto last  = std::end(prefix);
+
+    const node_t* node = root_.get();
+    for (;;) {
+      // the prefix may end anywhere within the stored data of this node
+      auto remaining = static_cast<std::size_t>(std::distance(first, last));
+      auto shared    = std::min(remaining, node->prefix.size());
+      if (!simd::equal(first, first + shared, std::begin(node->prefix), std::begin(node->prefix) + shared)) return false;
+
+      if (node->type == detail::node_type::leaf) {
+        if (shared != remaining) return false;
+
+        matching_word.assign(std::begin(prefix), first);
+        matching_word.append(node->prefix); // just append the whole node
+        return true;
+      }
+
+      if (shared == remaining) {
+        matching_word.assign(std::begin(prefix), first);
+        break;
+      }
+
+      first += shared;
+      auto next = detail::find_child(static_cast<const inner_t&>(*node), static_cast<unsigned char>(*first));
+      if (!next) return false;
+
+      ++first; // advance
+      node = next->get();
+    }
+
+    // find the first word we can match (alphabetical order)
+    for (;;) {
+      matching_word.append(node->prefix);
+      if (node->type == detail::node_type::leaf) return true;
+
+      auto& inner = static_cast<const inner_t&>(*node);
+      if (inner.value) return true;
+
+      auto next = detail::first_child(inner);
+      matching_word.push_back(static_cast<char>(next.first));
+      node = next.second;
+    }
+  }
+
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, *root_);
+
+    return ret;
+  }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_t*               node  = nullptr; // null once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.node = root_.get();
+    return state;
+  }
+
+  static bool batch_step_(batch_state_t& state) {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    auto remaining = static_cast<std::size_t>(std::distance(state.first, state.last));
+    auto& data     = node->prefix;
+
+    if (node->type == detail::node_type::leaf) {
+      // compare the remaining string to the leaf value
+      if (simd::equal(std::begin(data), std::end(data), state.first, state.last)) {
+        state.value = &static_cast<const leaf_t*>(node)->value;
+      }
+      return false;
+    }
+
+    if (remaining < data.size() || !simd::equal(std::begin(data), std::end(data), state.first, state.first + data.size())) {
+      return false;
+    }
+
+    state.first += data.size();
+    auto& inner = static_cast<const inner_t&>(*node);
+    if (state.first == state.last) {
+      state.value = inner.value.get();
+      return false;
+    }
+
+    auto next = detail::find_child(inner, static_cast<unsigned char>(*state.first));
+    if (!next) return false;
+
+    ++state.first; // advance
+    state.node = next->get();
+    util::prefetch(state.node);
+    return true;
+  }
+
+  void split_(node_ptr& ref, std::string::const_iterator node_split, std::string::const_iterator word_split,
+              std::string::const_iterator word_last, T& value) {
+    auto& node = *ref;
+
+    // the new parent takes everything both keys have in common
+    auto parent = new detail::node4_t<T>;
+    node_ptr owner{parent};
+    parent->prefix.assign(std::cbegin(node.prefix), node_split);
+
+    // re-home the old node under the split point
+    if (node_split == std::cend(node.prefix)) {
+      // only leaves can be exhausted here, the old word becomes the value of the new parent
+      parent->value = std::make_unique<T>(std::move(static_cast<leaf_t&>(node).value));
+      ref.reset();
+    }
+    else {
+      auto c = static_cast<unsigned char>(*node_split);
+      node.prefix.erase(std::begin(node.prefix), std::begin(node.prefix) + (node_split - std::cbegin(node.prefix)) + 1);
+      detail::insert_sorted(*parent, c, std::move(ref));
+    }
+
+    // then the new word
+    if (word_split == word_last) {
+      parent->value = std::make_unique<T>(std::move(value));
+    }
+    else {
+      // we use std::next here because the leaf contains data under it, not its own char as the first char
+      detail::insert_sorted(*parent, static_cast<unsigned char>(*word_split),
+                            detail::make_leaf(std::next(word_split), word_last, std::move(value)));
+    }
+
+    ref = std::move(owner);
+  }
+
+  const T* lookup_value_(const std::string& word) const {
+    if (word.empty()) return nullptr;
+
+    auto first = std::begin(word);
+    auto last  = std::end(word);
+
+    const node_t* node = root_.get();
+    for (;;) {
+      auto remaining = static_cast<std::size_t>(std::distance(first, last));
+      auto& data     = node->prefix;
+
+      if (node->type == detail::node_type::leaf) {
+        // compare the remaining string to the leaf value
+        if (simd::equal(std::begin(data), std::end(data), first, last)) {
+          return &static_cast<const leaf_t&>(*node).value;
+        }
+        return nullptr;
+      }
+
+      if (remaining < data.size() || !simd::equal(std::begin(data), std::end(data), first, first + data.size())) {
+        return nullptr;
+      }
+
+      first += data.size();
+      auto& inner = static_cast<const inner_t&>(*node);
+      if (first == last) return inner.value.get();
+
+      auto next = detail::find_child(inner, static_cast<unsigned char>(*first));
+      if (!next) return nullptr;
+
+      ++first; // advance
+      node = next->get();
+    }
+  }
+
+  void get_words_impl_(std::vector<std::string>& words, std::string& working_prefix, const node_t& node) const {
+    if (node.type == detail::node_type::leaf) {
+      words.push_back(working_prefix + node.prefix);
+      return;
+    }
+
+    auto& inner    = static_cast<const inner_t&>(node);
+    auto old_size  = working_prefix.size();
+    working_prefix += inner.prefix;
+
+    if (inner.value) words.push_back(working_prefix);
+
+    // visit children
+    detail::for_each_child(inner, [&](unsigned char c, const node_t& child) {
+      working_prefix.push_back(static_cast<char>(c));
+      get_words_impl_(words, working_prefix, child);
+      working_prefix.pop_back();
+    });
+
+    working_prefix.resize(old_size);
+  }
+};
+
+} // namespace impl4
+
+
+namespace impl5 {
+
+// impl3 with the virtual visitors swapped out for a node kind tag, traversal is
+// a plain loop switching on the tag which the compiler is free to inline
+namespace detail {
+
+enum class node_kind : unsigned char {
+  leaf,
+  branch,
+  branch_value
+};
+
+template <typename T>
+struct node_t;
+
+template <typename T>
+struct node_deleter {
+  void operator()(node_t<T>* node) const;
+};
+
+template <typename T>
+using node_ptr = std::unique_ptr<node_t<T>, node_deleter<T>>;
+
+template <typename T>
+struct node_t {
+  node_kind kind;
+
+  explicit node_t(node_kind kind) : kind{kind} { }
+};
+
+template <typename T>
+struct leaf_node_t : node_t<T> {
+  std::string data;
+  T value;
+
+  leaf_node_t(T value) : node_t<T>{node_kind::leaf}, value{std::move(value)} { }
+};
+
+template <typename T>
+struct branch_node_t : node_t<T> {
+  std::map<char, node_ptr<T>> children;
+
+  branch_node_t() : node_t<T>{node_kind::branch} { }
+
+protected:
+  explicit branch_node_t(node_kind kind) : node_t<T>{kind} { }
+};
+
+template <typename T>
+struct branch_value_node_t : branch_node_t<T> {
+  T value;
+
+  branch_value_node_t(T value) : branch_node_t<T>{node_kind::branch_value}, value{std::move(value)} { }
+};
+
+template <typename T>
+void node_deleter<T>::operator()(node_t<T>* node) const {
+  switch (node->kind) {
+  case node_kind::leaf:         delete static_cast<leaf_node_t<T>*>(node);         break;
+  case node_kind::branch:       delete static_cast<branch_node_t<T>*>(node);       break;
+  case node_kind::branch_value: delete static_cast<branch_value_node_t<T>*>(node); break;
+  }
+}
+
+template <typename T>
+std::pair<node_ptr<T>, branch_node_t<T>*> build_branches(std::string::const_iterator first,
+                                                         std::string::const_iterator last) {
+  auto root = new branch_node_t<T>;
+  node_ptr<T> owner{root};
+
+  auto parent = root;
+  for (; first != last; ++first) {
+    auto child(new branch_node_t<T>); // use raw ptr here to avoid temporary
+    parent->children[*first].reset(child);
+
+    parent = child; // move to child
+  }
+
+  return { std::move(owner), parent };
+}
+
+template <typename T>
+std::pair<node_ptr<T>, branch_value_node_t<T>*> build_branches_to_value(std::string::const_iterator first, std::string::const_iterator last, T value) {
+  if (first == last) {
+    auto root = new branch_value_node_t<T>{std::move(value)};
+    return { node_ptr<T>{root}, root };
+  }
+
+  auto short_last = std::prev(last);
+  auto branches   = build_branches<T>(first, short_last);
+
+  // the last element is where we want to place the value branch
+  // short_last is a valid iterator
+  auto child(new branch_value_node_t<T>{std::move(value)});
+  branches.second->children[*short_last].reset(child);
+
+  return { std::move(branches.first), child };
+}
+
+template <typename T>
+node_ptr<T> make_leaf(std::string::const_iterator first,
+                      std::string::const_iterator last,
+                      T value) {
+  auto l = new leaf_node_t<T>{std::move(value)};
+  l->data.append(first, last);
+  return node_ptr<T>{l};
+}
+
+template <typename T>
+node_ptr<T> breakup_leaf(leaf_node_t<T>& leaf,
+                         std::string::const_iterator common_first,
+                         std::string::const_iterator common_second,
+                         T value) {
+  // first we want to find where the common prefixes end
+  auto first1 = std::cbegin(leaf.data);
+  auto last1  = std::cend(leaf.data);
+  auto first2 = common_first;
+  auto last2  = common_second;
+  // once structured bindings are stable across all platforms, std::tie can go away
+  std::tie(first1, first2) = simd::mismatch(first1, last1, first2, last2);
+
+  // base case (adding same word)
+  if (first1 == last1 && first2 == last2) {
+    return nullptr;
+  }
+
+  // basic first case: we consumed all of the leaf data, so let's return a branch leading down to this
+  //                   node where we split
+  if (first1 == last1) {
+    // *_to_value annotates the branch that it is a word
+    auto root_leaf = build_branches_to_value(std::cbegin(leaf.data), last1, std::move(leaf.value));
+
+    // now fill in the remaining leaf
+    // we use std::next here because the leaf contains data under it, not its own char as the first char
+    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2, std::move(value));
+
+    return std::move(root_leaf.first);
+  }
+
+  // case 2: we exhausted the word data.  Split up to the prefix part and construct a new leaf rooted at the end of the first prefix match
+  if (first2 == last2) {
+    // *_to_value annotates this branch that it's a value at the end
+    auto root_leaf = build_branches_to_value(common_first, last2, std::move(value));
+
+    // now fill in the remaining leaf
+    // we use std::next here because the leaf contains data under it, not its own char as the first char
+    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1, std::move(leaf.value));
+
+    return std::move(root_leaf.first);
+  }
+
+  // case 3: we've exhausted neither, build branches for both paths and construct two leaf nodes
+  auto root_leaf = build_branches<T>(std::cbegin(leaf.data), first1); // first1 is where the range differs
+
+  // leaf for the old leaf
+  {
+    // we use std::next here because the leaf contains data under it, not its own char as the first char
+    root_leaf.second->children[*first1] = make_leaf(std::next(first1), last1, std::move(leaf.value));
+  }
+
+  // leaf for the new incoming word
+  {
+    // we use std::next here because the leaf contains data under it, not its own char as the first char
+    root_leaf.second->children[*first2] = make_leaf(std::next(first2), last2, std::move(value));
+  }
+
+  return std::move(root_leaf.first);
+}
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  typedef detail::node_t<T>              node_t;
+  typedef detail::leaf_node_t<T>         leaf_node_t;
+  typedef detail::branch_node_t<T>       branch_node_t;
+  typedef detail::branch_value_node_t<T> branch_value_node_t;
+  typedef detail::node_kind              node_kind;
+
+  branch_node_t root_;
+public:
+  trie()  = default;
+  ~trie() = default;
+
+  void insert(const std::string& word, T value) {
+    if (word.empty()) return;
+
+    auto first = std::begin(word);
+    auto last  = std::end(word);
+
+    auto next = root_.children.find(*first);
+    if (next == std::end(root_.children)) {
+      // new leaf node
+      // we use std::next here because the leaf contains data under it, not its own char as the first char
+      root_.children[*first] = detail::make_leaf(std::next(first), last, std::move(value));
+      return;
+    }
+
+    ++first; // move forward
+    auto ref = &next->second;
+    for (;;) {
+      switch ((*ref)->kind) {
+      case node_kind::leaf: {
+        // we need to break this leaf apart
+        auto new_node = detail::breakup_leaf(static_cast<leaf_node_t&>(**ref), first, last, std::move(value));
+        if (new_node) {
+          *ref = std::move(new_node);
+        }
+        // otherwise the prefixes matched and no change needs to be made to the tree
+        return;
+      }
+      case node_kind::branch:
+      case node_kind::branch_value: {
+        auto& branch = static_cast<branch_node_t&>(**ref);
+        if (first == last) {
+          if (branch.kind == node_kind::branch) {
+            // gut this branch and make it a branch value node
+            auto new_branch = new branch_value_node_t{std::move(value)};
+            new_branch->children = std::move(branch.children);
+            ref->reset(new_branch);
+          }
+          return;
+        }
+
+        auto child = branch.children.find(*first);
+        if (child == std::end(branch.children)) {
+          // found place to insert leaf
+          branch.children[*first] = detail::make_leaf(std::next(first), last, std::move(value));
+          return;
+        }
+
+        // recurse down the branch
+        ++first; // move forward
+        ref = &child->second;
+        break;
+      }
+      }
+    }
+  }
+
+  bool exists(const std::string& word) const {
+    return lookup_node_(std::begin(word), std::end(word)) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto node = lookup_node_(std::begin(word), std::end(word));
+
+    if (!node) return false;
+
+    value = node->kind == node_kind::leaf ? static_cast<const leaf_node_t*>(node)->value
+                                          : static_cast<const branch_value_node_t*>(node)->value;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good until the trie is changed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    auto prefix_end = std::begin(prefix);
+    auto node = lookup_node_prefix_(std::begin(prefix), std::end(prefix), prefix_end);
+
+    if (!node) return false;
+
+    // create the matching word based on where the prefix ended
+    // this is necessary since the prefix could land somewhere in
+    // a leaf node.  We only want to start with the characters from
+    // branches leading down to a leaf.
+    matching_word = std::string(std::begin(prefix), prefix_end);
+
+    // find the first word we can match (alphabetical order)
+    while (node->kind == node_kind::branch) {
+      auto& branch = static_cast<const branch_node_t&>(*node);
+      auto next = std::begin(branch.children);
+      assert(next != std::end(branch.children) && "prog error");
+      matching_word.push_back(next->first);
+      node = next->second.get();
+    }
+
+    if (node->kind == node_kind::leaf) {
+      matching_word.append(static_cast<const leaf_node_t*>(node)->data); // just append the whole node
+    }
+
+    return true;
+  }
+
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, root_);
+
+    return ret;
+  }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_t*               node  = nullptr; // null once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.node = &root_;
+    return state;
+  }
+
+  static bool batch_step_(batch_state_t& state) {
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    if (node->kind == node_kind::leaf) {
+      // compare the remaining string to the leaf value
+      auto& leaf = static_cast<const leaf_node_t&>(*node);
+      if (simd::equal(std::begin(leaf.data), std::end(leaf.data), state.first, state.last)) {
+        state.value = &leaf.value;
+      }
+      return false;
+    }
+
+    if (state.first == state.last) {
+      // only branches carrying a value are words
+      if (node->kind == node_kind::branch_value) {
+        state.value = &static_cast<const branch_value_node_t*>(node)->value;
+      }
+      return false;
+    }
+
+    auto& children = static_cast<const branch_node_t*>(node)->children;
+    auto next = children.find(*state.first);
+    if (next == std::end(children)) return false;
+
+    ++state.first; // advance
+    state.node = next->second.get();
+    util::prefetch(state.node);
+    return true;
+  }
+
+  void get_words_impl_(std::vector<std::string>& words, std::string& working_prefix, const node_t& node) const {
+    if (node.kind == node_kind::leaf) {
+      words.push_back(working_prefix + static_cast<const leaf_node_t&>(node).data);
+      return;
+    }
+
+    if (node.kind == node_kind::branch_value) words.push_back(working_prefix);
+
+    // visit children
+    for (const auto& child : static_cast<const branch_node_t&>(node).children) {
+      working_prefix.push_back(child.first);
+      get_words_impl_(words, working_prefix, *child.second);
+      working_prefix.pop_back();
+    }
+  }
+
+  const node_t* lookup_node_(std::string::const_iterator first, std::string::const_iterator last) const {
+    if (first == last) return nullptr;
+
+    const node_t* node = &root_;
+    while (node->kind != node_kind::leaf) {
+      if (first == last) {
+        // only branches carrying a value are words
+        return node->kind == node_kind::branch_value ? node : nullptr;
+      }
+
+      auto& children = static_cast<const branch_node_t*>(node)->children;
+      auto next = children.find(*first);
+      if (next == std::end(children)) {
+        // not found
+        return nullptr;
+      }
+
+      ++first; // advance
+      node = next->second.get();
+    }
+
+    // compare the remaining string to the leaf value
+    auto& data = static_cast<const leaf_node_t*>(node)->data;
+    if (simd::equal(std::begin(data), std::end(data), first, last)) {
+      return node;
+    }
+
+    return nullptr;
+  }
+
+  const node_t* lookup_node_prefix_(std::string::const_iterator first, std::string::const_iterator last, std::string::const_iterator& prefix_end) const {
+    if (first == last) return nullptr;
+
+    const node_t* node = &root_;
+    while (node->kind != node_kind::leaf) {
+      if (first == last) {
+        // best match
+        prefix_end = first;
+        return node;
+      }
+
+      auto& children = static_cast<const branch_node_t*>(node)->children;
+      auto next = children.find(*first);
+      if (next == std::end(children)) {
+        // not found
+        return nullptr;
+      }
+
+      ++first; // advance
+      node = next->second.get();
+    }
+
+    // compare to the end of this prefix
+    auto& data = static_cast<const leaf_node_t*>(node)->data;
+    if (simd::mismatch(first, last, std::begin(data), std::end(data)).first == last) {
+      prefix_end = first;
+      return node;
+    }
+
+    return nullptr;
+  }
+};
+
+} // namespace impl5
+
+
+namespace impl6 {
+
+// double-array trie: the key set is compiled into two parallel arrays, a transition from
+// state s on code c lands on t = base[s] + c and is only real if check[t] == s.  A state
+// left leading to a single key stops branching, the rest of that key goes in a shared tail
+// and the state becomes a leaf.  Read only, built from sorted (word, value) pairs or from an
+// impl3 trie
+namespace detail {
+
+// code 0 ends a word which other words carry on from, chars are shifted up past it
+constexpr std::int32_t end_code   = 0;
+constexpr std::int32_t code_count = 257;
+
+inline std::int32_t code(char c) {
+  return static_cast<unsigned char>(c) + 1;
+}
+
+struct leaf_t {
+  std::uint32_t tail_first;
+  std::uint32_t tail_size;
+};
+
+// the free slots in order, only kept while building.  A slot which keeps failing as the
+// start of a base drops out so the search doesn't crawl over it forever
+struct free_list_t {
+  static constexpr std::uint8_t max_tries = 16;
+  static constexpr std::uint8_t dropped   = 0xff;
+
+  std::vector<std::int32_t> next;
+  std::vector<std::int32_t> prev;
+  std::vector<std::uint8_t> tries;
+  std::int32_t              head = -1;
+  std::int32_t              tail = -1;
+
+  // slots [first, last) are new and free
+  void append(std::size_t first, std::size_t last) {
+    next.resize(last, -1);
+    prev.resize(last, -1);
+    tries.resize(last, 0);
+    for (auto i = static_cast<std::int32_t>(first); i != static_cast<std::int32_t>(last); ++i) {
+      prev[i] = tail;
+      if (tail == -1) head = i;
+      else next[tail] = i;
+      tail = i;
+    }
+  }
+
+  void remove(std::int32_t i) {
+    if (tries[i] == dropped) return;
+    tries[i] = dropped;
+
+    if (prev[i] == -1) head = next[i];
+    else next[prev[i]] = next[i];
+    if (next[i] == -1) tail = prev[i];
+    else prev[next[i]] = prev[i];
+  }
+};
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  typedef detail::leaf_t      leaf_t;
+  typedef detail::free_list_t free_list_t;
+
+  // (word, value) while building
+  typedef std::pair<const std::string*, const T*> key_t;
+
+  // base_[s] >= 0 is where the children of s start, base_[s] < 0 makes s leaf -base_[s] - 1
+  std::vector<std::int32_t> base_;
+  // check_[t] is the state t hangs off, -1 while t is free
+  std::vector<std::int32_t> check_;
+  std::vector<leaf_t>       leaves_;
+  std::vector<T>            values_; // one per leaf
+  std::string               tail_;
+public:
+  // every state gets a full code_count slots after its base so lookups never need a bounds check
+  trie() : base_(detail::code_count, 0), check_(detail::code_count, -1) { }
+
+  // builds from (word, value) pairs sorted by word.  Duplicate words keep their first value
+  template <typename ForwardIt>
+  trie(sorted_input_t, ForwardIt first, ForwardIt last) : trie() {
+    assert(std::is_sorted(first, last, [](const auto& a, const auto& b) { return a.first < b.first; }) &&
+           "input must be sorted");
+
+    std::vector<key_t> keys;
+    for (; first != last; ++first) {
+      // the empty word is never stored
+      if (first->first.empty()) continue;
+      if (!keys.empty() && *keys.back().first == first->first) continue;
+
+      keys.emplace_back(&first->first, &first->second);
+    }
+    build_(keys);
+  }
+
+  template <typename Alloc, typename Augment>
+  explicit trie(const impl3::trie<T, Alloc, Augment>& source) : trie() {
+    std::vector<std::string> words;
+    std::vector<T>           values;
+    for (auto it = source.begin(); it != source.end(); ++it) {
+      words.push_back(*it);
+      values.push_back(it.value());
+    }
+
+    std::vector<key_t> keys;
+    keys.reserve(words.size());
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      keys.emplace_back(&words[i], &values[i]);
+    }
+    build_(keys);
+  }
+
+  bool exists(const std::string& word) const {
+    return find_(word) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto leaf = find_(word);
+    if (!leaf) return false;
+
+    value = values_[static_cast<std::size_t>(leaf - leaves_.data())];
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch with the base
+  // of the next state of each lookup prefetched
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good as long as the trie is
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    auto first = std::begin(prefix);
+    auto last  = std::end(prefix);
+
+    std::int32_t s = 0;
+    for (; first != last; ++first) {
+      auto base = base_[s];
+      if (base < 0) {
+        // the prefix has to fit in the tail
+        auto& leaf      = leaves_[static_cast<std::size_t>(-base - 1)];
+        auto  tail      = tail_.data() + leaf.tail_first;
+        auto  remaining = static_cast<std::size_t>(std::distance(first, last));
+        if (remaining > leaf.tail_size || !simd::equal(first, last, tail, tail + remaining)) return false;
+
+        matching_word.assign(std::begin(prefix), first);
+        matching_word.append(tail, leaf.tail_size);
+        return true;
+      }
+
+      auto t = base + detail::code(*first);
+      if (check_[t] != s) return false;
+      s = t;
+    }
+
+    // find the first word we can match, the smallest code first
+    matching_word = prefix;
+    for (;;) {
+      auto base = base_[s];
+      if (base < 0) {
+        auto& leaf = leaves_[static_cast<std::size_t>(-base - 1)];
+        matching_word.append(tail_, leaf.tail_first, leaf.tail_size);
+        return true;
+      }
+
+      auto c = detail::end_code;
+      while (check_[base + c] != s) ++c;
+
+      if (c != detail::end_code) matching_word.push_back(static_cast<char>(c - 1));
+      s = base + c;
+    }
+  }
+
+  // the words come out in unsigned char order
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    if (!leaves_.empty()) get_words_impl_(ret, working_prefix, 0);
+
+    return ret;
+  }
+
+  std::size_t size() const { return leaves_.size(); }
+
+  // length of the base and check arrays
+  std::size_t state_count() const { return base_.size(); }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    std::int32_t                s     = -1; // -1 once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.s = 0;
+    return state;
+  }
+
+  // one transition of find_
+  bool batch_step_(batch_state_t& state) const {
+    if (state.s < 0) return false;
+
+    auto s  = state.s;
+    state.s = -1;
+
+    auto base = base_[s];
+    if (base < 0) {
+      // compare the rest of the word to the tail
+      auto  index = static_cast<std::size_t>(-base - 1);
+      auto& leaf  = leaves_[index];
+      auto  tail  = tail_.data() + leaf.tail_first;
+      if (simd::equal(state.first, state.last, tail, tail + leaf.tail_size)) state.value = &values_[index];
+      return false;
+    }
+
+    // only a word ending here leads on to its leaf
+    auto t = base + (state.first == state.last ? detail::end_code : detail::code(*state.first));
+    if (check_[t] != s) return false;
+
+    if (state.first != state.last) ++state.first; // advance
+    state.s = t;
+    util::prefetch(&base_[t]);
+    return true;
+  }
+
+  void build_(const std::vector<key_t>& keys) {
+    if (keys.empty()) return;
+
+    leaves_.reserve(keys.size());
+    values_.reserve(keys.size());
+
+    free_list_t free_list;
+    free_list.append(1, check_.size()); // the root is never free
+    build_state_(free_list, 0, keys, 0, keys.size(), 0);
+
+    // only the slots in use plus the room for a full set of codes after the last base
+    auto used = check_.size();
+    while (used > 1 && check_[used - 1] == -1) --used;
+    base_.resize(used + detail::code_count, 0);
+    check_.resize(used + detail::code_count, -1);
+    base_.shrink_to_fit();
+    check_.shrink_to_fit();
+  }
+
+  // state s holds keys [first, last), which all share their first depth chars
+  void build_state_(free_list_t& free_list, std::int32_t s, const std::vector<key_t>& keys,
+                    std::size_t first, std::size_t last, std::size_t depth) {
+    if (last - first == 1) {
+      // only one key left, the rest of it goes in the tail
+      auto& word = *keys[first].first;
+      base_[s] = -static_cast<std::int32_t>(leaves_.size()) - 1;
+      leaves_.push_back({ static_cast<std::uint32_t>(tail_.size()), static_cast<std::uint32_t>(word.size() - depth) });
+      tail_.append(word, depth, std::string::npos);
+      values_.push_back(*keys[first].second);
+      return;
+    }
+
+    // the codes out of s and where the keys for each start
+    std::vector<std::pair<std::int32_t, std::size_t>> children;
+    for (auto i = first; i != last;) {
+      auto& word = *keys[i].first;
+      auto  c    = word.size() == depth ? detail::end_code : detail::code(word[depth]);
+      children.emplace_back(c, i);
+
+      // only one word can end here, the rest carry on with their char
+      for (++i; c != detail::end_code && i != last && detail::code((*keys[i].first)[depth]) == c; ++i) { }
+    }
+
+    auto base = find_base_(free_list, children);
+    base_[s]  = base;
+    // claim every slot before going down so the children can't take each other's
+    for (auto& child : children) {
+      check_[base + child.first] = s;
+      free_list.remove(base + child.first);
+    }
+
+    for (std::size_t i = 0; i != children.size(); ++i) {
+      auto child_last  = i + 1 == children.size() ? last : children[i + 1].second;
+      auto child_depth = children[i].first == detail::end_code ? depth : depth + 1;
+      build_state_(free_list, base + children[i].first, keys, children[i].second, child_last, child_depth);
+    }
+  }
+
+  // the first base where every one of the codes lands on a free slot
+  std::int32_t find_base_(free_list_t& free_list, const std::vector<std::pair<std::int32_t, std::size_t>>& children) {
+    auto min_code = children.front().first;
+    for (auto& child : children) {
+      min_code = std::min(min_code, child.first);
+    }
+
+    // the slot for min_code is always a free one so only those need trying
+    for (auto pos = free_list.head;;) {
+      if (pos == -1) {
+        grow_(free_list, check_.size() * 2);
+        pos = free_list.head;
+        continue;
+      }
+
+      auto base = pos - min_code;
+      if (base >= 0) {
+        if (static_cast<std::size_t>(base + detail::code_count) > check_.size()) {
+          grow_(free_list, std::max(check_.size() * 2, static_cast<std::size_t>(base + detail::code_count)));
+        }
+
+        auto free = std::all_of(std::begin(children), std::end(children),
+          [this, base](const std::pair<std::int32_t, std::size_t>& child) { return check_[base + child.first] == -1; });
+        if (free) return base;
+      }
+
+      auto next = free_list.next[pos];
+      if (++free_list.tries[pos] == free_list_t::max_tries) free_list.remove(pos);
+      pos = next;
+    }
+  }
+
+  void grow_(free_list_t& free_list, std::size_t size) {
+    auto old_size = check_.size();
+    base_.resize(size, 0);
+    check_.resize(size, -1);
+    free_list.append(old_size, size);
+  }
+
+  // the leaf holding 'word', nullptr if it isn't there
+  const leaf_t* find_(const std::string& word) const {
+    if (word.empty()) return nullptr;
+
+    auto first = std::begin(word);
+    auto last  = std::end(word);
+
+    std::int32_t s = 0;
+    for (;;) {
+      auto base = base_[s];
+      if (base < 0) {
+        // compare the rest of the word to the tail
+        auto& leaf = leaves_[static_cast<std::size_t>(-base - 1)];
+        auto  tail = tail_.data() + leaf.tail_first;
+        if (!simd::equal(first, last, tail, tail + leaf.tail_size)) {
+          return nullptr;
+        }
+        return &leaf;
+      }
+
+      if (first == last) {
+        // only a word ending here leads on to its leaf
+        auto t = base + detail::end_code;
+        if (check_[t] != s) return nullptr;
+        s = t;
+        continue;
+      }
+
+      auto t = base + detail::code(*first);
+      if (check_[t] != s) return nullptr;
+
+      ++first; // advance
+      s = t;
+    }
+  }
+
+  void get_words_impl_(std::vector<std::string>& words, std::string& prefix, std::int32_t s) const {
+    auto base = base_[s];
+    if (base < 0) {
+      auto& leaf = leaves_[static_cast<std::size_t>(-base - 1)];
+      words.push_back(prefix);
+      words.back().append(tail_, leaf.tail_first, leaf.tail_size);
+      return;
+    }
+
+    for (auto c = detail::end_code; c != detail::code_count; ++c) {
+      if (check_[base + c] != s) continue;
+
+      if (c != detail::end_code) prefix.push_back(static_cast<char>(c - 1));
+      get_words_impl_(words, prefix, base + c);
+      if (c != detail::end_code) prefix.pop_back();
+    }
+  }
+};
+
+} // namespace impl6
+
+
+namespace impl7 {
+
+// LOUDS (level order unary degree sequence) trie: the shape is a bit string where every
+// node, in breadth first order, writes a 1 per child followed by a 0.  The children of
+// node i sit right after the i'th 0 and get consecutive ids, so walking down is a select
+// over the bits instead of a pointer.  Labels, the word ending bits and the values are
+// flat arrays in the same node order, a node costs a byte and a few bits.  Read only,
+// built from sorted (word, value) pairs or from an impl3 trie
+namespace detail {
+
+// bits with rank and select support, push_back everything then index() once
+class bit_vector_t {
+  static constexpr std::size_t block_bits      = 512;
+  static constexpr std::size_t words_per_block = block_bits / 64;
+
+  std::vector<std::uint64_t> words_;
+  std::vector<std::uint32_t> ranks_;        // the ones before every block, plus one past the end
+  std::vector<std::uint32_t> zero_samples_; // the block holding every block_bits'th zero
+  std::size_t                size_ = 0;
+public:
+  void push_back(bool bit) {
+    if (size_ % 64 == 0) words_.push_back(0);
+    if (bit) words_.back() |= std::uint64_t{1} << (size_ % 64);
+    ++size_;
+  }
+
+  bool operator[](std::size_t pos) const {
+    return (words_[pos / 64] >> (pos % 64)) & 1;
+  }
+
+  std::size_t size() const { return size_; }
+
+  // brings in the word holding bit 'pos'
+  void prefetch(std::size_t pos) const {
+    if (pos < size_) util::prefetch(&words_[pos / 64]);
+  }
+
+  std::size_t size_in_bytes() const {
+    return words_.size() * sizeof(std::uint64_t) +
+      (ranks_.size() + zero_samples_.size()) * sizeof(std::uint32_t);
+  }
+
+  void index() {
+    ranks_.clear();
+    zero_samples_.clear();
+
+    std::uint32_t ones = 0;
+    for (std::size_t first = 0; first < words_.size(); first += words_per_block) {
+      ranks_.push_back(ones);
+      auto last = std::min(first + words_per_block, words_.size());
+      for (auto w = first; w != last; ++w) {
+        ones += util::popcount(words_[w]);
+      }
+    }
+    ranks_.push_back(ones);
+
+    for (std::size_t block = 0; block + 1 < ranks_.size(); ++block) {
+      while (zero_samples_.size() * block_bits < zeros_before_(block + 1)) {
+        zero_samples_.push_back(static_cast<std::uint32_t>(block));
+      }
+    }
+
+    words_.shrink_to_fit();
+  }
+
+  // the ones in [0, pos)
+  std::size_t rank1(std::size_t pos) const {
+    auto block = pos / block_bits;
+    std::size_t ret = ranks_[block];
+    for (auto w = block * words_per_block; w != pos / 64; ++w) {
+      ret += util::popcount(words_[w]);
+    }
+    if (pos % 64 != 0) ret += util::popcount(words_[pos / 64] & ((std::uint64_t{1} << (pos % 64)) - 1));
+    return ret;
+  }
+
+  // where the k'th zero is, counting from 1
+  std::size_t select0(std::size_t k) const {
+    std::size_t block = zero_samples_[(k - 1) / block_bits];
+    while (block + 2 < ranks_.size() && zeros_before_(block + 1) < k) ++block;
+
+    k -= zeros_before_(block);
+    for (auto w = block * words_per_block;; ++w) {
+      std::size_t zeros = 64 - util::popcount(words_[w]);
+      if (k <= zeros) return w * 64 + select_in_word_(~words_[w], k);
+      k -= zeros;
+    }
+  }
+
+  // the first zero at or after pos, there has to be one
+  std::size_t next_zero(std::size_t pos) const {
+    auto w    = pos / 64;
+    auto word = ~words_[w] & (~std::uint64_t{0} << (pos % 64));
+    while (word == 0) {
+      word = ~words_[++w];
+    }
+    return w * 64 + util::lowest_bit(word);
+  }
+
+private:
+  // the bits past size_ in the last word count as zeros, nothing asks for those
+  std::size_t zeros_before_(std::size_t block) const {
+    return block * block_bits - ranks_[block];
+  }
+
+  static std::size_t select_in_word_(std::uint64_t word, std::size_t k) {
+    for (; k != 1; --k) {
+      word &= word - 1; // drop the lowest set bit
+    }
+    return util::lowest_bit(word);
+  }
+};
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  // (word, value) while building
+  typedef std::pair<const std::string*, const T*> key_t;
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  detail::bit_vector_t louds_;    // a 1 per child then a 0, for every node in breadth first order
+  detail::bit_vector_t terminal_; // set for the nodes which end a word
+  std::string          labels_;   // the char leading into every node but the root
+  std::vector<T>       values_;   // one per terminal node, in node order
+public:
+  trie() { build_({}); }
+
+  // builds from (word, value) pairs sorted by word.  Duplicate words keep their first value
+  template <typename ForwardIt>
+  trie(sorted_input_t, ForwardIt first, ForwardIt last) {
+    assert(std::is_sorted(first, last, [](const auto& a, const auto& b) { return a.first < b.first; }) &&
+           "input must be sorted");
+
+    std::vector<key_t> keys;
+    for (; first != last; ++first) {
+      // the empty word is never stored
+      if (first->first.empty()) continue;
+      if (!keys.empty() && *keys.back().first == first->first) continue;
+
+      keys.emplace_back(&first->first, &first->second);
+    }
+    build_(keys);
+  }
+
+  template <typename Alloc, typename Augment>
+  explicit trie(const impl3::trie<T, Alloc, Augment>& source) {
+    std::vector<std::string> words;
+    std::vector<T>           values;
+    for (auto it = source.begin(); it != source.end(); ++it) {
+      words.push_back(*it);
+      values.push_back(it.value());
+    }
+
+    std::vector<key_t> keys;
+    keys.reserve(words.size());
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      keys.emplace_back(&words[i], &values[i]);
+    }
+    build_(keys);
+  }
+
+  bool exists(const std::string& word) const {
+    return find_(word) != npos;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto node = find_(word);
+    if (node == npos) return false;
+
+    value = values_[terminal_.rank1(node)];
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch so the select
+  // of one lookup overlaps with the others
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good as long as the trie is
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    std::size_t node = 0;
+    for (char c : prefix) {
+      node = child_(node, c);
+      if (node == npos) return false;
+    }
+
+    // find the first word we can match, always the smallest label
+    matching_word = prefix;
+    while (!terminal_[node]) {
+      auto first = first_child_(node);
+      matching_word.push_back(labels_[first - 1]);
+      node = first;
+    }
+
+    return true;
+  }
+
+  // the words come out in unsigned char order
+  std::vector<std::string> get_words() const {
+    return get_words(std::string{});
+  }
+
+  // the words starting with 'prefix', in the same order.  Only the nodes under the prefix
+  // are visited, so listing a small part of a large dictionary stays cheap
+  std::vector<std::string> get_words(const std::string& prefix) const {
+    std::vector<std::string> ret;
+
+    std::size_t node = 0;
+    for (char c : prefix) {
+      node = child_(node, c);
+      if (node == npos) return ret;
+    }
+
+    std::string working_prefix = prefix;
+    get_words_impl_(ret, working_prefix, node);
+
+    return ret;
+  }
+
+  std::size_t size() const { return values_.size(); }
+
+  std::size_t node_count() const { return terminal_.size(); }
+
+  // everything the trie holds on to
+  std::size_t size_in_bytes() const {
+    return louds_.size_in_bytes() + terminal_.size_in_bytes() + labels_.capacity() + values_.capacity() * sizeof(T);
+  }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    std::size_t                 node  = npos; // npos once the lookup is done
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  static batch_state_t batch_start_(const std::string& word) {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.node = 0;
+    return state;
+  }
+
+  // one child_ of find_
+  bool batch_step_(batch_state_t& state) const {
+    if (state.node == npos) return false;
+
+    auto node  = state.node;
+    state.node = npos;
+
+    if (state.first == state.last) {
+      if (terminal_[node]) state.value = &values_[terminal_.rank1(node)];
+      return false;
+    }
+
+    node = child_(node, *state.first);
+    if (node == npos) return false;
+
+    ++state.first; // advance
+    state.node = node;
+    // the node'th zero, where its children start, is about twice as far in as the node
+    louds_.prefetch(2 * node);
+    return true;
+  }
+
+  void build_(const std::vector<key_t>& keys) {
+    // one level at a time, the keys under a node share their first depth chars
+    struct range_t {
+      std::size_t first;
+      std::size_t last;
+    };
+    struct group_t {
+      char        label;
+      std::size_t first;
+      std::size_t last;
+    };
+
+    std::vector<range_t> level{ { 0, keys.size() } };
+    std::vector<range_t> next_level;
+    std::vector<group_t> groups;
+    for (std::size_t depth = 0; !level.empty(); ++depth) {
+      for (auto range : level) {
+        auto word_ends = range.first != range.last && keys[range.first].first->size() == depth;
+        terminal_.push_back(word_ends);
+        if (word_ends) {
+          values_.push_back(*keys[range.first].second);
+          ++range.first;
+        }
+
+        groups.clear();
+        for (auto i = range.first; i != range.last;) {
+          auto label = (*keys[i].first)[depth];
+          auto start = i;
+          for (++i; i != range.last && (*keys[i].first)[depth] == label; ++i) { }
+          groups.push_back({ label, start, i });
+        }
+        // children go in unsigned order whichever order the keys came in
+        std::sort(std::begin(groups), std::end(groups), [](const group_t& a, const group_t& b) {
+          return static_cast<unsigned char>(a.label) < static_cast<unsigned char>(b.label);
+        });
+
+        for (auto& group : groups) {
+          louds_.push_back(true);
+          labels_.push_back(group.label);
+          next_level.push_back({ group.first, group.last });
+        }
+        louds_.push_back(false);
+      }
+
+      level.swap(next_level);
+      next_level.clear();
+    }
+
+    louds_.index();
+    terminal_.index();
+    labels_.shrink_to_fit();
+    values_.shrink_to_fit();
+  }
+
+  // the children of node i are the ones between the i'th zero and the next, the one before
+  // the first of them is child number start - i overall, which makes it node start - i + 1
+  std::size_t children_start_(std::size_t node) const {
+    return node == 0 ? 0 : louds_.select0(node) + 1;
+  }
+
+  std::size_t first_child_(std::size_t node) const {
+    return children_start_(node) - node + 1;
+  }
+
+  std::size_t child_(std::size_t node, char c) const {
+    auto start = children_start_(node);
+    auto end   = louds_.next_zero(start);
+
+    auto first = std::begin(labels_) + static_cast<std::ptrdiff_t>(start - node);
+    auto last  = std::begin(labels_) + static_cast<std::ptrdiff_t>(end - node);
+    auto found = std::lower_bound(first, last, c, [](char a, char b) {
+      return static_cast<unsigned char>(a) < static_cast<unsigned char>(b);
+    });
+    if (found == last || *found != c) return npos;
+
+    return static_cast<std::size_t>(found - std::begin(labels_)) + 1;
+  }
+
+  std::size_t find_(const std::string& word) const {
+    std::size_t node = 0;
+    for (char c : word) {
+      node = child_(node, c);
+      if (node == npos) return npos;
+    }
+
+    return terminal_[node] ? node : npos;
+  }
+
+  void get_words_impl_(std::vector<std::string>& words, std::string& prefix, std::size_t node) const {
+    if (terminal_[node]) words.push_back(prefix);
+
+    auto start = children_start_(node);
+    auto end   = louds_.next_zero(start);
+    for (auto child = start - node + 1; child != end - node + 1; ++child) {
+      prefix.push_back(labels_[child - 1]);
+      get_words_impl_(words, prefix, child);
+      prefix.pop_back();
+    }
+  }
+};
+
+} // namespace impl7
+
+
+namespace impl8 {
+
+// minimal acyclic automaton (DAWG): like a trie but states with the same future are merged,
+// so common suffixes ("-ing", "-tion") are stored once just like common prefixes.  Built
+// from sorted keys with incremental minimization: once a word is done with a state (the
+// next word branches off above it) nothing can change below it any more, so it is swapped
+// for an equal state already seen or registered as a new one.  Values can't sit on merged
+// states, every transition instead carries how many words it skips over, summing them along
+// the path of a word gives its position in the sorted key set and so its slot in a packed
+// value array (a transducer with counting outputs).  Read only
+namespace detail {
+
+struct build_state_t {
+  std::vector<std::pair<char, std::uint32_t>> transitions;
+  bool                                        final = false;
+};
+
+// states in the register are looked up by what they look like, not their id
+struct state_hash_t {
+  const std::vector<build_state_t>* states;
+
+  std::size_t operator()(std::uint32_t id) const {
+    auto& state = (*states)[id];
+    std::size_t ret = state.final;
+    for (auto& transition : state.transitions) {
+      ret = ret * 31 + static_cast<unsigned char>(transition.first);
+      ret = ret * 31 + transition.second;
+    }
+    return ret;
+  }
+};
+
+struct state_equal_t {
+  const std::vector<build_state_t>* states;
+
+  bool operator()(std::uint32_t a, std::uint32_t b) const {
+    auto& left  = (*states)[a];
+    auto& right = (*states)[b];
+    return left.final == right.final && left.transitions == right.transitions;
+  }
+};
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  // (word, value) while building
+  typedef std::pair<const std::string*, const T*> key_t;
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  // the transitions of state s are [first_[s], first_[s + 1]), sorted by unsigned label
+  std::vector<std::uint32_t> first_;
+  std::vector<bool>          final_;
+  std::string                labels_;
+  std::vector<std::uint32_t> targets_;
+  std::vector<std::uint32_t> outputs_; // the words which sort before the ones down this transition
+  std::vector<T>             values_;  // in sorted key order
+public:
+  trie() { build_({}); }
+
+  // builds from (word, value) pairs sorted by word.  Duplicate words keep their first value
+  template <typename ForwardIt>
+  trie(sorted_input_t, ForwardIt first, ForwardIt last) {
+    assert(std::is_sorted(first, last, [](const auto& a, const auto& b) { return a.first < b.first; }) &&
+           "input must be sorted");
+
+    std::vector<key_t> keys;
+    for (; first != last; ++first) {
+      // the empty word is never stored
+      if (first->first.empty()) continue;
+      if (!keys.empty() && *keys.back().first == first->first) continue;
+
+      keys.emplace_back(&first->first, &first->second);
+    }
+    build_(keys);
+  }
+
+  template <typename Alloc, typename Augment>
+  explicit trie(const impl3::trie<T, Alloc, Augment>& source) {
+    std::vector<std::pair<std::string, T>> pairs;
+    for (auto it = source.begin(); it != source.end(); ++it) {
+      pairs.emplace_back(*it, it.value());
+    }
+    // impl3 walks its children in signed char order
+    std::sort(std::begin(pairs), std::end(pairs), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<key_t> keys;
+    keys.reserve(pairs.size());
+    for (auto& pair : pairs) {
+      keys.emplace_back(&pair.first, &pair.second);
+    }
+    build_(keys);
+  }
+
+  bool exists(const std::string& word) const {
+    return find_(word) != npos;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto index = find_(word);
+    if (index == npos) return false;
+
+    value = values_[index];
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch with the
+  // transitions of the next state of each lookup prefetched
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good as long as the trie is
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [](const std::string& word) { return batch_start_(word); },
+      [this](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    std::uint32_t state = 0;
+    for (char c : prefix) {
+      auto transition = transition_(state, c);
+      if (transition == npos) return false;
+      state = targets_[transition];
+    }
+
+    // find the first word we can match, always the smallest label
+    matching_word = prefix;
+    while (!final_[state]) {
+      matching_word.push_back(labels_[first_[state]]);
+      state = targets_[first_[state]];
+    }
+
+    return true;
+  }
+
+  // the words come out in unsigned char order
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, 0);
+
+    return ret;
+  }
+
+  std::size_t size() const { return values_.size(); }
+
+  std::size_t state_count() const { return final_.size(); }
+
+  std::size_t transition_count() const { return labels_.size(); }
+
+  // everything the trie holds on to
+  std::size_t size_in_bytes() const {
+    return first_.capacity() * sizeof(std::uint32_t) + final_.capacity() / 8 + labels_.capacity() +
+      (targets_.capacity() + outputs_.capacity()) * sizeof(std::uint32_t) + values_.capacity() * sizeof(T);
+  }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    std::size_t                 state = npos; // npos once the lookup is done
+    std::size_t                 index = 0;    // the outputs summed so far
+    std::string::const_iterator first;
+    std::string::const_iterator last;
+    const T*                    value = nullptr;
+  };
+
+  static batch_state_t batch_start_(const std::string& word) {
+    batch_state_t state;
+    state.first = std::begin(word);
+    state.last  = std::end(word);
+    if (!word.empty()) state.state = 0;
+    return state;
+  }
+
+  // one transition of find_
+  bool batch_step_(batch_state_t& state) const {
+    if (state.state == npos) return false;
+
+    auto current = static_cast<std::uint32_t>(state.state);
+    state.state  = npos;
+
+    if (state.first == state.last) {
+      if (final_[current]) state.value = &values_[state.index];
+      return false;
+    }
+
+    auto transition = transition_(current, *state.first);
+    if (transition == npos) return false;
+
+    ++state.first; // advance
+    state.index += outputs_[transition];
+    state.state  = targets_[transition];
+    util::prefetch(&first_[state.state]);
+    return true;
+  }
+
+  void build_(const std::vector<key_t>& keys) {
+    std::vector<detail::build_state_t> states(1);
+    std::vector<std::uint32_t>         unused;
+    std::unordered_set<std::uint32_t, detail::state_hash_t, detail::state_equal_t>
+      registered(keys.size(), detail::state_hash_t{&states}, detail::state_equal_t{&states});
+
+    // the states along the last word, path[i] is reached after its first i chars
+    std::vector<std::uint32_t> path{ 0 };
+    auto minimize = [&](std::size_t depth) {
+      for (auto i = path.size() - 1; i > depth; --i) {
+        auto state = path[i];
+        auto found = registered.find(state);
+        if (found == std::end(registered)) {
+          registered.insert(state);
+          continue;
+        }
+
+        states[path[i - 1]].transitions.back().second = *found;
+        states[state] = detail::build_state_t{};
+        unused.push_back(state);
+      }
+      path.resize(depth + 1);
+    };
+
+    const std::string* previous = nullptr;
+    for (auto& key : keys) {
+      auto& word = *key.first;
+
+      std::size_t common = 0;
+      if (previous) {
+        auto length = std::min(previous->size(), word.size());
+        for (; common != length && (*previous)[common] == word[common]; ++common) { }
+      }
+      minimize(common);
+
+      for (auto i = common; i != word.size(); ++i) {
+        std::uint32_t state;
+        if (!unused.empty()) {
+          state = unused.back();
+          unused.pop_back();
+        }
+        else {
+          state = static_cast<std::uint32_t>(states.size());
+          states.emplace_back();
+        }
+        states[path.back()].transitions.emplace_back(word[i], state);
+        path.push_back(state);
+      }
+      states[path.back()].final = true;
+      values_.push_back(*key.second);
+
+      previous = &word;
+    }
+    minimize(0);
+
+    flatten_(states);
+  }
+
+  // lays the reachable states out breadth first with their outputs
+  void flatten_(const std::vector<detail::build_state_t>& states) {
+    const auto unseen = static_cast<std::uint32_t>(-1);
+
+    std::vector<std::uint32_t> counts(states.size(), unseen);
+    std::vector<std::uint32_t> ids(states.size(), unseen);
+    std::vector<std::uint32_t> order{ 0 };
+    ids[0] = 0;
+    for (std::size_t i = 0; i != order.size(); ++i) {
+      for (auto& transition : states[order[i]].transitions) {
+        if (ids[transition.second] != unseen) continue;
+
+        ids[transition.second] = static_cast<std::uint32_t>(order.size());
+        order.push_back(transition.second);
+      }
+    }
+
+    for (auto state : order) {
+      auto& from  = states[state];
+      auto output = static_cast<std::uint32_t>(from.final);
+
+      first_.push_back(static_cast<std::uint32_t>(labels_.size()));
+      final_.push_back(from.final);
+      for (auto& transition : from.transitions) {
+        labels_.push_back(transition.first);
+        targets_.push_back(ids[transition.second]);
+        outputs_.push_back(output);
+        output += count_(states, counts, transition.second);
+      }
+    }
+    first_.push_back(static_cast<std::uint32_t>(labels_.size()));
+
+    first_.shrink_to_fit();
+    labels_.shrink_to_fit();
+    targets_.shrink_to_fit();
+    outputs_.shrink_to_fit();
+    values_.shrink_to_fit();
+  }
+
+  // the words starting from a state
+  static std::uint32_t count_(const std::vector<detail::build_state_t>& states,
+                              std::vector<std::uint32_t>& counts, std::uint32_t state) {
+    if (counts[state] != static_cast<std::uint32_t>(-1)) return counts[state];
+
+    std::uint32_t ret = states[state].final;
+    for (auto& transition : states[state].transitions) {
+      ret += count_(states, counts, transition.second);
+    }
+    counts[state] = ret;
+    return ret;
+  }
+
+  std::size_t transition_(std::uint32_t state, char c) const {
+    auto first = std::begin(labels_) + first_[state];
+    auto last  = std::begin(labels_) + first_[state + 1];
+    auto found = std::lower_bound(first, last, c, [](char a, char b) {
+      return static_cast<unsigned char>(a) < static_cast<unsigned char>(b);
+    });
+    if (found == last || *found != c) return npos;
+
+    return static_cast<std::size_t>(found - std::begin(labels_));
+  }
+
+  // the index of the word's value
+  std::size_t find_(const std::string& word) const {
+    std::uint32_t state = 0;
+    std::size_t   index = 0;
+    for (char c : word) {
+      auto transition = transition_(state, c);
+      if (transition == npos) return npos;
+
+      index += outputs_[transition];
+      state  = targets_[transition];
+    }
+
+    return final_[state] ? index : npos;
+  }
+
+  void get_words_impl_(std::vector<std::string>& words, std::string& prefix, std::uint32_t state) const {
+    if (final_[state]) words.push_back(prefix);
+
+    for (auto transition = first_[state]; transition != first_[state + 1]; ++transition) {
+      prefix.push_back(labels_[transition]);
+      get_words_impl_(words, prefix, targets_[transition]);
+      prefix.pop_back();
+    }
+  }
+};
+
+} // namespace impl8
+
+
+namespace impl9 {
+
+// HAT-trie: the top of the tree is made of wide trie nodes (one child per byte) and
+// everything below them sits in array hash containers, small hash tables whose slots pack
+// their entries back to back in a single buffer so a lookup scans contiguous memory
+// instead of chasing one pointer per char.  A container which outgrows the burst threshold
+// is "burst": it turns into a trie node plus one container per leading char.  A low
+// threshold makes more trie nodes (faster, bigger), a high one fewer (slower, smaller)
+namespace detail {
+
+enum class node_kind : unsigned char {
+  trie,
+  container
+};
+
+template <typename T>
+struct node_t;
+
+template <typename T>
+struct node_deleter {
+  void operator()(node_t<T>* node) const;
+};
+
+template <typename T>
+using node_ptr = std::unique_ptr<node_t<T>, node_deleter<T>>;
+
+template <typename T>
+struct node_t {
+  node_kind kind;
+
+  explicit node_t(node_kind kind) : kind{kind} { }
+};
+
+template <typename T>
+struct trie_node_t : node_t<T> {
+  node_ptr<T>        children[256]; // by unsigned char
+  std::unique_ptr<T> value;         // set when a word ends here
+
+  trie_node_t() : node_t<T>{node_kind::trie} { }
+};
+
+inline std::size_t hash(const char* data, std::size_t length) {
+  // FNV-1a
+  std::uint64_t ret = 0xcbf29ce484222325ULL;
+  for (std::size_t i = 0; i != length; ++i) {
+    ret = (ret ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+  }
+  return static_cast<std::size_t>(ret);
+}
+
+// an entry is its length (one byte, or 0xff followed by four), its chars and then the
+// index of its value
+inline void append_entry(std::string& slot, const char* data, std::size_t length, std::uint32_t index) {
+  if (length < 0xff) {
+    slot.push_back(static_cast<char>(length));
+  }
+  else {
+    auto long_length = static_cast<std::uint32_t>(length);
+    slot.push_back(static_cast<char>(0xff));
+    slot.append(reinterpret_cast<const char*>(&long_length), sizeof(long_length));
+  }
+  slot.append(data, length);
+  slot.append(reinterpret_cast<const char*>(&index), sizeof(index));
+}
+
+// reads the entry at 'entry' and returns where the next one starts
+inline const char* read_entry(const char* entry, const char*& data, std::size_t& length, std::uint32_t& index) {
+  length = static_cast<unsigned char>(*entry++);
+  if (length == 0xff) {
+    std::uint32_t long_length;
+    std::memcpy(&long_length, entry, sizeof(long_length));
+    length = long_length;
+    entry += sizeof(long_length);
+  }
+  data = entry;
+  std::memcpy(&index, entry + length, sizeof(index));
+  return entry + length + sizeof(index);
+}
+
+template <typename T>
+struct container_node_t : node_t<T> {
+  static constexpr std::size_t initial_slots = 8;
+  static constexpr std::size_t max_load      = 4; // average entries per slot before rehashing
+
+  std::vector<std::string> slots; // the entries hashing to a slot, back to back
+  std::vector<T>           values;
+
+  container_node_t() : node_t<T>{node_kind::container}, slots(initial_slots) { }
+
+  std::size_t size() const { return values.size(); }
+
+  const T* find(const char* data, std::size_t length) const {
+    return find_in(slot_of(data, length), data, length);
+  }
+
+  // the slot the suffix hashes to and the lookup within it, apart so the slot can be
+  // prefetched in between
+  const std::string& slot_of(const char* data, std::size_t length) const {
+    return slots[hash(data, length) & (slots.size() - 1)];
+  }
+
+  const T* find_in(const std::string& slot, const char* data, std::size_t length) const {
+    const char*   entry_data;
+    std::size_t   entry_length;
+    std::uint32_t index;
+    for (const char *entry = slot.data(), *end = entry + slot.size(); entry != end;) {
+      entry = read_entry(entry, entry_data, entry_length, index);
+      if (entry_length == length && std::memcmp(entry_data, data, length) == 0) return &values[index];
+    }
+    return nullptr;
+  }
+
+  // false if the suffix is already here, the first value stays
+  bool insert(const char* data, std::size_t length, T& value) {
+    if (find(data, length)) return false;
+
+    if (size() + 1 > slots.size() * max_load) rehash_(slots.size() * 2);
+
+    append_entry(slots[hash(data, length) & (slots.size() - 1)], data, length, static_cast<std::uint32_t>(values.size()));
+    values.push_back(std::move(value));
+    return true;
+  }
+
+  // calls f(data, length, value) for every entry, in no particular order
+  template <typename F>
+  void for_each(F f) const {
+    const char*   data;
+    std::size_t   length;
+    std::uint32_t index;
+    for (auto& slot : slots) {
+      for (const char *entry = slot.data(), *end = entry + slot.size(); entry != end;) {
+        entry = read_entry(entry, data, length, index);
+        f(data, length, values[index]);
+      }
+    }
+  }
+
+  std::size_t size_in_bytes() const {
+    std::size_t ret = sizeof(*this) + slots.capacity() * sizeof(std::string) + values.capacity() * sizeof(T);
+    for (auto& slot : slots) {
+      ret += slot.capacity();
+    }
+    return ret;
+  }
+
+private:
+  void rehash_(std::size_t slot_count) {
+    std::vector<std::string> rehashed(slot_count);
+
+    const char*   data;
+    std::size_t   length;
+    std::uint32_t index;
+    for (auto& slot : slots) {
+      for (const char *entry = slot.data(), *end = entry + slot.size(); entry != end;) {
+        entry = read_entry(entry, data, length, index);
+        append_entry(rehashed[hash(data, length) & (slot_count - 1)], data, length, index);
+      }
+    }
+    slots.swap(rehashed);
+  }
+};
+
+template <typename T>
+void node_deleter<T>::operator()(node_t<T>* node) const {
+  switch (node->kind) {
+  case node_kind::trie:      delete static_cast<trie_node_t<T>*>(node);      break;
+  case node_kind::container: delete static_cast<container_node_t<T>*>(node); break;
+  }
+}
+
+} // namespace detail
+
+template <typename T>
+class trie {
+  typedef detail::node_t<T>           node_t;
+  typedef detail::trie_node_t<T>      trie_node_t;
+  typedef detail::container_node_t<T> container_node_t;
+  typedef detail::node_ptr<T>         node_ptr;
+
+  node_ptr    root_;
+  std::size_t burst_threshold_;
+  std::size_t size_ = 0;
+public:
+  static constexpr std::size_t default_burst_threshold = 4096;
+
+  // a container bursts once it holds more than 'burst_threshold' words
+  explicit trie(std::size_t burst_threshold = default_burst_threshold) :
+    root_{new container_node_t}, burst_threshold_{std::max<std::size_t>(burst_threshold, 1)} { }
+
+  void insert(const std::string& word, T value) {
+    if (word.empty()) return;
+
+    auto slot = &root_;
+    for (std::size_t pos = 0;; ++pos) {
+      if ((*slot)->kind == detail::node_kind::container) {
+        auto container = static_cast<container_node_t*>(slot->get());
+        if (!container->insert(word.data() + pos, word.size() - pos, value)) return;
+
+        ++size_;
+        if (container->size() > burst_threshold_) *slot = burst_(*container);
+        return;
+      }
+
+      auto node = static_cast<trie_node_t*>(slot->get());
+      if (pos == word.size()) {
+        // like impl3 the first value stays
+        if (!node->value) {
+          node->value.reset(new T(std::move(value)));
+          ++size_;
+        }
+        return;
+      }
+
+      slot = &node->children[static_cast<unsigned char>(word[pos])];
+      if (!*slot) slot->reset(new container_node_t);
+    }
+  }
+
+  bool exists(const std::string& word) const {
+    return find_(word) != nullptr;
+  }
+
+  bool value_at(const std::string& word, T& value) const {
+    auto found = find_(word);
+    if (!found) return false;
+
+    value = *found;
+    return true;
+  }
+
+  // batched exists and value_at, interleaved like impl3::trie::exists_batch.  A lookup
+  // reaching a container takes one step to hash and prefetch the slot and another to scan it
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt exists_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value != nullptr; });
+  }
+
+  // the pointers are good until the trie is changed
+  template <typename ForwardIt, typename OutputIt>
+  OutputIt value_at_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    return util::interleave_lookups(first, last, out,
+      [this](const std::string& word) { return batch_start_(word); },
+      [](batch_state_t& state) { return batch_step_(state); },
+      [](const batch_state_t& state) { return state.value; });
+  }
+
+  bool prefix_match(const std::string& prefix, std::string& matching_word) const {
+    if (prefix.empty()) return false;
+
+    const node_t* node = root_.get();
+    std::size_t   pos  = 0;
+    for (; node->kind == detail::node_kind::trie && pos != prefix.size(); ++pos) {
+      node = static_cast<const trie_node_t*>(node)->children[static_cast<unsigned char>(prefix[pos])].get();
+      if (!node) return false;
+    }
+
+    // the smallest word under 'node' starting with the rest of the prefix
+    std::string rest = prefix.substr(pos);
+    std::string smallest;
+    if (!smallest_(*node, rest, smallest)) return false;
+
+    matching_word = prefix.substr(0, pos) + smallest;
+    return true;
+  }
+
+  // the words come out in unsigned char order
+  std::vector<std::string> get_words() const {
+    std::vector<std::string> ret;
+    std::string              working_prefix;
+
+    get_words_impl_(ret, working_prefix, *root_);
+
+    return ret;
+  }
+
+  std::size_t size() const { return size_; }
+
+  std::size_t burst_threshold() const { return burst_threshold_; }
+
+  std::size_t trie_node_count() const { return count_(*root_, detail::node_kind::trie); }
+
+  std::size_t container_count() const { return count_(*root_, detail::node_kind::container); }
+
+  // roughly everything the trie holds on to
+  std::size_t size_in_bytes() const { return size_in_bytes_(*root_); }
+
+private:
+  // a single lookup of exists_batch/value_at_batch
+  struct batch_state_t {
+    const node_t*           node      = nullptr; // null once the lookup is done
+    const container_node_t* container = nullptr; // set with slot while it is being prefetched
+    const std::string*      slot      = nullptr;
+    const std::string*      word      = nullptr;
+    std::size_t             pos       = 0;
+    const T*                value     = nullptr;
+  };
+
+  batch_state_t batch_start_(const std::string& word) const {
+    batch_state_t state;
+    state.word = &word;
+    if (!word.empty()) state.node = root_.get();
+    return state;
+  }
+
+  // one node of find_
+  static bool batch_step_(batch_state_t& state) {
+    auto data   = state.word->data() + state.pos;
+    auto length = state.word->size() - state.pos;
+
+    if (state.slot) {
+      state.value = state.container->find_in(*state.slot, data, length);
+      return false;
+    }
+    if (!state.node) return false;
+
+    auto node  = state.node;
+    state.node = nullptr;
+
+    if (node->kind == detail::node_kind::container) {
+      state.container = static_cast<const container_node_t*>(node);
+      state.slot      = &state.container->slot_of(data, length);
+      util::prefetch(state.slot->data());
+      return true;
+    }
+
+    auto trie_node = static_cast<const trie_node_t*>(node);
+    if (length == 0) {
+      state.value = trie_node->value.get();
+      return false;
+    }
+
+    state.node = trie_node->children[static_cast<unsigned char>(*data)].get();
+    if (!state.node) return false;
+
+    ++state.pos; // advance
+    util::prefetch(state.node);
+    return true;
+  }
+
+  // the container's words move down one char into a container per leading char, the word
+  // which ends right here (if any) becomes the value of the new trie node
+  node_ptr burst_(container_node_t& container) {
+    auto node = new trie_node_t;
+    node_ptr ret{node};
+
+    const char*   data;
+    std::size_t   length;
+    std::uint32_t index;
+    for (auto& slot : container.slots) {
+      for (const char *entry = slot.data(), *end = entry + slot.size(); entry != end;) {
+        entry = detail::read_entry(entry, data, length, index);
+
+        auto& value = container.values[index];
+        if (length == 0) {
+          node->value.reset(new T(std::move(value)));
+          continue;
+        }
+
+        auto& child = node->children[static_cast<unsigned char>(*data)];
+        if (!child) child.reset(new container_node_t);
+        static_cast<container_node_t*>(child.get())->insert(data + 1, length - 1, value);
+      }
+    }
+
+    // every word could have gone to the same child
+    for (auto& child : node->children) {
+      if (child && static_cast<container_node_t*>(child.get())->size() > burst_threshold_) {
+        child = burst_(*static_cast<container_node_t*>(child.get()));
+      }
+    }
+
+    return ret;
+  }
+
+  const T* find_(const std::string& word) const {
+    if (word.empty()) return nullptr;
+
+    const node_t* node = root_.get();
+    for (std::size_t pos = 0;; ++pos) {
+      if (node->kind == detail::node_kind::container) {
+        return static_cast<const container_node_t*>(node)->find(word.data() + pos, word.size() - pos);
+      }
+
+      auto trie_node = static_cast<const trie_node_t*>(node);
+      if (pos == word.size()) return trie_node->value.get();
+
+      node = trie_node->children[static_cast<unsigned char>(word[pos])].get();
+      if (!node) return nullptr;
+    }
+  }
+
+  // the smallest suffix below 'node' starting with 'rest'
+  static bool smallest_(const node_t& node, const std::string& rest, std::string& smallest) {
+    if (node.kind == detail::node_kind::container) {
+      bool found = false;
+      static_cast<const container_node_t&>(node).for_each([&](const char* data, std::size_t length, const T&) {
+        if (length < rest.size() || rest.compare(0, rest.size(), data, rest.size()) != 0) return;
+
+        // compares as unsigned chars like std::string does
+        if (!found || smallest.compare(0, smallest.size(), data, length) > 0) {
+          smallest.assign(data, length);
+          found = true;
+        }
+      });
+      return found;
+    }
+
+    // the prefix ran out on a trie node, go down the smallest children
+    auto trie_node = static_cast<const trie_node_t*>(&node);
+    smallest.clear();
+    for (;;) {
+      if (trie_node->value) return true;
+
+      auto c = 0;
+      for (; c != 256 && !trie_node->children[c]; ++c) { }
+      if (c == 256) return false;
+
+      smallest.push_back(static_cast<char>(c));
+      auto& child = *trie_node->children[c];
+      if (child.kind == detail::node_kind::container) {
+        std::string below;
+        if (!smallest_(child, {}, below)) return false;
+
+        smallest += below;
+        return true;
+      }
+      trie_node = static_cast<const trie_node_t*>(&child);
+    }
+  }
+
+  static void get_words_impl_(std::vector<std::string>& words, std::string& prefix, const node_t& node) {
+    if (node.kind == detail::node_kind::container) {
+      auto first = words.size();
+      static_cast<const container_node_t&>(node).for_each([&](const char* data, std::size_t length, const T&) {
+        words.push_back(prefix);
+        words.back().append(data, length);
+      });
+      std::sort(std::begin(words) + static_cast<std::ptrdiff_t>(first), std::end(words));
+      return;
+    }
+
+    auto& trie_node = static_cast<const trie_node_t&>(node);
+    if (trie_node.value) words.push_back(prefix);
+    for (auto c = 0; c != 256; ++c) {
+      if (!trie_node.children[c]) continue;
+
+      prefix.push_back(static_cast<char>(c));
+      get_words_impl_(words, prefix, *trie_node.children[c]);
+      prefix.pop_back();
+    }
+  }
+
+  static std::size_t count_(const node_t& node, detail::node_kind kind) {
+    std::size_t ret = node.kind == kind;
+    if (node.kind == detail::node_kind::trie) {
+      for (auto& child : static_cast<const trie_node_t&>(node).children) {
+        if (child) ret += count_(*child, kind);
+      }
+    }
+    return ret;
+  }
+
+  static std::size_t size_in_bytes_(const node_t& node) {
+    if (node.kind == detail::node_kind::container) return static_cast<const container_node_t&>(node).size_in_bytes();
+
+    auto& trie_node = static_cast<const trie_node_t&>(node);
+    std::size_t ret = sizeof(trie_node) + (trie_node.value ? sizeof(T) : 0);
+    for (auto& child : trie_node.children) {
+      if (child) ret += size_in_bytes_(*child);
+    }
+    return ret;
+  }
+};
+
+} // namespace impl9
 
 } // namespace trie
@@ -21,9 +21,17 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+#include <cstdio>
 #include <cstring>
 
+#include <atomic>
+#include <fstream>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <type_traits>
 
 #ifndef CATCH_CONFIG_MAIN // for intellisense
@@ -72,6 +80,133 @@ void build_radom_list() {
   s_random_words = std::make_unique<std::vector<std::string>>(std::move(random_words));
 }
 
+typedef std::vector<std::pair<std::string, int>> pairs_t;
+
+// the words the engines which are only built once (impl6, impl7, impl8) are checked with
+pairs_t static_pairs() {
+  pairs_t pairs = {
+    { "cat", 1 }, { "bat", 2 }, { "cake", 3 }, { "bake", 4 }, { "abcd", 5 }, { "somereallylongword", 6 }, { "ca", 7 }
+  };
+  std::sort(std::begin(pairs), std::end(pairs));
+  return pairs;
+}
+
+// words either side of 0x7f/0x80 and up at 0xff, they only come out in this order if
+// chars are compared unsigned
+pairs_t high_byte_pairs() {
+  pairs_t pairs = {
+    { "a", 1 }, { "a\x7f", 2 }, { "a\x80", 3 }, { "\x80z", 4 }, { "\x80\x80", 5 }, { "\xfe\xff", 6 }, { "\xff", 7 }, { "\xff\x80", 8 }
+  };
+  std::sort(std::begin(pairs), std::end(pairs));
+  return pairs;
+}
+
+// fills the impl3 trie the other engines are built from
+void fill_source(trie::impl3::trie<int>& source, const pairs_t& pairs, const std::vector<std::string>& words = { }) {
+  for (auto& pair : pairs) {
+    source.insert(pair.first, pair.second);
+  }
+  for (auto& word : words) {
+    source.insert(word, static_cast<int>(word.size()));
+  }
+}
+
+template <typename Trie>
+void check_empty(const Trie& empty) {
+  std::string match;
+  REQUIRE(empty.size() == 0);
+  REQUIRE(empty.get_words().empty());
+  REQUIRE(!empty.exists("cat"));
+  REQUIRE(!empty.exists(""));
+  REQUIRE(!empty.prefix_match("c", match));
+}
+
+// 't' holds exactly static_pairs()
+template <typename Trie>
+void check_static_pairs(const Trie& t) {
+  REQUIRE(t.size() == 7);
+  REQUIRE(t.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "ca", "cake", "cat", "somereallylongword" }));
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.exists("ca"));
+  REQUIRE(!t.exists("c"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(!t.exists(""));
+
+  int value = 0;
+  for (auto& pair : static_pairs()) {
+    REQUIRE(t.value_at(pair.first, value));
+    REQUIRE(value == pair.second);
+  }
+  REQUIRE(!t.value_at("somereallylongwor", value));
+
+  std::string match;
+  REQUIRE(t.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+  REQUIRE(t.prefix_match("c", match));
+  REQUIRE(match == "ca");
+  REQUIRE(t.prefix_match("somereallylongword", match));
+  REQUIRE(match == "somereallylongword");
+
+  match.clear();
+  REQUIRE(!t.prefix_match("", match));
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(!t.prefix_match("somereallylongwordd", match));
+  REQUIRE(match.empty());
+}
+
+// 't' holds exactly high_byte_pairs()
+template <typename Trie>
+void check_high_bytes(const Trie& t) {
+  REQUIRE(t.size() == 8);
+  REQUIRE(t.get_words() == std::vector<std::string>({ "a", "a\x7f", "a\x80", "\x80z", "\x80\x80", "\xfe\xff", "\xff", "\xff\x80" }));
+
+  int value = 0;
+  for (auto& pair : high_byte_pairs()) {
+    REQUIRE(t.value_at(pair.first, value));
+    REQUIRE(value == pair.second);
+  }
+  REQUIRE(!t.exists("\x80"));
+  REQUIRE(!t.exists("\xfe"));
+  REQUIRE(!t.exists("a\x81"));
+
+  std::string match;
+  REQUIRE(t.prefix_match("\x80", match));
+  REQUIRE(match == "\x80z");
+  REQUIRE(t.prefix_match("\xfe", match));
+  REQUIRE(match == "\xfe\xff");
+  REQUIRE(t.prefix_match("\xff", match));
+  REQUIRE(match == "\xff");
+  REQUIRE(t.prefix_match("a", match));
+  REQUIRE(match == "a");
+  REQUIRE(!t.prefix_match("\x81", match));
+}
+
+// 'built' has every word of 'source', which holds the random words, with the same values
+template <typename Trie>
+void check_built_from(const Trie& built, const trie::impl3::trie<int>& source) {
+  REQUIRE(built.size() == source.get_words().size());
+  REQUIRE(built.get_words() == source.get_words());
+  for (auto& word : *s_random_words) {
+    int expected = 0;
+    int value    = 0;
+    REQUIRE(source.value_at(word, expected));
+    REQUIRE(built.value_at(word, value));
+    REQUIRE(value == expected);
+    REQUIRE(!built.exists(word + "0"));
+
+    std::string match;
+    std::string expected_match;
+    auto prefix = word.substr(0, 2);
+    REQUIRE(source.prefix_match(prefix, expected_match));
+    REQUIRE(built.prefix_match(prefix, match));
+    REQUIRE(match == expected_match);
+  }
+}
+
 } // namespace [anon]
 
 struct test_listener : Catch::TestEventListenerBase {
@@ -385,4 +520,2270 @@ TEST_CASE("impl3", "[impl3::trie]") {
     // we can't match spaces since we never inserted a word with spaces
     REQUIRE(!t.prefix_match("thing invalid", match));
   }
+
+  SECTION("wide branches") {
+    // past 16 children a branch moves from its small arrays to a map, inserted out of order
+    trie::impl3::trie<int> wide;
+    std::vector<std::string> expected;
+    for (int i = 0; i != 40; ++i) {
+      std::string word = "w";
+      word.push_back(static_cast<char>('A' + (i * 7) % 40));
+      wide.insert(word, i);
+      expected.push_back(word);
+
+      std::sort(std::begin(expected), std::end(expected));
+      REQUIRE(wide.get_words() == expected);
+    }
+
+    int value;
+    REQUIRE(wide.value_at("wA", value));
+    REQUIRE(value == 0);
+    REQUIRE(!wide.exists("w@"));
+
+    // and keeps working as it shrinks
+    for (auto& word : expected) {
+      REQUIRE(wide.erase(word));
+    }
+    REQUIRE(wide.get_words().empty());
+  }
+
+  SECTION("the first value stays") {
+    // a value that is left empty once moved from
+    trie::impl3::trie<std::string> strings;
+    strings.insert("cat", "first");
+    strings.insert("cat", "second");
+    strings.insert("ca", "ca");
+    strings.insert("cat", "third");
+
+    std::string value;
+    REQUIRE(strings.value_at("cat", value));
+    REQUIRE(value == "first");
+    REQUIRE(strings.value_at("ca", value));
+    REQUIRE(value == "ca");
+  }
+}
+
+TEST_CASE("impl4", "[impl4::trie]") {
+  std::vector<std::string> words;
+  words.push_back("cat");
+  words.push_back("bat");
+  words.push_back("cake");
+  words.push_back("bake");
+  words.push_back("abcd");
+  words.push_back("somereallylongword");
+
+  trie::impl4::trie<int> t;
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+
+  SECTION("ensure all words are the same") {
+    auto trie_words = t.get_words();
+
+    auto tfirst = std::begin(trie_words);
+    auto tlast = std::end(trie_words);
+    REQUIRE(std::all_of(std::begin(words), std::end(words),
+      [tfirst, tlast](const std::string& word) { return std::find(tfirst, tlast, word) != tlast; }));
+  }
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(t.exists("bake"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(t.exists("somereallylongword"));
+
+  int value;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+
+  value = 0;
+  REQUIRE(!t.value_at("catt", value));
+  REQUIRE(value == 0);
+
+  value = 0;
+  REQUIRE(t.value_at("cake", value));
+  REQUIRE(value == 3);
+
+  value = 0;
+  REQUIRE(t.value_at("abcd", value));
+  REQUIRE(value == 5);
+
+  value = 0;
+  REQUIRE(t.value_at("somereallylongword", value));
+  REQUIRE(value == 6);
+
+  std::string match;
+  REQUIRE(t.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+
+  match.clear();
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+
+  match.clear();
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(match.empty());
+
+  SECTION("permutations of 'abcd'") {
+    std::string abcd = "abcd";
+    while (std::next_permutation(std::begin(abcd), std::end(abcd))) {
+      REQUIRE(!t.exists(abcd));
+    }
+  }
+
+  // fill with other garbage
+  {
+    for (auto& word : *s_random_words) {
+      t.insert(word, 10);
+    }
+
+    SECTION("all words were actually inserted") {
+      auto random_words = *s_random_words; // copy, yuck
+      auto old_size = random_words.size();
+      random_words.resize(old_size + words.size());
+      std::copy(std::begin(words), std::end(words), std::begin(random_words) + old_size);
+
+      auto trie_words = t.get_words();
+      auto tfirst = std::begin(trie_words);
+      auto tlast = std::end(trie_words);
+
+      REQUIRE(trie_words.size() == random_words.size());
+
+      REQUIRE(std::all_of(std::begin(random_words), std::end(random_words),
+        [tfirst, tlast](const std::string& word) { return std::find(tfirst, tlast, word) != tlast; }));
+    }
+  }
+
+  SECTION("retest starting invariants") {
+    REQUIRE(t.exists("cat"));
+    REQUIRE(t.exists("bake"));
+    REQUIRE(t.exists("somereallylongword"));
+
+    int value;
+    REQUIRE(t.value_at("cat", value));
+    REQUIRE(value == 1);
+
+    value = 0;
+    REQUIRE(t.value_at("cake", value));
+    REQUIRE(value == 3);
+
+    value = 0;
+    REQUIRE(t.value_at("abcd", value));
+    REQUIRE(value == 5);
+
+    value = 0;
+    REQUIRE(t.value_at("somereallylongword", value));
+    REQUIRE(value == 6);
+
+    std::string match;
+    REQUIRE(t.prefix_match("somereallylongword", match));
+    REQUIRE(match == "somereallylongword");
+
+    // we can't match spaces since we never inserted a word with spaces
+    REQUIRE(!t.prefix_match("thing invalid", match));
+  }
+
+  SECTION("nodes grow through every size") {
+    // every byte value under the same parent forces node4 -> node16 -> node48 -> node256
+    for (int c = 1; c != 256; ++c) {
+      t.insert(std::string("grow") + static_cast<char>(c), c);
+    }
+
+    for (int c = 1; c != 256; ++c) {
+      int value = 0;
+      REQUIRE(t.value_at(std::string("grow") + static_cast<char>(c), value));
+      REQUIRE(value == c);
+    }
+    REQUIRE(!t.exists("grow"));
+
+    t.insert("grow", 0);
+    REQUIRE(t.exists("grow"));
+    REQUIRE(t.exists("cat"));
+    REQUIRE(t.exists("somereallylongword"));
+  }
+
+  SECTION("bytes from 0x80 up are ordered like impl3") {
+    // 3, 10, 40 and 254 children land in every node size, half of them bytes from 0x80 up
+    trie::impl4::trie<int> wide;
+    trie::impl3::trie<int> expected;
+    for (int count : { 3, 10, 40, 254 }) {
+      auto parent = "n" + std::to_string(count);
+      for (int i = 0; i != count; ++i) {
+        auto word = parent + static_cast<char>(i % 2 ? 0x80 + i / 2 : 1 + i / 2) + "x";
+        wide.insert(word, i);
+        expected.insert(word, i);
+      }
+
+      std::string match;
+      std::string expected_match;
+      REQUIRE(wide.prefix_match(parent, match));
+      REQUIRE(expected.prefix_match(parent, expected_match));
+      REQUIRE(match == expected_match);
+    }
+    REQUIRE(wide.get_words() == expected.get_words());
+  }
+}
+
+TEST_CASE("impl5", "[impl5::trie]") {
+  std::vector<std::string> words;
+  words.push_back("cat");
+  words.push_back("bat");
+  words.push_back("cake");
+  words.push_back("bake");
+  words.push_back("abcd");
+  words.push_back("somereallylongword");
+
+  trie::impl5::trie<int> t;
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+
+  SECTION("ensure all words are the same") {
+    auto trie_words = t.get_words();
+
+    auto tfirst = std::begin(trie_words);
+    auto tlast = std::end(trie_words);
+    REQUIRE(std::all_of(std::begin(words), std::end(words),
+      [tfirst, tlast](const std::string& word) { return std::find(tfirst, tlast, word) != tlast; }));
+  }
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(t.exists("bake"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(t.exists("somereallylongword"));
+
+  int value;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+
+  value = 0;
+  REQUIRE(!t.value_at("catt", value));
+  REQUIRE(value == 0);
+
+  value = 0;
+  REQUIRE(t.value_at("cake", value));
+  REQUIRE(value == 3);
+
+  value = 0;
+  REQUIRE(t.value_at("abcd", value));
+  REQUIRE(value == 5);
+
+  value = 0;
+  REQUIRE(t.value_at("somereallylongword", value));
+  REQUIRE(value == 6);
+
+  std::string match;
+  REQUIRE(t.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+
+  match.clear();
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+
+  match.clear();
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(match.empty());
+
+  SECTION("permutations of 'abcd'") {
+    std::string abcd = "abcd";
+    while (std::next_permutation(std::begin(abcd), std::end(abcd))) {
+      REQUIRE(!t.exists(abcd));
+    }
+  }
+
+  // fill with other garbage
+  {
+    for (auto& word : *s_random_words) {
+      t.insert(word, 10);
+    }
+
+    SECTION("all words were actually inserted") {
+      auto random_words = *s_random_words; // copy, yuck
+      auto old_size = random_words.size();
+      random_words.resize(old_size + words.size());
+      std::copy(std::begin(words), std::end(words), std::begin(random_words) + old_size);
+
+      auto trie_words = t.get_words();
+      auto tfirst = std::begin(trie_words);
+      auto tlast = std::end(trie_words);
+
+      REQUIRE(trie_words.size() == random_words.size());
+
+      REQUIRE(std::all_of(std::begin(random_words), std::end(random_words),
+        [tfirst, tlast](const std::string& word) { return std::find(tfirst, tlast, word) != tlast; }));
+    }
+  }
+
+  SECTION("retest starting invariants") {
+    REQUIRE(t.exists("cat"));
+    REQUIRE(t.exists("bake"));
+    REQUIRE(t.exists("somereallylongword"));
+
+    int value;
+    REQUIRE(t.value_at("cat", value));
+    REQUIRE(value == 1);
+
+    value = 0;
+    REQUIRE(t.value_at("cake", value));
+    REQUIRE(value == 3);
+
+    value = 0;
+    REQUIRE(t.value_at("abcd", value));
+    REQUIRE(value == 5);
+
+    value = 0;
+    REQUIRE(t.value_at("somereallylongword", value));
+    REQUIRE(value == 6);
+
+    std::string match;
+    REQUIRE(t.prefix_match("somereallylongword", match));
+    REQUIRE(match == "somereallylongword");
+
+    // we can't match spaces since we never inserted a word with spaces
+    REQUIRE(!t.prefix_match("thing invalid", match));
+  }
+}
+
+TEST_CASE("arena allocator", "[arena_allocator]") {
+  std::vector<std::string> words = *s_random_words;
+  words.push_back("cat");
+  words.push_back("cake");
+  words.push_back("ca");
+  words.push_back(std::string(200, 'x')); // bigger than the tiny blocks below
+
+  SECTION("impl2") {
+    trie::impl2::trie                                    heap_t;
+    trie::impl2::basic_trie<trie::arena_allocator>       arena_t;
+    trie::impl2::basic_trie<trie::arena_allocator>       small_block_t{trie::arena_allocator{64}};
+    for (auto& word : words) {
+      heap_t.insert(word);
+      arena_t.insert(word);
+      small_block_t.insert(word);
+    }
+
+    REQUIRE(arena_t.get_words() == heap_t.get_words());
+    REQUIRE(small_block_t.get_words() == heap_t.get_words());
+    REQUIRE(std::all_of(std::begin(words), std::end(words),
+      [&arena_t](const std::string& word) { return arena_t.exists(word); }));
+    REQUIRE(!arena_t.exists("c"));
+  }
+
+  SECTION("impl3") {
+    trie::impl3::trie<std::string>                         heap_t;
+    trie::impl3::trie<std::string, trie::arena_allocator>  arena_t;
+    trie::impl3::trie<std::string, trie::arena_allocator>  small_block_t{trie::arena_allocator{64}};
+    for (auto& word : words) {
+      heap_t.insert(word, word);
+      arena_t.insert(word, word);
+      small_block_t.insert(word, word);
+    }
+
+    REQUIRE(arena_t.get_words() == heap_t.get_words());
+    REQUIRE(small_block_t.get_words() == heap_t.get_words());
+    for (auto& word : words) {
+      std::string value;
+      REQUIRE(arena_t.value_at(word, value));
+      REQUIRE(value == word);
+
+      value.clear();
+      REQUIRE(small_block_t.value_at(word, value));
+      REQUIRE(value == word);
+    }
+    REQUIRE(!arena_t.exists("c"));
+  }
+}
+
+TEST_CASE("impl3 frozen", "[impl3::frozen_trie]") {
+  trie::impl3::trie<int> t;
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+
+  SECTION("empty trie") {
+    trie::impl3::trie<int> empty;
+    auto frozen = empty.freeze();
+
+    std::string match;
+    REQUIRE(frozen.size() == 0);
+    REQUIRE(frozen.get_words().empty());
+    REQUIRE(!frozen.exists("cat"));
+    REQUIRE(!frozen.prefix_match("c", match));
+  }
+
+  auto frozen = t.freeze();
+
+  REQUIRE(frozen.size() == 7);
+  REQUIRE(frozen.get_words() == t.get_words());
+
+  REQUIRE(frozen.exists("cat"));
+  REQUIRE(frozen.exists("ca"));
+  REQUIRE(!frozen.exists("c"));
+  REQUIRE(!frozen.exists("catt"));
+  REQUIRE(!frozen.exists("bbake"));
+  REQUIRE(!frozen.exists(""));
+
+  int value = 0;
+  REQUIRE(frozen.value_at("somereallylongword", value));
+  REQUIRE(value == 6);
+  REQUIRE(frozen.value_at("ca", value));
+  REQUIRE(value == 7);
+  REQUIRE(!frozen.value_at("somereallylongwor", value));
+
+  std::string match;
+  REQUIRE(frozen.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+  REQUIRE(frozen.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+  REQUIRE(frozen.prefix_match("c", match));
+  REQUIRE(match == "ca");
+  REQUIRE(frozen.prefix_match("somereallylongword", match));
+  REQUIRE(match == "somereallylongword");
+
+  match.clear();
+  REQUIRE(!frozen.prefix_match("zz", match));
+  REQUIRE(!frozen.prefix_match("somereallylongwordd", match));
+  REQUIRE(match.empty());
+
+  SECTION("matches the trie it was built from") {
+    for (auto& word : *s_random_words) {
+      t.insert(word, static_cast<int>(word.size()));
+    }
+    frozen = t.freeze();
+
+    REQUIRE(frozen.get_words() == t.get_words());
+    for (auto& word : *s_random_words) {
+      int expected = 0;
+      REQUIRE(t.value_at(word, expected));
+      REQUIRE(frozen.value_at(word, value));
+      REQUIRE(value == expected);
+
+      std::string expected_match;
+      auto prefix = word.substr(0, 2);
+      REQUIRE(t.prefix_match(prefix, expected_match));
+      REQUIRE(frozen.prefix_match(prefix, match));
+      REQUIRE(match == expected_match);
+    }
+  }
+}
+
+TEST_CASE("impl3 mapped", "[impl3::mapped_trie]") {
+  trie::impl3::trie<int> t;
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+  for (auto& word : *s_random_words) {
+    t.insert(word, static_cast<int>(word.size()));
+  }
+
+  std::ostringstream out;
+  REQUIRE(t.freeze().write(out));
+  auto image = out.str();
+
+  auto check = [&t](const trie::impl3::mapped_trie<int>& mapped) {
+    REQUIRE(mapped.is_open());
+    REQUIRE(mapped.get_words() == t.get_words());
+    REQUIRE(!mapped.exists("c"));
+    REQUIRE(!mapped.exists("catt"));
+
+    for (auto& word : t.get_words()) {
+      int expected = 0;
+      int value    = -1;
+      REQUIRE(t.value_at(word, expected));
+      REQUIRE(mapped.value_at(word, value));
+      REQUIRE(value == expected);
+    }
+
+    // random words can sort before "somereallylongword", so ask the trie it was built from
+    std::string match;
+    std::string expected;
+    REQUIRE(t.prefix_match("so", expected));
+    REQUIRE(mapped.prefix_match("so", match));
+    REQUIRE(match == expected);
+    REQUIRE(mapped.prefix_match("c", match));
+    REQUIRE(match == "ca");
+  };
+
+  SECTION("attached to a buffer") {
+    trie::impl3::mapped_trie<int> mapped;
+    REQUIRE(mapped.attach(image.data(), image.size()));
+    check(mapped);
+  }
+
+  SECTION("mapped from a file") {
+    const char* path = "trie_test_mapped.bin";
+    {
+      std::ofstream file{path, std::ios::binary};
+      REQUIRE(t.freeze().write(file));
+    }
+
+    trie::impl3::mapped_trie<int> mapped;
+    REQUIRE(mapped.open(path));
+    check(mapped);
+
+    auto moved = std::move(mapped);
+    REQUIRE(!mapped.is_open());
+    check(moved);
+
+    // a vector of them moves rather than copies when it grows
+    static_assert(std::is_nothrow_move_constructible<trie::impl3::mapped_trie<int>>::value, "");
+    static_assert(std::is_nothrow_move_assignable<trie::impl3::mapped_trie<int>>::value, "");
+
+    // move assigning over an open mapping closes it first
+    trie::impl3::mapped_trie<int> reopened;
+    REQUIRE(reopened.attach(image.data(), image.size()));
+    reopened = std::move(moved);
+    REQUIRE(!moved.is_open());
+    check(reopened);
+
+    moved = std::move(reopened);
+    REQUIRE(!reopened.is_open());
+    check(moved);
+
+    moved.close();
+    REQUIRE(!moved.exists("cat"));
+    std::remove(path);
+  }
+
+  SECTION("bad images are rejected") {
+    trie::impl3::mapped_trie<int> mapped;
+    REQUIRE(!mapped.open("this/file/does/not/exist"));
+    REQUIRE(!mapped.attach(image.data(), 10));
+    REQUIRE(!mapped.attach(image.data(), image.size() / 2));
+
+    trie::impl3::mapped_trie<short> wrong_value;
+    REQUIRE(!wrong_value.attach(image.data(), image.size()));
+
+    auto corrupt = image;
+    corrupt[0] = 'X';
+    REQUIRE(!mapped.attach(corrupt.data(), corrupt.size()));
+    REQUIRE(!mapped.is_open());
+  }
+
+  SECTION("crafted headers and nodes are rejected") {
+    typedef trie::impl3::detail::frozen_header_t header_t;
+    typedef trie::impl3::detail::frozen_node_t   node_t;
+
+    header_t header;
+    std::memcpy(&header, image.data(), sizeof(header));
+    auto with_header = [&image](const header_t& patched) {
+      auto ret = image;
+      std::memcpy(&ret[0], &patched, sizeof(patched));
+      return ret;
+    };
+    auto with_node = [&image, &header](std::size_t i, void (*patch)(node_t&, const header_t&)) {
+      auto   ret = image;
+      node_t node;
+      auto   at  = static_cast<std::size_t>(header.nodes_offset) + i * sizeof(node_t);
+      std::memcpy(&node, &ret[at], sizeof(node));
+      patch(node, header);
+      std::memcpy(&ret[at], &node, sizeof(node));
+      return ret;
+    };
+
+    std::vector<std::string> bad;
+
+    // offsets and counts which wrap around when added up
+    auto patched = header;
+    patched.data_offset = ~0ull - 2;
+    bad.push_back(with_header(patched));
+    patched = header;
+    patched.node_count = ~0ull / sizeof(node_t) + 2;
+    bad.push_back(with_header(patched));
+    patched = header;
+    patched.values_offset = ~0ull - 7;
+    bad.push_back(with_header(patched));
+    patched = header;
+    patched.edges_offset = image.size() - header.node_count + 1;
+    bad.push_back(with_header(patched));
+
+    // nodes pointing outside of the sections, or back up the trie
+    bad.push_back(with_node(0, [](node_t& node, const header_t& h) {
+      node.child_first = static_cast<std::uint32_t>(h.node_count);
+    }));
+    bad.push_back(with_node(0, [](node_t& node, const header_t&) { node.child_first = 0; }));
+    bad.push_back(with_node(1, [](node_t& node, const header_t& h) {
+      node.value = static_cast<std::uint32_t>(h.value_count);
+    }));
+    bad.push_back(with_node(1, [](node_t& node, const header_t& h) {
+      node.data_first = static_cast<std::uint32_t>(h.data_size);
+      node.data_size  = 1;
+    }));
+    bad.push_back(with_node(1, [](node_t& node, const header_t&) {
+      node.child_count = 0;
+      node.value       = node_t::npos;
+    }));
+
+    for (auto& image_bytes : bad) {
+      // a failed attach doesn't keep the image attached before it
+      trie::impl3::mapped_trie<int> mapped;
+      REQUIRE(mapped.attach(image.data(), image.size()));
+      REQUIRE(!mapped.attach(image_bytes.data(), image_bytes.size()));
+      REQUIRE(!mapped.is_open());
+      REQUIRE(!mapped.exists("cat"));
+    }
+  }
+}
+
+TEST_CASE("sorted bulk load", "[sorted_input]") {
+  std::vector<std::string> words = *s_random_words;
+  words.push_back("cat");
+  words.push_back("ca");
+  words.push_back("cake");
+  words.push_back("cakes");
+  words.push_back("c");
+  words.push_back("cat"); // duplicates are fine
+  words.push_back("");    // and so is the empty word, it just isn't stored
+  std::sort(std::begin(words), std::end(words));
+
+  SECTION("impl2") {
+    trie::impl2::trie inserted;
+    for (auto& word : words) {
+      inserted.insert(word);
+    }
+
+    trie::impl2::trie t{trie::sorted_input, std::begin(words), std::end(words)};
+    REQUIRE(t.get_words() == inserted.get_words());
+    REQUIRE(t.exists("c"));
+    REQUIRE(t.exists("cakes"));
+    REQUIRE(t.exists("cak") == inserted.exists("cak"));
+
+    // a random word can sort before "cake", ask the inserted trie
+    std::string match;
+    std::string expected_match;
+    REQUIRE(inserted.prefix_match("cak", expected_match));
+    REQUIRE(t.prefix_match("cak", match));
+    REQUIRE(match == expected_match);
+
+    // the tree keeps working after the bulk load
+    t.insert("cakewalk");
+    REQUIRE(t.exists("cakewalk"));
+    REQUIRE(t.exists("cake"));
+  }
+
+  SECTION("impl3") {
+    std::vector<std::pair<std::string, int>> pairs;
+    trie::impl3::trie<int> inserted;
+    for (auto& word : words) {
+      pairs.emplace_back(word, static_cast<int>(pairs.size()));
+      inserted.insert(word, pairs.back().second);
+    }
+
+    trie::impl3::trie<int> t{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+    REQUIRE(t.get_words() == inserted.get_words());
+
+    // the same shape as inserting one at a time
+    REQUIRE(t.freeze().node_count() == inserted.freeze().node_count());
+
+    for (auto& word : inserted.get_words()) {
+      int expected = -1;
+      int value    = -2;
+      REQUIRE(inserted.value_at(word, expected));
+      REQUIRE(t.value_at(word, value));
+      REQUIRE(value == expected);
+    }
+
+    t.insert("cakewalk", 100);
+    int value = 0;
+    REQUIRE(t.value_at("cakewalk", value));
+    REQUIRE(value == 100);
+
+    std::vector<std::pair<std::string, int>> nothing;
+    trie::impl3::trie<int> empty{trie::sorted_input, std::begin(nothing), std::end(nothing)};
+    REQUIRE(empty.get_words().empty());
+  }
+}
+
+TEST_CASE("parallel bulk load", "[parallel_input]") {
+  std::vector<std::pair<std::string, int>> pairs;
+  for (auto& word : *s_random_words) {
+    pairs.emplace_back(word, static_cast<int>(pairs.size()));
+  }
+  pairs.emplace_back("cat", 1000);
+  pairs.emplace_back("ca", 1001);
+  pairs.emplace_back("\xe9t\xe9", 1002); // a first byte past 0x7f
+  pairs.emplace_back("cat", 1003);        // duplicates keep the first value
+  pairs.emplace_back("", 1004);           // and the empty word isn't stored
+
+  trie::impl3::trie<int> inserted;
+  for (auto& pair : pairs) {
+    inserted.insert(pair.first, pair.second);
+  }
+
+  auto check = [&](const auto& t) {
+    REQUIRE(t.get_words() == inserted.get_words());
+
+    // the same shape as inserting one at a time
+    REQUIRE(t.freeze().node_count() == inserted.freeze().node_count());
+
+    for (auto& word : inserted.get_words()) {
+      int expected = -1;
+      int value    = -2;
+      REQUIRE(inserted.value_at(word, expected));
+      REQUIRE(t.value_at(word, value));
+      REQUIRE(value == expected);
+    }
+    REQUIRE(!t.exists(""));
+  };
+
+  SECTION("one thread") {
+    trie::impl3::trie<int> t{trie::parallel_input, std::begin(pairs), std::end(pairs), 1};
+    check(t);
+  }
+
+  SECTION("more threads than groups") {
+    trie::impl3::trie<int> t{trie::parallel_input, std::begin(pairs), std::end(pairs), 64};
+    check(t);
+
+    // the tree keeps working after the bulk load
+    t.insert("cakewalk", 100);
+    int value = 0;
+    REQUIRE(t.value_at("cakewalk", value));
+    REQUIRE(value == 100);
+  }
+
+  SECTION("one thread per core") {
+    trie::impl3::trie<int> t{trie::parallel_input, std::begin(pairs), std::end(pairs)};
+    check(t);
+  }
+
+  SECTION("arena allocator") {
+    trie::impl3::trie<int, trie::arena_allocator> t{trie::parallel_input, std::begin(pairs), std::end(pairs), 4};
+    check(t);
+  }
+
+  SECTION("empty input") {
+    std::vector<std::pair<std::string, int>> nothing;
+    trie::impl3::trie<int> empty{trie::parallel_input, std::begin(nothing), std::end(nothing), 4};
+    REQUIRE(empty.get_words().empty());
+  }
+
+  SECTION("a worker that throws") {
+    // copying a negative one throws, whichever thread ends up building it
+    struct picky_t {
+      int value = 0;
+      picky_t() = default;
+      explicit picky_t(int v) : value(v) { }
+      picky_t(const picky_t& other) : value(other.value) {
+        if (value < 0) throw std::runtime_error("picky");
+      }
+      picky_t(picky_t&&) = default;
+      picky_t& operator=(const picky_t&) = default;
+      picky_t& operator=(picky_t&&) = default;
+    };
+
+    std::vector<std::pair<std::string, picky_t>> picky;
+    for (auto& pair : pairs) {
+      picky.emplace_back(pair.first, picky_t{pair.second});
+    }
+    picky.emplace_back("zebra", picky_t{-1});
+    picky.emplace_back("apple", picky_t{-1});
+
+    REQUIRE_THROWS_AS((trie::impl3::trie<picky_t>{trie::parallel_input, std::begin(picky), std::end(picky), 4}),
+                      std::runtime_error);
+  }
+}
+
+TEST_CASE("batch lookups", "[exists_batch]") {
+  std::vector<std::string> words = *s_random_words;
+  words.resize(std::min<std::size_t>(words.size(), 2000));
+  words.push_back("cat");
+  words.push_back("ca");
+  words.push_back("cake");
+  words.push_back("cakes");
+  words.push_back("cakewalk");
+
+  // a mix of words that are there, prefixes of them, and words that are not
+  std::vector<std::string> queries = words;
+  queries.push_back("");
+  queries.push_back("c");
+  queries.push_back("cak");
+  queries.push_back("cats");
+  queries.push_back("caked");
+  queries.push_back("cakewalks");
+  queries.push_back("not in the trie");
+  for (std::size_t i = 0; i != std::min<std::size_t>(words.size(), 200); ++i) {
+    queries.push_back(words[i].substr(0, words[i].size() / 2));
+  }
+  std::shuffle(std::begin(queries), std::end(queries), std::mt19937{});
+
+  // the engines which can't hand out pointers to their values only have exists_batch
+  auto check_exists = [&queries](auto& t) {
+    std::vector<bool> found;
+    t.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found));
+    REQUIRE(found.size() == queries.size());
+
+    for (std::size_t i = 0; i != queries.size(); ++i) {
+      REQUIRE(found[i] == t.exists(queries[i]));
+    }
+  };
+
+  auto check = [&queries](auto& t) {
+    std::vector<bool> found;
+    t.exists_batch(std::begin(queries), std::end(queries), std::back_inserter(found));
+    REQUIRE(found.size() == queries.size());
+
+    std::vector<const int*> values;
+    t.value_at_batch(std::begin(queries), std::end(queries), std::back_inserter(values));
+    REQUIRE(values.size() == queries.size());
+
+    for (std::size_t i = 0; i != queries.size(); ++i) {
+      int value = -1;
+      bool exists = t.value_at(queries[i], value);
+      REQUIRE(found[i] == exists);
+      REQUIRE((values[i] != nullptr) == exists);
+      if (exists) REQUIRE(*values[i] == value);
+    }
+  };
+
+  trie::impl3::trie<int> t3;
+  trie::impl4::trie<int> t4;
+  trie::impl5::trie<int> t5;
+  for (std::size_t i = 0; i != words.size(); ++i) {
+    t3.insert(words[i], static_cast<int>(i));
+    t4.insert(words[i], static_cast<int>(i));
+    t5.insert(words[i], static_cast<int>(i));
+  }
+
+  SECTION("impl3") {
+    check(t3);
+  }
+
+  SECTION("impl4") {
+    check(t4);
+  }
+
+  SECTION("impl5") {
+    check(t5);
+  }
+
+  SECTION("impl3 frozen") {
+    auto frozen = t3.freeze();
+    check(frozen);
+  }
+
+  SECTION("impl3 mapped") {
+    std::stringstream image;
+    REQUIRE(t3.freeze().write(image));
+    auto buffer = image.str();
+
+    trie::impl3::mapped_trie<int> mapped;
+    REQUIRE(mapped.attach(buffer.data(), buffer.size()));
+    check(mapped);
+  }
+
+  SECTION("impl6") {
+    trie::impl6::trie<int> t6{t3};
+    check(t6);
+  }
+
+  SECTION("impl7") {
+    trie::impl7::trie<int> t7{t3};
+    check(t7);
+  }
+
+  SECTION("impl8") {
+    trie::impl8::trie<int> t8{t3};
+    check(t8);
+  }
+
+  SECTION("impl9") {
+    // a low threshold so lookups go through trie nodes as well as containers
+    trie::impl9::trie<int> t9{16};
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      t9.insert(words[i], static_cast<int>(i));
+    }
+    check(t9);
+  }
+
+  SECTION("impl3 persistent") {
+    trie::impl3::persistent_trie<int> persistent;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      persistent = persistent.insert(words[i], static_cast<int>(i));
+    }
+    check(persistent);
+  }
+
+  SECTION("impl3 concurrent") {
+    trie::impl3::concurrent_trie<int> concurrent;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      concurrent.insert(words[i], static_cast<int>(i));
+    }
+    check_exists(concurrent);
+  }
+
+  SECTION("impl3 sharded") {
+    trie::impl3::sharded_trie<int> sharded{16};
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      sharded.insert(words[i], static_cast<int>(i));
+    }
+    check_exists(sharded);
+  }
+
+  SECTION("words which aren't std::string") {
+    // the batch keeps its own copies, nothing may point into a temporary
+    std::vector<const char*>      c_strings;
+    std::vector<std::string_view> views;
+    for (auto& query : queries) {
+      c_strings.push_back(query.c_str());
+      views.push_back(query);
+    }
+
+    std::vector<const int*> from_c_strings;
+    t3.value_at_batch(std::begin(c_strings), std::end(c_strings), std::back_inserter(from_c_strings));
+    std::vector<bool> from_views;
+    t4.exists_batch(std::begin(views), std::end(views), std::back_inserter(from_views));
+    auto frozen = t3.freeze();
+    std::vector<const int*> from_frozen;
+    frozen.value_at_batch(std::begin(c_strings), std::end(c_strings), std::back_inserter(from_frozen));
+
+    for (std::size_t i = 0; i != queries.size(); ++i) {
+      int value = -1;
+      bool exists = t3.value_at(queries[i], value);
+      REQUIRE((from_c_strings[i] != nullptr) == exists);
+      if (exists) REQUIRE(*from_c_strings[i] == value);
+      REQUIRE(from_views[i] == exists);
+      REQUIRE((from_frozen[i] != nullptr) == exists);
+    }
+  }
+
+  SECTION("empty range") {
+    std::vector<bool> found;
+    t3.exists_batch(std::begin(queries), std::begin(queries), std::back_inserter(found));
+    REQUIRE(found.empty());
+  }
+}
+
+TEST_CASE("lazy iteration", "[const_iterator]") {
+  std::vector<std::string> words = *s_random_words;
+  words.push_back("cat");
+  words.push_back("ca");
+  words.push_back("cake");
+  words.push_back("cakes");
+  words.push_back("c");
+
+  std::vector<std::string> sorted = words;
+  std::sort(std::begin(sorted), std::end(sorted));
+  sorted.erase(std::unique(std::begin(sorted), std::end(sorted)), std::end(sorted));
+
+  std::vector<std::string> targets = { "a", "c", "ca", "cak", "cakes", "cakesz", "cb", "zzzzzz", "m" };
+  for (std::size_t i = 0; i != 100; ++i) {
+    targets.push_back(words[i]);
+    targets.push_back(words[i].substr(0, words[i].size() / 2));
+  }
+
+  auto check = [&](auto& t) {
+    REQUIRE(t.begin() != t.end());
+
+    std::vector<std::string> walked;
+    for (auto it = t.begin(); it != t.end(); ++it) {
+      walked.push_back(*it);
+    }
+    REQUIRE(walked == sorted);
+    REQUIRE(walked == t.get_words());
+
+    REQUIRE(t.lower_bound("") == t.begin());
+    for (auto& target : targets) {
+      auto expected = std::lower_bound(std::begin(sorted), std::end(sorted), target);
+      auto it       = t.lower_bound(target);
+      if (expected == std::end(sorted)) {
+        REQUIRE(it == t.end());
+        continue;
+      }
+      REQUIRE(it != t.end());
+      REQUIRE(*it == *expected);
+
+      // and it keeps going in order from there
+      ++it;
+      ++expected;
+      if (expected == std::end(sorted)) REQUIRE(it == t.end());
+      else REQUIRE(*it == *expected);
+    }
+
+    // every word under a prefix
+    std::vector<std::string> under;
+    for (auto it = t.lower_bound("ca"); it != t.end() && it->compare(0, 2, "ca") == 0; ++it) {
+      under.push_back(*it);
+    }
+    std::vector<std::string> expected_under;
+    std::copy_if(std::begin(sorted), std::end(sorted), std::back_inserter(expected_under),
+      [](const std::string& word) { return word.compare(0, 2, "ca") == 0; });
+    REQUIRE(under.size() >= 4);
+    REQUIRE(under == expected_under);
+  };
+
+  SECTION("impl1") {
+    trie::impl1::trie t;
+    REQUIRE(t.begin() == t.end());
+    for (auto& word : words) {
+      t.insert(word);
+    }
+    check(t);
+  }
+
+  SECTION("impl2") {
+    trie::impl2::trie t;
+    REQUIRE(t.begin() == t.end());
+    for (auto& word : words) {
+      t.insert(word);
+    }
+    check(t);
+  }
+
+  SECTION("impl3") {
+    trie::impl3::trie<int> t;
+    REQUIRE(t.begin() == t.end());
+    REQUIRE(t.lower_bound("a") == t.end());
+    for (auto& word : words) {
+      t.insert(word, static_cast<int>(word.size()));
+    }
+    check(t);
+
+    for (auto it = t.begin(); it != t.end(); ++it) {
+      REQUIRE(it.value() == static_cast<int>(it->size()));
+    }
+  }
+}
+
+TEST_CASE("impl3 top_k", "[impl3::max_augment]") {
+  typedef trie::impl3::trie<int, trie::heap_allocator, trie::impl3::max_augment<>> scored_trie;
+
+  std::vector<std::string> words = *s_random_words;
+  words.push_back("cat");
+  words.push_back("ca");
+  words.push_back("cake");
+  words.push_back("cakes");
+  words.push_back("c");
+  std::sort(std::begin(words), std::end(words));
+  words.erase(std::unique(std::begin(words), std::end(words)), std::end(words));
+
+  // every word gets a distinct score so the expected order is exact
+  std::vector<int> scores(words.size());
+  std::iota(std::begin(scores), std::end(scores), 0);
+  std::shuffle(std::begin(scores), std::end(scores), std::mt19937{});
+
+  auto brute_force = [&](const std::string& prefix, std::size_t k) {
+    std::vector<std::pair<std::string, int>> ret;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      if (words[i].compare(0, prefix.size(), prefix) == 0) ret.emplace_back(words[i], scores[i]);
+    }
+    std::sort(std::begin(ret), std::end(ret), [](const auto& a, const auto& b) { return a.second > b.second; });
+    if (ret.size() > k) ret.resize(k);
+    return ret;
+  };
+
+  auto check = [&](const scored_trie& t) {
+    std::vector<std::string> prefixes = { "", "c", "ca", "cak", "cakes", "cakesz", "zzzzzz" };
+    for (std::size_t i = 0; i != 26; ++i) {
+      prefixes.push_back(std::string(1, static_cast<char>('a' + i)));
+    }
+    for (std::size_t i = 0; i != 20; ++i) {
+      prefixes.push_back(words[i].substr(0, 2));
+      prefixes.push_back(words[i]);
+    }
+
+    for (auto& prefix : prefixes) {
+      for (std::size_t k : { 0, 1, 3, 10, 1000 }) {
+        REQUIRE(t.top_k(prefix, k) == brute_force(prefix, k));
+      }
+    }
+  };
+
+  SECTION("insert") {
+    scored_trie t;
+    REQUIRE(t.top_k("", 10).empty());
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      t.insert(words[i], scores[i]);
+    }
+    check(t);
+
+    // inserting a word again changes nothing, same as the plain trie
+    t.insert("cat", 1000000);
+    check(t);
+  }
+
+  SECTION("sorted bulk load") {
+    std::vector<std::pair<std::string, int>> pairs;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      pairs.emplace_back(words[i], scores[i]);
+    }
+    std::sort(std::begin(pairs), std::end(pairs));
+
+    scored_trie t{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+    check(t);
+  }
+}
+
+TEST_CASE("erase", "[erase]") {
+  std::vector<std::string> words = *s_random_words;
+  words.push_back("cat");
+  words.push_back("ca");
+  words.push_back("cake");
+  words.push_back("cakes");
+  words.push_back("c");
+  std::sort(std::begin(words), std::end(words));
+  words.erase(std::unique(std::begin(words), std::end(words)), std::end(words));
+  std::shuffle(std::begin(words), std::end(words), std::mt19937{});
+
+  // erase every other word, including all of the 'c' family but "cake"
+  std::vector<std::string> erased;
+  std::vector<std::string> kept;
+  for (std::size_t i = 0; i != words.size(); ++i) {
+    auto& word = words[i];
+    if (word == "cake") kept.push_back(word);
+    else if (i % 2 == 0 || word.front() == 'c') erased.push_back(word);
+    else kept.push_back(word);
+  }
+  std::sort(std::begin(kept), std::end(kept));
+
+  SECTION("impl2") {
+    trie::impl2::trie t;
+    for (auto& word : words) {
+      t.insert(word);
+    }
+
+    REQUIRE(!t.erase(""));
+    REQUIRE(!t.erase("cak"));
+    REQUIRE(!t.erase("cakesz"));
+    REQUIRE(!t.erase("not in the trie"));
+
+    for (auto& word : erased) {
+      REQUIRE(t.erase(word));
+      REQUIRE(!t.exists(word));
+      REQUIRE(!t.erase(word));
+    }
+    REQUIRE(t.get_words() == kept);
+    for (auto& word : kept) {
+      REQUIRE(t.exists(word));
+    }
+
+    // and words can go back in
+    t.insert("cakes");
+    REQUIRE(t.exists("cakes"));
+    REQUIRE(t.exists("cake"));
+
+    for (auto& word : t.get_words()) {
+      REQUIRE(t.erase(word));
+    }
+    REQUIRE(t.get_words().empty());
+  }
+
+  SECTION("impl3") {
+    trie::impl3::trie<int> t;
+    trie::impl3::trie<int> fresh;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      t.insert(words[i], static_cast<int>(i));
+    }
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      if (std::binary_search(std::begin(kept), std::end(kept), words[i])) fresh.insert(words[i], static_cast<int>(i));
+    }
+
+    REQUIRE(!t.erase(""));
+    REQUIRE(!t.erase("cak"));
+    REQUIRE(!t.erase("cakesz"));
+
+    for (auto& word : erased) {
+      REQUIRE(t.erase(word));
+      REQUIRE(!t.exists(word));
+      REQUIRE(!t.erase(word));
+    }
+    REQUIRE(t.get_words() == kept);
+
+    // shaped just like a trie which never had the erased words
+    REQUIRE(t.freeze().node_count() == fresh.freeze().node_count());
+
+    for (auto& word : kept) {
+      int expected = -1;
+      int value    = -2;
+      REQUIRE(fresh.value_at(word, expected));
+      REQUIRE(t.value_at(word, value));
+      REQUIRE(value == expected);
+    }
+
+    t.insert("ca", 100);
+    int value = 0;
+    REQUIRE(t.value_at("ca", value));
+    REQUIRE(value == 100);
+    REQUIRE(t.erase("cake"));
+    REQUIRE(t.erase("ca"));
+
+    for (auto& word : t.get_words()) {
+      REQUIRE(t.erase(word));
+    }
+    REQUIRE(t.get_words().empty());
+    REQUIRE(t.freeze().node_count() == 1);
+  }
+
+  SECTION("impl3 keeps summaries up to date") {
+    trie::impl3::trie<int, trie::heap_allocator, trie::impl3::max_augment<>> t;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      t.insert(words[i], static_cast<int>(i));
+    }
+    for (auto& word : erased) {
+      REQUIRE(t.erase(word));
+    }
+
+    // the best of what is left
+    std::vector<std::pair<std::string, int>> expected;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      if (std::binary_search(std::begin(kept), std::end(kept), words[i])) expected.emplace_back(words[i], static_cast<int>(i));
+    }
+    std::sort(std::begin(expected), std::end(expected), [](const auto& a, const auto& b) { return a.second > b.second; });
+    expected.resize(std::min<std::size_t>(expected.size(), 10));
+
+    REQUIRE(t.top_k("", 10) == expected);
+    auto c_words = t.top_k("c", 10);
+    REQUIRE(c_words.size() == 1);
+    REQUIRE(c_words.front().first == "cake");
+  }
+}
+
+TEST_CASE("impl6", "[impl6::trie]") {
+  auto pairs = static_pairs();
+
+  SECTION("empty trie") {
+    pairs_t nothing;
+    check_empty(trie::impl6::trie<int>{trie::sorted_input, std::begin(nothing), std::end(nothing)});
+  }
+
+  trie::impl6::trie<int> t{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+  check_static_pairs(t);
+
+  SECTION("duplicates keep their first value") {
+    pairs.emplace_back("cat", 100);
+    std::stable_sort(std::begin(pairs), std::end(pairs),
+      [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    int value = 0;
+    trie::impl6::trie<int> dups{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+    REQUIRE(dups.size() == 7);
+    REQUIRE(dups.value_at("cat", value));
+    REQUIRE(value == 1);
+  }
+
+  SECTION("codes are in unsigned order") {
+    auto high = high_byte_pairs();
+    check_high_bytes(trie::impl6::trie<int>{trie::sorted_input, std::begin(high), std::end(high)});
+
+    trie::impl3::trie<int> source;
+    fill_source(source, high);
+    check_high_bytes(trie::impl6::trie<int>{source});
+  }
+
+  SECTION("matches the impl3 trie it was built from") {
+    trie::impl3::trie<int> source;
+    fill_source(source, pairs, *s_random_words);
+    check_built_from(trie::impl6::trie<int>{source}, source);
+  }
+}
+
+TEST_CASE("impl7", "[impl7::trie]") {
+  auto pairs = static_pairs();
+
+  SECTION("empty trie") {
+    pairs_t nothing;
+    trie::impl7::trie<int> empty{trie::sorted_input, std::begin(nothing), std::end(nothing)};
+    REQUIRE(empty.node_count() == 1);
+    check_empty(empty);
+  }
+
+  trie::impl7::trie<int> t{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+  check_static_pairs(t);
+
+  SECTION("labels are in unsigned order") {
+    auto high = high_byte_pairs();
+    check_high_bytes(trie::impl7::trie<int>{trie::sorted_input, std::begin(high), std::end(high)});
+
+    trie::impl3::trie<int> source;
+    fill_source(source, high);
+    check_high_bytes(trie::impl7::trie<int>{source});
+  }
+
+  SECTION("words under a prefix") {
+    trie::impl3::trie<int> source;
+    fill_source(source, pairs, *s_random_words);
+    trie::impl7::trie<int> built{source};
+
+    auto all = source.get_words();
+    auto under = [&all](const std::string& prefix) {
+      std::vector<std::string> ret;
+      std::copy_if(std::begin(all), std::end(all), std::back_inserter(ret),
+        [&prefix](const std::string& word) { return word.compare(0, prefix.size(), prefix) == 0; });
+      return ret;
+    };
+
+    std::vector<std::string> prefixes = { "", "c", "ca", "cat", "catt", "somereallylongword", "zzzzzzzzzzzzzzzzz" };
+    for (std::size_t i = 0; i != std::min<std::size_t>(s_random_words->size(), 50); ++i) {
+      auto& word = (*s_random_words)[i];
+      prefixes.push_back(word.substr(0, 1));
+      prefixes.push_back(word.substr(0, 2));
+      prefixes.push_back(word);
+      prefixes.push_back(word + "0");
+    }
+    for (auto& prefix : prefixes) {
+      REQUIRE(built.get_words(prefix) == under(prefix));
+    }
+    REQUIRE(built.get_words("") == built.get_words());
+    REQUIRE(built.get_words("catt").empty());
+
+    auto high = high_byte_pairs();
+    trie::impl7::trie<int> bytes{trie::sorted_input, std::begin(high), std::end(high)};
+    REQUIRE(bytes.get_words("\x80") == std::vector<std::string>({ "\x80z", "\x80\x80" }));
+    REQUIRE(bytes.get_words("\xff") == std::vector<std::string>({ "\xff", "\xff\x80" }));
+    REQUIRE(bytes.get_words("\x81").empty());
+  }
+
+  SECTION("matches the impl3 trie it was built from") {
+    trie::impl3::trie<int> source;
+    fill_source(source, pairs, *s_random_words);
+
+    // every three letter word over 'a' to 'p' makes 1 + 16 + 256 + 4096 nodes whatever the
+    // random words are, so the louds bits span well over 16 blocks of 512
+    std::vector<std::string> grid;
+    for (char a = 'a'; a != 'q'; ++a) {
+      for (char b = 'a'; b != 'q'; ++b) {
+        for (char c = 'a'; c != 'q'; ++c) {
+          grid.push_back({ a, b, c });
+          source.insert(grid.back(), 3);
+        }
+      }
+    }
+
+    trie::impl7::trie<int> built{source};
+    REQUIRE(built.node_count() >= 4369);
+    for (auto& word : grid) {
+      int value = 0;
+      REQUIRE(built.value_at(word, value));
+      REQUIRE(value == 3);
+    }
+    check_built_from(built, source);
+  }
+}
+
+TEST_CASE("impl8", "[impl8::trie]") {
+  auto pairs = static_pairs();
+
+  SECTION("empty trie") {
+    pairs_t nothing;
+    trie::impl8::trie<int> empty{trie::sorted_input, std::begin(nothing), std::end(nothing)};
+    REQUIRE(empty.state_count() == 1);
+    check_empty(empty);
+  }
+
+  // every word keeps its own value even though "bake" and "cake" end in the same state
+  trie::impl8::trie<int> t{trie::sorted_input, std::begin(pairs), std::end(pairs)};
+  check_static_pairs(t);
+  REQUIRE(!t.exists("cbt")); // merged states don't make new words
+
+  SECTION("shares suffixes") {
+    pairs_t verbs = {
+      { "talked", 1 }, { "talking", 2 }, { "walked", 3 }, { "walking", 4 }
+    };
+
+    // the root, one state after 't' or 'w', "al", "k", "e", "i", "in" and the final state
+    int value = 0;
+    trie::impl8::trie<int> shared{trie::sorted_input, std::begin(verbs), std::end(verbs)};
+    REQUIRE(shared.state_count() == 9);
+    REQUIRE(shared.get_words() == std::vector<std::string>({ "talked", "talking", "walked", "walking" }));
+    for (auto& verb : verbs) {
+      REQUIRE(shared.value_at(verb.first, value));
+      REQUIRE(value == verb.second);
+    }
+    REQUIRE(!shared.exists("talk"));
+  }
+
+  SECTION("transitions are in unsigned order") {
+    auto high = high_byte_pairs();
+    check_high_bytes(trie::impl8::trie<int>{trie::sorted_input, std::begin(high), std::end(high)});
+
+    // impl3 walks its words in signed order, so the words get sorted again on the way in
+    trie::impl3::trie<int> source;
+    fill_source(source, high);
+    check_high_bytes(trie::impl8::trie<int>{source});
+  }
+
+  SECTION("matches the impl3 trie it was built from") {
+    trie::impl3::trie<int> source;
+    fill_source(source, pairs, *s_random_words);
+    check_built_from(trie::impl8::trie<int>{source}, source);
+  }
+}
+
+TEST_CASE("impl9", "[impl9::trie]") {
+  // the same checks on a trie which bursts all the time and one which never bursts here
+  std::size_t threshold = trie::impl9::trie<int>::default_burst_threshold;
+  SECTION("default burst threshold") { }
+  SECTION("tiny burst threshold") {
+    threshold = 2;
+
+    // bursts pick a child by unsigned byte and containers sort their suffixes unsigned, so
+    // these cross 0x7f/0x80 both above and below a burst
+    trie::impl9::trie<int> bytes{threshold};
+    for (auto& pair : high_byte_pairs()) {
+      bytes.insert(pair.first, pair.second);
+    }
+    REQUIRE(bytes.trie_node_count() > 1);
+    check_high_bytes(bytes);
+  }
+
+  trie::impl9::trie<int> t{threshold};
+  REQUIRE(t.burst_threshold() == threshold);
+  REQUIRE(t.get_words().empty());
+  REQUIRE(!t.exists("cat"));
+
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+  t.insert("cat", 100); // the first value stays
+  t.insert("", 8);      // the empty word is never stored
+
+  REQUIRE(t.size() == 7);
+  REQUIRE(t.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "ca", "cake", "cat", "somereallylongword" }));
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.exists("ca"));
+  REQUIRE(!t.exists("c"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(!t.exists("bbake"));
+  REQUIRE(!t.exists(""));
+
+  int value = 0;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+  REQUIRE(t.value_at("ca", value));
+  REQUIRE(value == 7);
+  REQUIRE(t.value_at("somereallylongword", value));
+  REQUIRE(value == 6);
+  REQUIRE(!t.value_at("somereallylongwor", value));
+
+  std::string match;
+  REQUIRE(t.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+  REQUIRE(t.prefix_match("c", match));
+  REQUIRE(match == "ca");
+
+  match.clear();
+  REQUIRE(!t.prefix_match("", match));
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(!t.prefix_match("somereallylongwordd", match));
+  REQUIRE(match.empty());
+
+  // enough words to burst the tiny threshold many levels down
+  trie::impl3::trie<int> source;
+  for (auto& word : t.get_words()) {
+    REQUIRE(t.value_at(word, value));
+    source.insert(word, value);
+  }
+  for (auto& word : *s_random_words) {
+    t.insert(word, static_cast<int>(word.size()));
+    source.insert(word, static_cast<int>(word.size()));
+  }
+  if (threshold == 2) REQUIRE(t.trie_node_count() > 1);
+
+  REQUIRE(t.get_words() == source.get_words());
+  for (auto& word : *s_random_words) {
+    int expected = 0;
+    REQUIRE(source.value_at(word, expected));
+    REQUIRE(t.value_at(word, value));
+    REQUIRE(value == expected);
+    REQUIRE(!t.exists(word + "0"));
+
+    std::string expected_match;
+    auto prefix = word.substr(0, 2);
+    REQUIRE(source.prefix_match(prefix, expected_match));
+    REQUIRE(t.prefix_match(prefix, match));
+    REQUIRE(match == expected_match);
+  }
+}
+
+TEST_CASE("simd compares", "[simd]") {
+  // every length around the 16 and 32 byte blocks, differing at every position
+  std::string a(100, 'x');
+  for (std::size_t length = 0; length != a.size(); ++length) {
+    std::string b = a.substr(0, length);
+    REQUIRE(trie::simd::mismatch(a.data(), b.data(), length) == length);
+    REQUIRE(trie::simd::equal(std::begin(b), std::end(b), std::begin(a), std::begin(a) + length));
+    REQUIRE(!trie::simd::equal(std::begin(b), std::end(b), std::begin(a), std::end(a)));
+
+    for (std::size_t pos = 0; pos != length; ++pos) {
+      b[pos] = static_cast<char>(0x80); // a high byte to catch signed compares
+      REQUIRE(trie::simd::mismatch(a.data(), b.data(), length) == pos);
+      REQUIRE(!trie::simd::equal(a.data(), b.data(), length));
+
+      auto found = trie::simd::mismatch(std::begin(a), std::end(a), std::begin(b), std::end(b));
+      REQUIRE(found.first - std::begin(a) == static_cast<std::ptrdiff_t>(pos));
+      REQUIRE(found.second - std::begin(b) == static_cast<std::ptrdiff_t>(pos));
+      b[pos] = 'x';
+    }
+  }
+
+  // the dispatcher only ever hands out one kernel, so call each of them directly
+  std::vector<trie::simd::detail::mismatch_fn> kernels = { trie::simd::detail::mismatch_scalar };
+#if defined(TRIE_HAS_SSE2)
+  kernels.push_back(trie::simd::detail::mismatch_sse2);
+#endif
+#if defined(TRIE_HAS_AVX2_DISPATCH)
+  if (trie::simd::detail::has_avx2()) kernels.push_back(trie::simd::detail::mismatch_avx2);
+#endif
+  std::string c(101, 'x');
+  for (auto kernel : kernels) {
+    for (std::size_t length = 0; length <= 100; ++length) {
+      std::string d = c.substr(0, length);
+      REQUIRE(kernel(c.data(), d.data(), length) == length);
+      for (std::size_t pos = 0; pos != length; ++pos) {
+        d[pos] = static_cast<char>(0x80);
+        REQUIRE(kernel(c.data(), d.data(), length) == pos);
+        REQUIRE(kernel(d.data(), c.data(), length) == pos);
+        d[pos] = 'x';
+      }
+    }
+  }
+
+  std::string empty;
+  REQUIRE(trie::simd::equal(std::begin(empty), std::end(empty), std::begin(empty), std::end(empty)));
+  auto none = trie::simd::mismatch(std::begin(empty), std::end(empty), std::begin(a), std::end(a));
+  REQUIRE(none.first == std::end(empty));
+  REQUIRE(none.second == std::begin(a));
+}
+
+TEST_CASE("impl3 concurrent", "[impl3::concurrent_trie]") {
+  trie::impl3::concurrent_trie<int> t;
+  REQUIRE(t.get_words().empty());
+  REQUIRE(!t.exists("cat"));
+
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+  t.insert("cat", 100); // the first value stays
+  t.insert("", 8);      // the empty word is never stored
+
+  REQUIRE(t.size() == 7);
+  REQUIRE(t.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "ca", "cake", "cat", "somereallylongword" }));
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.exists("ca"));
+  REQUIRE(!t.exists("c"));
+  REQUIRE(!t.exists("catt"));
+  REQUIRE(!t.exists(""));
+
+  int value = 0;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+  REQUIRE(t.value_at("ca", value));
+  REQUIRE(value == 7);
+  REQUIRE(!t.value_at("somereallylongwor", value));
+
+  std::string match;
+  REQUIRE(t.prefix_match("so", match));
+  REQUIRE(match == "somereallylongword");
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake"); // since 'k' comes before 't' in 'bake' vs bat'
+  REQUIRE(t.prefix_match("c", match));
+  REQUIRE(match == "ca");
+
+  match.clear();
+  REQUIRE(!t.prefix_match("", match));
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(!t.prefix_match("somereallylongwordd", match));
+  REQUIRE(match.empty());
+
+  SECTION("readers while a writer inserts") {
+    trie::impl3::concurrent_trie<int> shared;
+    auto& words = *s_random_words;
+
+    // words[i] is in once inserted > i, the readers must see it with its value from then on
+    std::atomic<std::size_t> inserted{0};
+    std::atomic<bool>        done{false};
+    std::atomic<std::size_t> failures{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r != 4; ++r) {
+      readers.emplace_back([&, r] {
+        std::size_t next = static_cast<std::size_t>(r);
+        while (!done.load()) {
+          auto count = inserted.load(std::memory_order_acquire);
+          if (count == 0) continue;
+
+          auto& word = words[next++ % count];
+          int   found = 0;
+          if (!shared.value_at(word, found) || found != static_cast<int>(word.size())) {
+            failures.fetch_add(1);
+          }
+        }
+      });
+    }
+
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      shared.insert(words[i], static_cast<int>(words[i].size()));
+      inserted.store(i + 1, std::memory_order_release);
+    }
+    done.store(true);
+    for (auto& reader : readers) {
+      reader.join();
+    }
+
+    REQUIRE(failures.load() == 0);
+    REQUIRE(shared.size() == words.size());
+    for (auto& word : words) {
+      REQUIRE(shared.exists(word));
+    }
+  }
+
+  SECTION("more readers than reader slots") {
+    trie::impl3::concurrent_trie<int> shared;
+    auto& words = *s_random_words;
+    for (auto& word : words) {
+      shared.insert(word, static_cast<int>(word.size()));
+    }
+
+    // past the 64 slots the extra readers have to wait for one to come free
+    std::atomic<std::size_t> failures{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r != 96; ++r) {
+      readers.emplace_back([&] {
+        for (auto& word : words) {
+          if (!shared.exists(word)) failures.fetch_add(1);
+        }
+      });
+    }
+    for (auto& reader : readers) {
+      reader.join();
+    }
+
+    REQUIRE(failures.load() == 0);
+  }
+}
+
+TEST_CASE("impl3 sharded", "[impl3::sharded_trie]") {
+  trie::impl3::sharded_trie<int> t;
+  REQUIRE(t.shard_count() == 256);
+  REQUIRE(t.get_words().empty());
+  REQUIRE(!t.exists("cat"));
+
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+  t.insert("cat", 100); // the first value stays
+  t.insert("", 8);      // the empty word is never stored
+
+  REQUIRE(t.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "ca", "cake", "cat", "somereallylongword" }));
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.exists("ca"));
+  REQUIRE(!t.exists("c"));
+  REQUIRE(!t.exists(""));
+
+  int value = 0;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+  REQUIRE(!t.value_at("somereallylongwor", value));
+
+  std::string match;
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake");
+  REQUIRE(t.prefix_match("c", match));
+  REQUIRE(match == "ca");
+  match.clear();
+  REQUIRE(!t.prefix_match("", match));
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(match.empty());
+
+  REQUIRE(t.erase("cat"));
+  REQUIRE(!t.erase("cat"));
+  REQUIRE(!t.exists("cat"));
+  REQUIRE(t.exists("cake"));
+
+  // shard counts below, at and above one per first byte
+  std::size_t shard_count = 0;
+  SECTION("one shard") { shard_count = 1; }
+  SECTION("uneven shards") { shard_count = 7; }
+  SECTION("one shard per first byte") { shard_count = 256; }
+  SECTION("two byte shards") { shard_count = 4096; }
+
+  trie::impl3::sharded_trie<int> shared{shard_count};
+  trie::impl3::trie<int>         expected;
+  auto& words = *s_random_words;
+  for (auto& word : words) {
+    expected.insert(word, static_cast<int>(word.size()));
+  }
+
+  std::vector<std::thread> writers;
+  for (std::size_t w = 0; w != 4; ++w) {
+    writers.emplace_back([&, w] {
+      for (auto i = w; i < words.size(); i += 4) {
+        shared.insert(words[i], static_cast<int>(words[i].size()));
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  REQUIRE(shared.get_words() == expected.get_words());
+  for (auto& word : words) {
+    int found = 0;
+    REQUIRE(shared.value_at(word, found));
+    REQUIRE(found == static_cast<int>(word.size()));
+    REQUIRE(!shared.exists(word + "0"));
+
+    std::string shared_match, expected_match;
+    for (std::size_t len = 1; len <= word.size(); ++len) {
+      auto prefix = word.substr(0, len);
+      REQUIRE(shared.prefix_match(prefix, shared_match) == expected.prefix_match(prefix, expected_match));
+      REQUIRE(shared_match == expected_match);
+    }
+  }
+
+  for (std::size_t i = 0; i < words.size(); i += 2) {
+    REQUIRE(shared.erase(words[i]));
+    REQUIRE(expected.erase(words[i]));
+  }
+  REQUIRE(shared.get_words() == expected.get_words());
+}
+
+TEST_CASE("impl3 persistent", "[impl3::persistent_trie]") {
+  trie::impl3::persistent_trie<int> empty;
+  REQUIRE(empty.get_words().empty());
+  REQUIRE(empty.size() == 0);
+
+  auto t = empty.insert("cat", 1)
+                .insert("bat", 2)
+                .insert("cake", 3)
+                .insert("bake", 4)
+                .insert("abcd", 5)
+                .insert("somereallylongword", 6)
+                .insert("ca", 7);
+
+  // the first value stays and the empty word is never stored, nothing changes
+  REQUIRE(t.insert("cat", 100).shares_root_with(t));
+  REQUIRE(t.insert("", 8).shares_root_with(t));
+  REQUIRE(t.erase("dog").shares_root_with(t));
+
+  REQUIRE(t.size() == 7);
+  REQUIRE(t.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "ca", "cake", "cat", "somereallylongword" }));
+  REQUIRE(empty.get_words().empty()); // older versions stay as they were
+
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.exists("ca"));
+  REQUIRE(!t.exists("c"));
+  REQUIRE(!t.exists(""));
+
+  int value = 0;
+  REQUIRE(t.value_at("cat", value));
+  REQUIRE(value == 1);
+  REQUIRE(t.value_at("ca", value));
+  REQUIRE(value == 7);
+
+  std::string match;
+  REQUIRE(t.prefix_match("ba", match));
+  REQUIRE(match == "bake");
+  REQUIRE(t.prefix_match("c", match));
+  REQUIRE(match == "ca");
+  match.clear();
+  REQUIRE(!t.prefix_match("", match));
+  REQUIRE(!t.prefix_match("zz", match));
+  REQUIRE(match.empty());
+
+  // rolling back is holding on to the version before
+  auto erased = t.erase("ca").erase("cat");
+  REQUIRE(erased.size() == 5);
+  REQUIRE(erased.get_words() == std::vector<std::string>({ "abcd", "bake", "bat", "cake", "somereallylongword" }));
+  REQUIRE(erased.prefix_match("ca", match));
+  REQUIRE(match == "cake");
+  REQUIRE(t.exists("ca"));
+  REQUIRE(t.exists("cat"));
+  REQUIRE(t.size() == 7);
+
+  SECTION("versions against impl3") {
+    auto& words = *s_random_words;
+
+    // every version of the trie along with what impl3 holds at that point
+    std::vector<trie::impl3::persistent_trie<int>> versions{ trie::impl3::persistent_trie<int>{} };
+    std::vector<std::vector<std::string>>         expected{ {} };
+    trie::impl3::trie<int>                        reference;
+    for (auto& word : words) {
+      versions.push_back(versions.back().insert(word, static_cast<int>(word.size())));
+      reference.insert(word, static_cast<int>(word.size()));
+      if ((versions.size() - 1) % 50 == 0) expected.push_back(reference.get_words());
+    }
+
+    for (std::size_t i = 0; i != expected.size(); ++i) {
+      REQUIRE(versions[i * 50].get_words() == expected[i]);
+    }
+
+    auto& all = versions.back();
+    REQUIRE(all.get_words() == reference.get_words());
+    for (auto& word : words) {
+      int found = 0;
+      REQUIRE(all.value_at(word, found));
+      REQUIRE(found == static_cast<int>(word.size()));
+      REQUIRE(!all.exists(word + "0"));
+
+      std::string all_match, expected_match;
+      for (std::size_t len = 1; len <= word.size(); ++len) {
+        auto prefix = word.substr(0, len);
+        REQUIRE(all.prefix_match(prefix, all_match) == reference.prefix_match(prefix, expected_match));
+        REQUIRE(all_match == expected_match);
+      }
+    }
+
+    // erasing every other word, the full version doesn't notice
+    auto half = all;
+    for (std::size_t i = 0; i < words.size(); i += 2) {
+      half = half.erase(words[i]);
+      REQUIRE(reference.erase(words[i]));
+    }
+    REQUIRE(half.get_words() == reference.get_words());
+    REQUIRE(half.size() == all.size() - (words.size() + 1) / 2);
+    REQUIRE(all.size() == words.size());
+    for (auto& word : words) {
+      REQUIRE(all.exists(word));
+    }
+
+    // and erasing the rest leaves nothing behind
+    for (std::size_t i = 1; i < words.size(); i += 2) {
+      half = half.erase(words[i]);
+    }
+    REQUIRE(half.size() == 0);
+    REQUIRE(half.get_words().empty());
+  }
+}
+
+TEST_CASE("fuzzy search", "[fuzzy_search]") {
+  trie::impl3::trie<int> t;
+  REQUIRE(t.fuzzy_search("cat", 2).empty());
+
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+
+  typedef std::vector<std::pair<std::string, std::size_t>> matches_t;
+  REQUIRE(t.fuzzy_search("cat", 0) == matches_t({ { "cat", 0 } }));
+  REQUIRE(t.fuzzy_search("cat", 1) == matches_t({ { "bat", 1 }, { "ca", 1 }, { "cat", 0 } }));
+  REQUIRE(t.fuzzy_search("cat", 2) == matches_t({ { "bat", 1 }, { "ca", 1 }, { "cake", 2 }, { "cat", 0 } }));
+  REQUIRE(t.fuzzy_search("cat", 3).size() == 5); // "bake" is three edits away
+  REQUIRE(t.fuzzy_search("cta", 0).empty());
+  REQUIRE(t.fuzzy_search("", 2) == matches_t({ { "ca", 2 } }));
+
+  // the edits can land in the middle of leaf data
+  REQUIRE(t.fuzzy_search("somerealylongwrd", 2) == matches_t({ { "somereallylongword", 2 } }));
+  REQUIRE(t.fuzzy_search("somerealylongwrd", 1).empty());
+
+  SECTION("against every word") {
+    auto& words = *s_random_words;
+
+    trie::impl3::trie<int> all;
+    for (auto& word : words) {
+      all.insert(word, static_cast<int>(word.size()));
+    }
+
+    auto distance = [](const std::string& a, const std::string& b) {
+      std::vector<std::size_t> row(b.size() + 1);
+      for (std::size_t j = 0; j != row.size(); ++j) row[j] = j;
+
+      for (std::size_t i = 1; i <= a.size(); ++i) {
+        auto diagonal = row[0];
+        row[0] = i;
+        for (std::size_t j = 1; j <= b.size(); ++j) {
+          auto above = row[j];
+          row[j] = std::min({ row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] != b[j - 1] ? 1 : 0) });
+          diagonal = above;
+        }
+      }
+      return row.back();
+    };
+
+    auto sorted = all.get_words();
+    for (std::size_t i = 0; i < words.size(); i += 10) {
+      // the word itself, and the word with its first char dropped and a 'q' on the end
+      auto edited = words[i];
+      edited.erase(0, 1);
+      edited.push_back('q');
+
+      for (auto& query : { words[i], edited }) {
+        for (std::size_t max_distance = 0; max_distance != 4; ++max_distance) {
+          matches_t expected;
+          for (auto& word : sorted) {
+            auto d = distance(query, word);
+            if (d <= max_distance) expected.emplace_back(word, d);
+          }
+          REQUIRE(all.fuzzy_search(query, max_distance) == expected);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("impl3 aho_corasick", "[impl3::aho_corasick]") {
+  trie::impl3::trie<int> t;
+  t.insert("he", 1);
+  t.insert("she", 2);
+  t.insert("his", 3);
+  t.insert("hers", 4);
+  t.insert("s", 5);
+
+  trie::impl3::aho_corasick<int> automaton{t};
+  REQUIRE(automaton.size() == 5);
+  REQUIRE(automaton.state_count() == 10); // the root, h, he, her, hers, hi, his, s, sh, she
+
+  typedef std::tuple<std::size_t, std::string, int> match_t;
+  std::vector<match_t> matches;
+  auto collect = [&matches](std::size_t offset, const std::string& word, int value) {
+    matches.emplace_back(offset, word, value);
+  };
+
+  automaton.scan("ushers", collect);
+  REQUIRE(matches == std::vector<match_t>({ match_t{ 1, "s", 5 }, match_t{ 1, "she", 2 }, match_t{ 2, "he", 1 },
+                                            match_t{ 2, "hers", 4 }, match_t{ 5, "s", 5 } }));
+
+  matches.clear();
+  automaton.scan("", collect);
+  automaton.scan("xyz", collect);
+  REQUIRE(matches.empty());
+
+  SECTION("against every offset") {
+    auto& words = *s_random_words;
+
+    trie::impl3::trie<int> all;
+    for (std::size_t i = 0; i < words.size(); i += 3) {
+      all.insert(words[i], static_cast<int>(i));
+    }
+    trie::impl3::aho_corasick<int> big{all};
+
+    // the text is the other words run together, then the words looked for at every offset
+    std::string text;
+    for (std::size_t i = 0; i != words.size(); ++i) {
+      text += words[i];
+    }
+
+    std::vector<match_t> expected;
+    for (std::size_t end = 1; end <= text.size(); ++end) {
+      // by where they end, longest first
+      for (std::size_t offset = 0; offset != end; ++offset) {
+        int value = 0;
+        auto word = text.substr(offset, end - offset);
+        if (all.value_at(word, value)) expected.emplace_back(offset, word, value);
+      }
+    }
+    REQUIRE(!expected.empty());
+
+    big.scan(text, collect);
+    REQUIRE(matches == expected);
+
+    // the same split up in uneven pieces, matches spanning pieces included
+    for (std::size_t piece : { 1, 7, 64 }) {
+      matches.clear();
+      auto scanner = big.make_scanner();
+      for (std::size_t first = 0; first < text.size(); first += piece) {
+        scanner.feed(text.data() + first, std::min(piece, text.size() - first), collect);
+      }
+      REQUIRE(scanner.offset() == text.size());
+      REQUIRE(matches == expected);
+
+      scanner.reset();
+      REQUIRE(scanner.offset() == 0);
+    }
+  }
+}
+
+TEST_CASE("longest prefix", "[longest_prefix_of]") {
+  trie::impl3::trie<int> t;
+  t.insert("/", 1);
+  t.insert("/api", 2);
+  t.insert("/api/v1", 3);
+  t.insert("/api/v1/users", 4);
+  t.insert("/static", 5);
+
+  auto frozen = t.freeze();
+
+  std::ostringstream out;
+  REQUIRE(frozen.write(out));
+  auto image = out.str();
+  trie::impl3::mapped_trie<int> mapped;
+  REQUIRE(mapped.attach(image.data(), image.size()));
+
+  auto check = [](const auto& routes) {
+    std::string match;
+    int         value = 0;
+    REQUIRE(routes.longest_prefix_of("/api/v1/users/42", match, value));
+    REQUIRE(match == "/api/v1/users");
+    REQUIRE(value == 4);
+    REQUIRE(routes.longest_prefix_of("/api/v1/user", match, value));
+    REQUIRE(match == "/api/v1");
+    REQUIRE(value == 3);
+    REQUIRE(routes.longest_prefix_of("/api/v2", match, value));
+    REQUIRE(match == "/api");
+    REQUIRE(routes.longest_prefix_of("/api", match));
+    REQUIRE(match == "/api");
+    REQUIRE(routes.longest_prefix_of("/stat", match, value)); // ends in the middle of a leaf
+    REQUIRE(match == "/");
+    REQUIRE(value == 1);
+    REQUIRE(routes.longest_prefix_of("/static/app.js", match, value));
+    REQUIRE(match == "/static");
+
+    match.clear();
+    REQUIRE(!routes.longest_prefix_of("", match));
+    REQUIRE(!routes.longest_prefix_of("api", match));
+    REQUIRE(match.empty());
+  };
+  check(t);
+  check(frozen);
+  check(mapped);
+
+  SECTION("against every prefix") {
+    auto& words = *s_random_words;
+
+    // every other word is stored, the rest are keys to look up
+    trie::impl3::trie<int> all;
+    for (std::size_t i = 0; i < words.size(); i += 2) {
+      all.insert(words[i], static_cast<int>(i));
+    }
+    auto all_frozen = all.freeze();
+
+    for (auto& word : words) {
+      auto key = word + "xyz";
+
+      std::string expected;
+      int         expected_value = -1;
+      for (auto len = key.size(); len != 0; --len) {
+        if (all.value_at(key.substr(0, len), expected_value)) {
+          expected = key.substr(0, len);
+          break;
+        }
+      }
+
+      std::string match;
+      int         value = -1;
+      REQUIRE(all.longest_prefix_of(key, match, value) == !expected.empty());
+      REQUIRE(match == expected);
+      REQUIRE(value == expected_value);
+
+      match.clear();
+      value = -1;
+      REQUIRE(all_frozen.longest_prefix_of(key, match, value) == !expected.empty());
+      REQUIRE(match == expected);
+      REQUIRE(value == expected_value);
+    }
+
+    // the batch finds the same values as one at a time
+    std::vector<std::string> keys;
+    for (auto& word : words) {
+      keys.push_back(word.substr(0, word.size() / 2 + 1) + "xyz");
+      keys.push_back(word);
+    }
+    std::vector<const int*> found(keys.size());
+    all_frozen.longest_prefix_of_batch(std::begin(keys), std::end(keys), std::begin(found));
+    for (std::size_t i = 0; i != keys.size(); ++i) {
+      std::string match;
+      int         value = -1;
+      REQUIRE(all_frozen.longest_prefix_of(keys[i], match, value) == (found[i] != nullptr));
+      if (found[i]) REQUIRE(*found[i] == value);
+    }
+  }
+}
+
+TEST_CASE("pattern match", "[match_pattern]") {
+  trie::impl3::trie<int> t;
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("abcd", 5);
+  t.insert("somereallylongword", 6);
+  t.insert("ca", 7);
+  t.insert("cave", 8);
+  t.insert("caves", 9);
+
+  auto matches = [&t](const std::string& pattern) {
+    std::vector<std::pair<std::string, int>> ret;
+    t.match_pattern(pattern, [&ret](const std::string& word, int value) { ret.emplace_back(word, value); });
+    return ret;
+  };
+  typedef std::vector<std::pair<std::string, int>> matches_t;
+
+  REQUIRE(matches("cat") == matches_t({ { "cat", 1 } }));
+  REQUIRE(matches("c") == matches_t());
+  REQUIRE(matches("") == matches_t());
+  REQUIRE(matches("ca?e") == matches_t({ { "cake", 3 }, { "cave", 8 } }));
+  REQUIRE(matches("ca?e*") == matches_t({ { "cake", 3 }, { "cave", 8 }, { "caves", 9 } }));
+  REQUIRE(matches("?at") == matches_t({ { "bat", 2 }, { "cat", 1 } }));
+  REQUIRE(matches("*e") == matches_t({ { "bake", 4 }, { "cake", 3 }, { "cave", 8 } }));
+  REQUIRE(matches("ca*") == matches_t({ { "ca", 7 }, { "cake", 3 }, { "cat", 1 }, { "cave", 8 }, { "caves", 9 } }));
+  REQUIRE(matches("*").size() == 9);
+  REQUIRE(matches("*z*") == matches_t());
+  REQUIRE(matches("*a*").size() == 9); // every word, each once
+  REQUIRE(matches("**a**") == matches("*a*"));
+
+  // wildcards inside of leaf data
+  REQUIRE(matches("some*long?ord") == matches_t({ { "somereallylongword", 6 } }));
+  REQUIRE(matches("some*short*") == matches_t());
+  REQUIRE(matches("somereallylongword?") == matches_t());
+
+  SECTION("against every word") {
+    auto& words = *s_random_words;
+
+    trie::impl3::trie<int> all;
+    for (auto& word : words) {
+      all.insert(word, static_cast<int>(word.size()));
+    }
+    auto sorted = all.get_words();
+
+    // a plain recursive glob to check against
+    std::function<bool(const char*, const char*)> glob = [&glob](const char* p, const char* w) {
+      if (!*p) return !*w;
+      if (*p == '*') return glob(p + 1, w) || (*w && glob(p, w + 1));
+      return *w && (*p == '?' || *p == *w) && glob(p + 1, w + 1);
+    };
+
+    for (std::size_t i = 0; i < words.size(); i += 10) {
+      auto& word = words[i];
+      for (auto pattern : { word.substr(0, 1) + "*", "*" + word.substr(word.size() - 1), "?" + word.substr(1),
+                            word.substr(0, 1) + "*" + word.substr(word.size() / 2, 1) + "*", std::string("??*??") }) {
+        std::vector<std::string> expected;
+        for (auto& candidate : sorted) {
+          if (glob(pattern.c_str(), candidate.c_str())) expected.push_back(candidate);
+        }
+
+        std::vector<std::string> found;
+        all.match_pattern(pattern, [&found](const std::string& match, int value) {
+          found.push_back(match);
+          (void)value;
+        });
+        REQUIRE(found == expected);
+      }
+    }
+  }
+}
+
+TEST_CASE("impl3 counts", "[impl3::count_augment]") {
+  typedef trie::impl3::trie<int, trie::heap_allocator, trie::impl3::count_augment> counted_trie;
+
+  counted_trie t;
+  REQUIRE(t.count_prefix("") == 0);
+  REQUIRE(t.rank("abc") == 0);
+  std::string word;
+  REQUIRE_FALSE(t.select(0, word));
+
+  t.insert("cat", 1);
+  t.insert("bat", 2);
+  t.insert("cake", 3);
+  t.insert("bake", 4);
+  t.insert("ca", 5);
+  t.insert("cave", 6);
+  t.insert("caves", 7);
+  t.insert("cat", 8); // already there, counts once
+
+  REQUIRE(t.count_prefix("") == 7);
+  REQUIRE(t.count_prefix("c") == 5);
+  REQUIRE(t.count_prefix("ca") == 5);
+  REQUIRE(t.count_prefix("cav") == 2);
+  REQUIRE(t.count_prefix("cave") == 2);
+  REQUIRE(t.count_prefix("caves") == 1);
+  REQUIRE(t.count_prefix("cavess") == 0);
+  REQUIRE(t.count_prefix("ba") == 2);
+  REQUIRE(t.count_prefix("bak") == 1); // ends inside of a leaf
+  REQUIRE(t.count_prefix("d") == 0);
+
+  auto words = t.get_words();
+  for (std::size_t i = 0; i != words.size(); ++i) {
+    REQUIRE(t.rank(words[i]) == i);
+    REQUIRE(t.select(i, word));
+    REQUIRE(word == words[i]);
+  }
+  REQUIRE_FALSE(t.select(words.size(), word));
+  REQUIRE(t.rank("a") == 0);
+  REQUIRE(t.rank("bb") == 2);
+  REQUIRE(t.rank("cak") == 3);
+  REQUIRE(t.rank("caz") == 7);
+  REQUIRE(t.rank("z") == 7);
+
+  SECTION("erase") {
+    REQUIRE(t.erase("cave"));
+    REQUIRE(t.count_prefix("") == 6);
+    REQUIRE(t.count_prefix("cav") == 1);
+    REQUIRE(t.erase("ca"));
+    REQUIRE(t.count_prefix("ca") == 3);
+    REQUIRE_FALSE(t.erase("ca"));
+    REQUIRE(t.count_prefix("") == 5);
+    REQUIRE(t.select(4, word));
+    REQUIRE(word == "caves");
+  }
+
+  SECTION("against every word") {
+    auto& random_words = *s_random_words;
+
+    counted_trie all;
+    for (auto& w : random_words) {
+      all.insert(w, 1);
+    }
+    // words with a value at a branch
+    for (std::size_t i = 0; i < random_words.size(); i += 7) {
+      all.insert(random_words[i].substr(0, random_words[i].size() / 2), 1);
+    }
+    // half of them gone again
+    for (std::size_t i = 0; i < random_words.size(); i += 2) {
+      all.erase(random_words[i]);
+    }
+
+    auto sorted = all.get_words();
+    REQUIRE(all.count_prefix("") == sorted.size());
+    for (std::size_t i = 0; i != sorted.size(); ++i) {
+      REQUIRE(all.rank(sorted[i]) == i);
+      REQUIRE(all.rank(sorted[i] + "0") == i + 1);
+      REQUIRE(all.select(i, word));
+      REQUIRE(word == sorted[i]);
+
+      auto prefix = sorted[i].substr(0, 2);
+      auto count  = static_cast<std::size_t>(std::count_if(std::begin(sorted), std::end(sorted),
+        [&prefix](const std::string& w) { return w.compare(0, prefix.size(), prefix) == 0; }));
+      REQUIRE(all.count_prefix(prefix) == count);
+    }
+
+    // the bulk loads work the counts out at the end
+    std::vector<std::pair<std::string, int>> input;
+    for (auto& w : sorted) {
+      input.emplace_back(w, 1);
+    }
+    counted_trie loaded{trie::sorted_input, std::begin(input), std::end(input)};
+    REQUIRE(loaded.count_prefix("") == sorted.size());
+    for (std::size_t i = 0; i < sorted.size(); i += 3) {
+      REQUIRE(loaded.rank(sorted[i]) == i);
+    }
+  }
 }